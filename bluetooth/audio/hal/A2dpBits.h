@@ -16,6 +16,10 @@
 
 #pragma once
 
+#include <bit>
+#include <cstdint>
+#include <vector>
+
 namespace aidl::android::hardware::bluetooth::audio {
 
 class A2dpBits {
@@ -29,11 +33,26 @@ class A2dpBits {
   A2dpBits(std::vector<uint8_t>& vector)
       : cdata_(vector.data()), data_(vector.data()) {}
 
+  constexpr A2dpBits(const uint8_t* data) : cdata_(data), data_(nullptr) {}
+
+  constexpr A2dpBits(uint8_t* data) : cdata_(data), data_(data) {}
+
+  /**
+   * Fields are numbered from the most significant bit of the first octet,
+   * a range spans at most 32 bits.
+   */
   struct Range {
     const int first, len;
     constexpr Range(int first, int last)
         : first(first), len(last - first + 1) {}
     constexpr Range(int index) : first(index), len(1) {}
+
+    constexpr int last() const { return first + len - 1; }
+    constexpr int first_octet() const { return first >> 3; }
+    constexpr int last_octet() const { return last() >> 3; }
+    // Position of the range LSB, counted from the LSB of its last octet
+    constexpr int shift() const { return 7 - (last() & 7); }
+    constexpr uint64_t mask() const { return ((uint64_t(1) << len) - 1); }
   };
 
   constexpr bool get(int bit) const {
@@ -41,10 +60,7 @@ class A2dpBits {
   }
 
   constexpr unsigned get(const Range& range) const {
-    unsigned v(0);
-    for (int i = 0; i < range.len; i++)
-      v |= get(range.first + i) << ((range.len - 1) - i);
-    return v;
+    return (load(range) >> range.shift()) & range.mask();
   }
 
   constexpr void set(int bit, int value = 1) {
@@ -56,19 +72,32 @@ class A2dpBits {
   }
 
   constexpr void set(const Range& range, int value) {
-    for (int i = 0; i < range.len; i++)
-      set(range.first + i, (value >> ((range.len - 1) - i)) & 1);
+    const uint64_t m = range.mask() << range.shift();
+    uint64_t v = load(range);
+    v = (v & ~m) | ((uint64_t(unsigned(value)) << range.shift()) & m);
+    store(range, v);
   }
 
   constexpr int find_active_bit(const Range& range) const {
     unsigned v = get(range);
-    int i = 0;
-    for (; i < range.len && ((v >> i) & 1) == 0; i++)
-      ;
-    return i < range.len && (v ^ (1 << i)) == 0
-               ? range.first + (range.len - 1) - i
+    return std::has_single_bit(v)
+               ? range.first + (range.len - 1) - std::countr_zero(v)
                : -1;
   }
+
+ private:
+  // Big-endian load of the octets covered by the range, at most 5 octets
+  constexpr uint64_t load(const Range& range) const {
+    uint64_t v(0);
+    for (int i = range.first_octet(); i <= range.last_octet(); i++)
+      v = (v << 8) | cdata_[i];
+    return v;
+  }
+
+  constexpr void store(const Range& range, uint64_t v) {
+    for (int i = range.last_octet(); i >= range.first_octet(); i--, v >>= 8)
+      data_[i] = uint8_t(v);
+  }
 };
 
 }  // namespace aidl::android::hardware::bluetooth::audio
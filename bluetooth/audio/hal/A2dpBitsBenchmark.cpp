@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+#include "A2dpBits.h"
+
+using aidl::android::hardware::bluetooth::audio::A2dpBits;
+
+namespace {
+
+// AAC and SBC field layouts, as walked by ParseConfiguration and
+// BuildConfiguration of the offload codecs
+const std::vector<A2dpBits::Range> kAacRanges = {
+    A2dpBits::Range(0, 6),   A2dpBits::Range(7),      A2dpBits::Range(8, 19),
+    A2dpBits::Range(20, 23), A2dpBits::Range(24),     A2dpBits::Range(25, 47),
+};
+const std::vector<A2dpBits::Range> kSbcRanges = {
+    A2dpBits::Range(0, 3),   A2dpBits::Range(4, 7),   A2dpBits::Range(8, 11),
+    A2dpBits::Range(12, 13), A2dpBits::Range(14, 15), A2dpBits::Range(16, 23),
+    A2dpBits::Range(24, 31),
+};
+
+// Previous bit-per-iteration implementation, kept as the baseline
+unsigned BitwiseGet(const uint8_t* data, const A2dpBits::Range& range) {
+  unsigned v(0);
+  for (int i = 0; i < range.len; i++) {
+    int bit = range.first + i;
+    v |= ((data[bit >> 3] >> (7 - (bit & 7))) & 1u) << ((range.len - 1) - i);
+  }
+  return v;
+}
+
+void BitwiseSet(uint8_t* data, const A2dpBits::Range& range, int value) {
+  for (int i = 0; i < range.len; i++) {
+    int bit = range.first + i;
+    uint8_t m = 1 << (7 - (bit & 7));
+    if ((value >> ((range.len - 1) - i)) & 1)
+      data[bit >> 3] |= m;
+    else
+      data[bit >> 3] &= ~m;
+  }
+}
+
+int BitwiseFindActiveBit(const uint8_t* data, const A2dpBits::Range& range) {
+  unsigned v = BitwiseGet(data, range);
+  int i = 0;
+  for (; i < range.len && ((v >> i) & 1) == 0; i++)
+    ;
+  return i < range.len && (v ^ (1 << i)) == 0
+             ? range.first + (range.len - 1) - i
+             : -1;
+}
+
+const std::vector<A2dpBits::Range>& RangesFor(const benchmark::State& state) {
+  return state.range(0) ? kSbcRanges : kAacRanges;
+}
+
+void BM_Get(benchmark::State& state) {
+  std::vector<uint8_t> data = {0x80, 0x01, 0x04, 0x83, 0xe8, 0x00};
+  auto& ranges = RangesFor(state);
+  for (auto _ : state) {
+    A2dpBits bits(data);
+    for (auto& range : ranges) benchmark::DoNotOptimize(bits.get(range));
+  }
+}
+BENCHMARK(BM_Get)->Arg(0)->Arg(1);
+
+void BM_BitwiseGet(benchmark::State& state) {
+  std::vector<uint8_t> data = {0x80, 0x01, 0x04, 0x83, 0xe8, 0x00};
+  auto& ranges = RangesFor(state);
+  for (auto _ : state) {
+    for (auto& range : ranges)
+      benchmark::DoNotOptimize(BitwiseGet(data.data(), range));
+  }
+}
+BENCHMARK(BM_BitwiseGet)->Arg(0)->Arg(1);
+
+void BM_Set(benchmark::State& state) {
+  std::vector<uint8_t> data(6);
+  auto& ranges = RangesFor(state);
+  int value = 0x5a5a5a;
+  for (auto _ : state) {
+    A2dpBits bits(data);
+    for (auto& range : ranges) bits.set(range, value++);
+    benchmark::ClobberMemory();
+  }
+}
+BENCHMARK(BM_Set)->Arg(0)->Arg(1);
+
+void BM_BitwiseSet(benchmark::State& state) {
+  std::vector<uint8_t> data(6);
+  auto& ranges = RangesFor(state);
+  int value = 0x5a5a5a;
+  for (auto _ : state) {
+    for (auto& range : ranges) BitwiseSet(data.data(), range, value++);
+    benchmark::ClobberMemory();
+  }
+}
+BENCHMARK(BM_BitwiseSet)->Arg(0)->Arg(1);
+
+void BM_FindActiveBit(benchmark::State& state) {
+  std::vector<uint8_t> data = {0x80, 0x01, 0x04, 0x83, 0xe8, 0x00};
+  auto& ranges = RangesFor(state);
+  for (auto _ : state) {
+    A2dpBits bits(data);
+    for (auto& range : ranges)
+      benchmark::DoNotOptimize(bits.find_active_bit(range));
+  }
+}
+BENCHMARK(BM_FindActiveBit)->Arg(0)->Arg(1);
+
+void BM_BitwiseFindActiveBit(benchmark::State& state) {
+  std::vector<uint8_t> data = {0x80, 0x01, 0x04, 0x83, 0xe8, 0x00};
+  auto& ranges = RangesFor(state);
+  for (auto _ : state) {
+    for (auto& range : ranges)
+      benchmark::DoNotOptimize(BitwiseFindActiveBit(data.data(), range));
+  }
+}
+BENCHMARK(BM_BitwiseFindActiveBit)->Arg(0)->Arg(1);
+
+}  // namespace
+
+BENCHMARK_MAIN();
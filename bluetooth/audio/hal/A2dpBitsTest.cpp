@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <random>
+
+#include "A2dpBits.h"
+
+using aidl::android::hardware::bluetooth::audio::A2dpBits;
+
+namespace {
+
+// Field layout shared with A2dpOffloadCodecAac
+constexpr A2dpBits::Range kObjectType(0, 6);
+constexpr A2dpBits::Range kDrcEnable(7);
+constexpr A2dpBits::Range kSamplingFrequency(8, 19);
+constexpr A2dpBits::Range kChannels(20, 23);
+constexpr A2dpBits::Range kBitrate(25, 47);
+
+constexpr std::array<uint8_t, 6> kAacConfiguration = {0x80, 0x01, 0x04,
+                                                      0x83, 0xe8, 0x00};
+
+constexpr unsigned Get(const std::array<uint8_t, 6>& data,
+                       const A2dpBits::Range& range) {
+  return A2dpBits(data.data()).get(range);
+}
+
+constexpr int FindActiveBit(const std::array<uint8_t, 6>& data,
+                            const A2dpBits::Range& range) {
+  return A2dpBits(data.data()).find_active_bit(range);
+}
+
+constexpr std::array<uint8_t, 6> Set(std::array<uint8_t, 6> data,
+                                     const A2dpBits::Range& range, int value) {
+  A2dpBits(data.data()).set(range, value);
+  return data;
+}
+
+static_assert(Get(kAacConfiguration, kObjectType) == 0x40);
+static_assert(Get(kAacConfiguration, kDrcEnable) == 0);
+static_assert(Get(kAacConfiguration, kSamplingFrequency) == 0x010);
+static_assert(Get(kAacConfiguration, kChannels) == 0x4);
+static_assert(Get(kAacConfiguration, kBitrate) == 0x03e800);
+static_assert(Get(kAacConfiguration, A2dpBits::Range(0, 31)) == 0x80010483);
+static_assert(Get(kAacConfiguration, A2dpBits::Range(13, 44)) == 0x20907d00);
+
+static_assert(FindActiveBit(kAacConfiguration, kObjectType) == 0);
+static_assert(FindActiveBit(kAacConfiguration, kSamplingFrequency) == 15);
+static_assert(FindActiveBit(kAacConfiguration, kChannels) == 21);
+static_assert(FindActiveBit(kAacConfiguration, kBitrate) == -1);
+static_assert(FindActiveBit(kAacConfiguration, kDrcEnable) == -1);
+
+static_assert(Set(kAacConfiguration, kBitrate, 0x7fffff) ==
+              std::array<uint8_t, 6>{0x80, 0x01, 0x04, 0xff, 0xff, 0xff});
+static_assert(Set(kAacConfiguration, kSamplingFrequency, 0x800) ==
+              std::array<uint8_t, 6>{0x80, 0x80, 0x04, 0x83, 0xe8, 0x00});
+static_assert(Set(kAacConfiguration, kDrcEnable, 1) ==
+              std::array<uint8_t, 6>{0x81, 0x01, 0x04, 0x83, 0xe8, 0x00});
+static_assert(Set(kAacConfiguration, A2dpBits::Range(4, 35), -1) ==
+              std::array<uint8_t, 6>{0x8f, 0xff, 0xff, 0xff, 0xf8, 0x00});
+
+// Reference bit-by-bit implementation
+unsigned ReferenceGet(const uint8_t* data, const A2dpBits::Range& range) {
+  unsigned v(0);
+  for (int i = 0; i < range.len; i++) {
+    int bit = range.first + i;
+    v |= ((data[bit >> 3] >> (7 - (bit & 7))) & 1u) << ((range.len - 1) - i);
+  }
+  return v;
+}
+
+TEST(A2dpBitsTest, GetSetMatchReference) {
+  std::mt19937 rng(0x5bc);
+  std::array<uint8_t, 8> data, expected;
+
+  for (int first = 0; first < 32; first++) {
+    for (int len = 1; len <= 32; len++) {
+      A2dpBits::Range range(first, first + len - 1);
+
+      for (auto& b : data) b = rng();
+      EXPECT_EQ(A2dpBits(data.data()).get(range),
+                ReferenceGet(data.data(), range));
+
+      int value = rng();
+      expected = data;
+      for (int i = 0; i < len; i++)
+        A2dpBits(expected.data())
+            .set(first + i, (value >> ((len - 1) - i)) & 1);
+      A2dpBits(data.data()).set(range, value);
+      EXPECT_EQ(data, expected) << "first=" << first << " len=" << len;
+    }
+  }
+}
+
+TEST(A2dpBitsTest, FindActiveBit) {
+  std::array<uint8_t, 8> data{};
+  A2dpBits::Range range(3, 29);
+
+  EXPECT_EQ(A2dpBits(data.data()).find_active_bit(range), -1);
+  for (int bit = range.first; bit <= range.last(); bit++) {
+    data = {};
+    A2dpBits(data.data()).set(bit);
+    EXPECT_EQ(A2dpBits(data.data()).find_active_bit(range), bit);
+    A2dpBits(data.data()).set(bit == range.first ? range.last() : range.first);
+    EXPECT_EQ(A2dpBits(data.data()).find_active_bit(range), -1);
+  }
+}
+
+}  // namespace
@@ -22,9 +22,6 @@
 #include <BluetoothAudioSessionReport.h>
 #include <android-base/logging.h>
 
-#include "A2dpOffloadCodecAac.h"
-#include "A2dpOffloadCodecSbc.h"
-
 namespace aidl {
 namespace android {
 namespace hardware {
@@ -57,7 +54,6 @@ ndk::ScopedAStatus A2dpOffloadAudioProvider::startSession(
     const std::vector<LatencyMode>& latency_modes, DataMQDesc* _aidl_return) {
   if (audio_config.getTag() == AudioConfiguration::Tag::a2dp) {
     auto a2dp_config = audio_config.get<AudioConfiguration::Tag::a2dp>();
-    A2dpStatus a2dp_status = A2dpStatus::NOT_SUPPORTED_CODEC_TYPE;
 
     auto codec = codec_factory_.GetCodec(a2dp_config.codecId);
     if (!codec) {
@@ -67,22 +63,9 @@ ndk::ScopedAStatus A2dpOffloadAudioProvider::startSession(
       return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
     }
 
-    if (codec->info.id == CodecId(CodecId::A2dp::SBC)) {
-      SbcParameters sbc_parameters;
-
-      auto codec_sbc =
-          std::static_pointer_cast<const A2dpOffloadCodecSbc>(codec);
-      a2dp_status = codec_sbc->ParseConfiguration(a2dp_config.configuration,
-                                                  &sbc_parameters);
-
-    } else if (codec->info.id == CodecId(CodecId::A2dp::AAC)) {
-      AacParameters aac_parameters;
-
-      auto codec_aac =
-          std::static_pointer_cast<const A2dpOffloadCodecAac>(codec);
-      a2dp_status = codec_aac->ParseConfiguration(a2dp_config.configuration,
-                                                  &aac_parameters);
-    }
+    CodecParameters codec_parameters;
+    A2dpStatus a2dp_status =
+        codec->ParseConfiguration(a2dp_config.configuration, &codec_parameters);
     if (a2dp_status != A2dpStatus::OK) {
       LOG(WARNING) << __func__ << " - Invalid Audio Configuration="
                    << audio_config.toString();
@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "A2dpOffloadCodec.h"
+
+namespace aidl::android::hardware::bluetooth::audio {
+
+class A2dpOffloadCodecAptx : public A2dpOffloadCodec {
+  CodecInfo info_;
+  const int bitdepth_;
+
+ protected:
+  A2dpOffloadCodecAptx(const CodecId& id, const std::string& name,
+                       size_t capabilities_size, int bitdepth);
+
+ public:
+  A2dpOffloadCodecAptx();
+
+  A2dpStatus ParseConfiguration(
+      const std::vector<uint8_t>& configuration,
+      CodecParameters* codec_parameters) const override;
+
+  bool BuildConfiguration(const std::vector<uint8_t>& remote_capabilities,
+                          const std::optional<CodecParameters>& hint,
+                          std::vector<uint8_t>* configuration) const override;
+};
+
+class A2dpOffloadCodecAptxHd : public A2dpOffloadCodecAptx {
+ public:
+  A2dpOffloadCodecAptxHd();
+};
+
+}  // namespace aidl::android::hardware::bluetooth::audio
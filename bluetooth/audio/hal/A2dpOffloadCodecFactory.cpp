@@ -14,37 +14,170 @@
  * limitations under the License.
  */
 
+#define LOG_TAG "BTAudioCodecFactoryA2dpHW"
+
 #include "A2dpOffloadCodecFactory.h"
 
+#include <android-base/logging.h>
+#include <android-base/properties.h>
+#include <android-base/strings.h>
+
 #include <algorithm>
 #include <cassert>
+#include <fstream>
 
 #include "A2dpOffloadCodecAac.h"
+#include "A2dpOffloadCodecAptx.h"
+#include "A2dpOffloadCodecLdac.h"
+#include "A2dpOffloadCodecOpus.h"
 #include "A2dpOffloadCodecSbc.h"
 
 namespace aidl::android::hardware::bluetooth::audio {
 
 /**
- * Local Capabilities Configuration
+ * Codec Registry
+ *
+ * Every offload codec the HAL knows how to negotiate. Which of them are
+ * enabled, and their rank, comes from the first codec list file found;
+ * one codec name per line, highest priority first, '#' starts a comment.
  */
 
-enum : bool {
-  kEnableAac = true,
-  kEnableSbc = true,
+struct A2dpOffloadCodecEntry {
+  const char* name;
+  std::shared_ptr<const A2dpOffloadCodec> (*make)();
+};
+
+template <typename T>
+static std::shared_ptr<const A2dpOffloadCodec> MakeCodec() {
+  return std::make_shared<T>();
+}
+
+// clang-format off
+
+static const A2dpOffloadCodecEntry kCodecRegistry[] = {
+  { "SBC",     MakeCodec<A2dpOffloadCodecSbc>    },
+  { "AAC",     MakeCodec<A2dpOffloadCodecAac>    },
+  { "LDAC",    MakeCodec<A2dpOffloadCodecLdac>   },
+  { "APTX",    MakeCodec<A2dpOffloadCodecAptx>   },
+  { "APTX_HD", MakeCodec<A2dpOffloadCodecAptxHd> },
+  { "OPUS",    MakeCodec<A2dpOffloadCodecOpus>   },
 };
 
+// clang-format on
+
+static const char* kCodecListPaths[] = {
+    "/vendor/etc/a2dp_offload_codecs.conf",
+    "/system/etc/a2dp_offload_codecs.conf",
+};
+
+// Used when no codec list file can be read
+static const char* kDefaultCodecList[] = {"AAC", "SBC"};
+
+static std::vector<std::string> LoadCodecList() {
+  for (auto path : kCodecListPaths) {
+    std::ifstream file(path);
+    if (!file.is_open()) continue;
+
+    std::vector<std::string> names;
+    for (std::string line; std::getline(file, line);) {
+      line = ::android::base::Trim(line.substr(0, line.find('#')));
+      if (!line.empty()) names.push_back(line);
+    }
+
+    LOG(INFO) << __func__ << ": loaded " << names.size() << " codecs from "
+              << path;
+    return names;
+  }
+
+  LOG(INFO) << __func__ << ": no codec list found, using defaults";
+  return {std::begin(kDefaultCodecList), std::end(kDefaultCodecList)};
+}
+
+/**
+ * Configuration optimizer
+ *
+ * Every codec is asked to build a configuration for each sampling
+ * frequency, channel mode and bitrate ceiling it supports. The distinct
+ * configurations are then scored by the cost function, and the cheapest
+ * one is selected.
+ */
+
+static const int32_t kBitrateCeilings[] = {0, 328000, 256000, 192000, 128000};
+
+static int GetCostProperty(const char* name, int default_value) {
+  return ::android::base::GetIntProperty(
+      std::string("persist.bluetooth.a2dp_offload.cost.") + name,
+      default_value);
+}
+
+static std::vector<CodecParameters> GetCandidateHints(
+    const A2dpOffloadCodec& codec, const std::optional<CodecParameters>& hint) {
+  auto& a2dp_info = codec.info.transport.get<CodecInfo::Transport::Tag::a2dp>();
+  std::vector<CodecParameters> candidates;
+
+  int32_t max_bitrate = hint ? hint->maxBitrate : 0;
+  int32_t min_bitrate = hint ? hint->minBitrate : 0;
+
+  // Capabilities are listed in increasing order, try the best ones first
+  for (auto sf = a2dp_info.samplingFrequencyHz.rbegin();
+       sf != a2dp_info.samplingFrequencyHz.rend(); ++sf)
+    for (auto cm = a2dp_info.channelMode.rbegin();
+         cm != a2dp_info.channelMode.rend(); ++cm)
+      for (auto ceiling : kBitrateCeilings) {
+        if (max_bitrate > 0 && (ceiling == 0 || ceiling > max_bitrate))
+          ceiling = max_bitrate;
+
+        CodecParameters candidate = hint.value_or(CodecParameters());
+        candidate.samplingFrequencyHz = *sf;
+        candidate.channelMode = *cm;
+        candidate.maxBitrate = ceiling;
+        candidate.minBitrate =
+            ceiling > 0 ? std::min(min_bitrate, ceiling) : min_bitrate;
+
+        candidates.push_back(std::move(candidate));
+      }
+
+  return candidates;
+}
+
 /**
  * Class implementation
  */
 
 A2dpOffloadCodecFactory::A2dpOffloadCodecFactory()
     : name("Offload"), codecs(ranked_codecs_) {
-  ranked_codecs_.reserve(kEnableAac + kEnableSbc);
+  cost_.rank = GetCostProperty("rank", cost_.rank);
+  cost_.quality = GetCostProperty("quality", cost_.quality);
+  cost_.channels = GetCostProperty("channels", cost_.channels);
+  cost_.latency = GetCostProperty("latency", cost_.latency);
+  cost_.parameter = GetCostProperty("parameter", cost_.parameter);
+  cost_.bitrate_range = GetCostProperty("bitrate_range", cost_.bitrate_range);
+  cost_.mtu_overflow = GetCostProperty("mtu_overflow", cost_.mtu_overflow);
+  cost_.mtu = GetCostProperty("mtu", cost_.mtu);
+  cost_.packet_rate = GetCostProperty("packet_rate", cost_.packet_rate);
 
-  if (kEnableAac)
-    ranked_codecs_.push_back(std::make_shared<A2dpOffloadCodecAac>());
-  if (kEnableSbc)
-    ranked_codecs_.push_back(std::make_shared<A2dpOffloadCodecSbc>());
+  auto names = LoadCodecList();
+  ranked_codecs_.reserve(names.size());
+
+  for (auto& codec_name : names) {
+    auto entry = std::find_if(
+        std::begin(kCodecRegistry), std::end(kCodecRegistry), [&](auto& e) {
+          return ::android::base::EqualsIgnoreCase(codec_name, e.name);
+        });
+
+    if (entry == std::end(kCodecRegistry)) {
+      LOG(WARNING) << __func__ << ": unknown codec " << codec_name;
+      continue;
+    }
+
+    auto codec = entry->make();
+    if (GetCodec(codec->info.id)) {
+      LOG(WARNING) << __func__ << ": duplicate codec " << codec_name;
+      continue;
+    }
+
+    ranked_codecs_.push_back(std::move(codec));
+  }
 }
 
 std::shared_ptr<const A2dpOffloadCodec> A2dpOffloadCodecFactory::GetCodec(
@@ -55,6 +188,47 @@ std::shared_ptr<const A2dpOffloadCodec> A2dpOffloadCodecFactory::GetCodec(
   return codec != end(ranked_codecs_) ? *codec : nullptr;
 }
 
+int A2dpOffloadCodecFactory::GetCost(
+    const CodecParameters& parameters, size_t rank,
+    const std::optional<CodecParameters>& hint) const {
+  int max_kbps = parameters.maxBitrate / 1000;
+  int min_kbps = parameters.minBitrate / 1000;
+
+  int kbps = max_kbps;
+  if (hint && hint->maxBitrate > 0)
+    kbps = std::min(kbps, hint->maxBitrate / 1000);
+
+  int channels = parameters.channelMode == ChannelMode::MONO ? 1 : 2;
+
+  int cost = cost_.rank * int(rank) - cost_.quality * kbps -
+             cost_.channels * channels;
+
+  if (cost_.mtu > 0 && max_kbps > 0) {
+    int budget_kbps = cost_.mtu * 8 * cost_.packet_rate / 1000;
+    if (max_kbps > budget_kbps)
+      cost += cost_.mtu_overflow * (max_kbps - budget_kbps);
+  }
+
+  if (!hint) return cost;
+
+  if (hint->lowLatency && !parameters.lowLatency) cost += cost_.latency;
+
+  if (hint->samplingFrequencyHz > 0 &&
+      hint->samplingFrequencyHz != parameters.samplingFrequencyHz)
+    cost += cost_.parameter;
+  if (hint->channelMode != ChannelMode::UNKNOWN &&
+      hint->channelMode != parameters.channelMode)
+    cost += cost_.parameter;
+
+  if (hint->maxBitrate > 0 && min_kbps > hint->maxBitrate / 1000)
+    cost += cost_.bitrate_range * (min_kbps - hint->maxBitrate / 1000);
+  if (hint->minBitrate > 0 && max_kbps > 0 &&
+      max_kbps < hint->minBitrate / 1000)
+    cost += cost_.bitrate_range * (hint->minBitrate / 1000 - max_kbps);
+
+  return cost;
+}
+
 bool A2dpOffloadCodecFactory::GetConfiguration(
     const std::vector<A2dpRemoteCapabilities>& remote_capabilities,
     const A2dpConfigurationHint& hint, A2dpConfiguration* configuration) const {
@@ -62,37 +236,78 @@ bool A2dpOffloadCodecFactory::GetConfiguration(
 
   codecs.reserve(ranked_codecs_.size());
 
-  auto hinted_codec =
-      std::find_if(begin(ranked_codecs_), end(ranked_codecs_),
-                   [&](auto c) { return hint.codecId == c->info.id; });
+  auto hinted_codec = hint.codecId ? GetCodec(*hint.codecId) : nullptr;
 
-  if (hinted_codec != end(ranked_codecs_)) codecs.push_back(*hinted_codec);
+  if (hinted_codec) codecs.push_back(hinted_codec);
 
   std::copy_if(begin(ranked_codecs_), end(ranked_codecs_),
                std::back_inserter(codecs),
-               [&](auto c) { return c != *hinted_codec; });
+               [&](auto c) { return c != hinted_codec; });
+
+  std::optional<A2dpConfiguration> best;
+  int best_cost = 0;
 
-  for (auto codec : codecs) {
+  LOG(INFO) << __func__ << ": hint="
+            << (hint.codecParameters ? hint.codecParameters->toString()
+                                     : "none");
+
+  for (size_t rank = 0; rank < codecs.size(); rank++) {
+    auto& codec = codecs[rank];
     auto rc =
         std::find_if(begin(remote_capabilities), end(remote_capabilities),
                      [&](auto& rc__) { return codec->info.id == rc__.id; });
 
-    if ((rc == end(remote_capabilities)) ||
-        !codec->BuildConfiguration(rc->capabilities, hint.codecParameters,
-                                   &configuration->configuration))
-      continue;
+    if (rc == end(remote_capabilities)) continue;
+
+    std::vector<std::vector<uint8_t>> built;
+
+    auto candidate_hints = GetCandidateHints(*codec, hint.codecParameters);
 
-    configuration->id = codec->info.id;
-    A2dpStatus status = codec->ParseConfiguration(configuration->configuration,
-                                                  &configuration->parameters);
-    assert(status == A2dpStatus::OK);
+    for (auto& candidate_hint : candidate_hints) {
+      A2dpConfiguration candidate;
 
-    configuration->remoteSeid = rc->seid;
+      if (!codec->BuildConfiguration(rc->capabilities, candidate_hint,
+                                     &candidate.configuration))
+        continue;
 
-    return true;
+      // Unsupported hints fall back to the same configurations
+      if (std::find(begin(built), end(built), candidate.configuration) !=
+          end(built))
+        continue;
+      built.push_back(candidate.configuration);
+
+      candidate.id = codec->info.id;
+      A2dpStatus status = codec->ParseConfiguration(candidate.configuration,
+                                                    &candidate.parameters);
+      assert(status == A2dpStatus::OK);
+
+      candidate.remoteSeid = rc->seid;
+
+      int cost = GetCost(candidate.parameters, rank, hint.codecParameters);
+
+      LOG(INFO) << __func__ << ":   " << codec->info.name << " "
+                << candidate.parameters.samplingFrequencyHz << "Hz "
+                << toString(candidate.parameters.channelMode) << " "
+                << candidate.parameters.minBitrate / 1000 << "-"
+                << candidate.parameters.maxBitrate / 1000 << "kbps"
+                << (candidate.parameters.lowLatency ? " low-latency" : "")
+                << " cost=" << cost;
+
+      if (!best || cost < best_cost) {
+        best = std::move(candidate);
+        best_cost = cost;
+      }
+    }
   }
 
-  return false;
+  if (!best) return false;
+
+  LOG(INFO) << __func__ << ": selected "
+            << GetCodec(best->id)->info.name << " cost=" << best_cost;
+
+  *configuration = std::move(*best);
+
+  return true;
 }
 
 }  // namespace aidl::android::hardware::bluetooth::audio
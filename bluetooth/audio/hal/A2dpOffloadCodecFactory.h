@@ -26,8 +26,35 @@
 
 namespace aidl::android::hardware::bluetooth::audio {
 
+/* Weights of the cost function used to pick between every configuration
+ * the remote capabilities allow; the lowest cost wins. Each weight can be
+ * overridden with the persist.bluetooth.a2dp_offload.cost.<name> property */
+struct A2dpConfigurationCost {
+  // Per position in the codec ranking, the hinted codec ranking first
+  int rank = 1000;
+  // Credit per kbps of bitrate the configuration can reach
+  int quality = 1;
+  // Credit per audio channel the configuration carries
+  int channels = 100;
+  // When the hint asks for low latency and the configuration is not
+  int latency = 2000;
+  // When the sampling frequency or channel mode differs from the hint
+  int parameter = 50;
+  // Per kbps outside of the bitrate range of the hint
+  int bitrate_range = 10;
+  // Per kbps above what fits in the peer MTU, 0 when the MTU is unknown
+  int mtu_overflow = 10;
+  int mtu = 0;
+  // Media packets per second assumed when budgeting the MTU
+  int packet_rate = 50;
+};
+
 class A2dpOffloadCodecFactory {
   std::vector<std::shared_ptr<const A2dpOffloadCodec>> ranked_codecs_;
+  A2dpConfigurationCost cost_;
+
+  int GetCost(const CodecParameters& parameters, size_t rank,
+              const std::optional<CodecParameters>& hint) const;
 
  public:
   const std::string name;
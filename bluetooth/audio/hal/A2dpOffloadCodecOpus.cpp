@@ -0,0 +1,265 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "A2dpOffloadCodecOpus.h"
+
+#include "A2dpBits.h"
+
+namespace aidl::android::hardware::bluetooth::audio {
+
+/**
+ * Opus Local Capabilities
+ */
+
+enum : bool {
+  kEnableSamplingFrequency48000 = true,
+};
+
+enum : bool {
+  kEnableFrameDuration10ms = true,
+  kEnableFrameDuration20ms = true,
+};
+
+enum : bool {
+  kEnableChannelModeMono = true,
+  kEnableChannelModeDual = false,
+  kEnableChannelModeStereo = true,
+};
+
+enum : int {
+  kBitdepth = 16,
+};
+
+enum : int32_t {
+  kMinimumBitrate = 64000,
+  kMaximumBitrate = 256000,
+};
+
+/**
+ * Opus Signaling format, following the Vendor and Codec ID
+ */
+
+// clang-format off
+
+constexpr A2dpBits::Range kSamplingFrequency (  0     );
+constexpr A2dpBits::Range kFrameDuration     (  3,  4 );
+constexpr A2dpBits::Range kChannelMode       (  5,  7 );
+constexpr size_t kCapabilitiesSize = 8/8;
+
+// clang-format on
+
+enum { kSamplingFrequency48000 = kSamplingFrequency.first };
+
+enum { kFrameDuration20ms = kFrameDuration.first, kFrameDuration10ms };
+
+enum {
+  kChannelModeDual = kChannelMode.first,
+  kChannelModeStereo,
+  kChannelModeMono
+};
+
+/**
+ * Opus Conversion functions
+ */
+
+static int GetChannelModeBit(ChannelMode channel_mode) {
+  switch (channel_mode) {
+    case ChannelMode::MONO:
+      return kChannelModeMono;
+    case ChannelMode::DUALMONO:
+      return kChannelModeDual;
+    case ChannelMode::STEREO:
+      return kChannelModeStereo;
+    default:
+      return -1;
+  }
+}
+
+static ChannelMode GetChannelModeEnum(int channel_mode) {
+  switch (channel_mode) {
+    case kChannelModeMono:
+      return ChannelMode::MONO;
+    case kChannelModeDual:
+      return ChannelMode::DUALMONO;
+    case kChannelModeStereo:
+      return ChannelMode::STEREO;
+    default:
+      return ChannelMode::UNKNOWN;
+  }
+}
+
+static int GetFrameDurationValue(int frame_duration) {
+  switch (frame_duration) {
+    case kFrameDuration10ms:
+      return 10000;
+    case kFrameDuration20ms:
+      return 20000;
+    default:
+      return 0;
+  }
+}
+
+/**
+ * Opus Class implementation
+ */
+
+A2dpOffloadCodecOpus::A2dpOffloadCodecOpus()
+    : A2dpOffloadCodec(info_),
+      info_({.id = CodecId(CodecId::Vendor{.id = 0x00E0, .codecId = 0x0001}),
+             .name = "OPUS"}) {
+  info_.transport.set<CodecInfo::Transport::Tag::a2dp>();
+  auto& a2dp_info = info_.transport.get<CodecInfo::Transport::Tag::a2dp>();
+
+  /* --- Setup Capabilities --- */
+
+  a2dp_info.capabilities.resize(kCapabilitiesSize);
+  std::fill(begin(a2dp_info.capabilities), end(a2dp_info.capabilities), 0);
+
+  auto capabilities = A2dpBits(a2dp_info.capabilities);
+
+  capabilities.set(kSamplingFrequency48000, kEnableSamplingFrequency48000);
+
+  capabilities.set(kFrameDuration10ms, kEnableFrameDuration10ms);
+  capabilities.set(kFrameDuration20ms, kEnableFrameDuration20ms);
+
+  capabilities.set(kChannelModeMono, kEnableChannelModeMono);
+  capabilities.set(kChannelModeDual, kEnableChannelModeDual);
+  capabilities.set(kChannelModeStereo, kEnableChannelModeStereo);
+
+  /* --- Setup Sampling Frequencies --- */
+
+  if (capabilities.get(kSamplingFrequency48000))
+    a2dp_info.samplingFrequencyHz.push_back(48000);
+
+  /* --- Setup Channel Modes --- */
+
+  auto& channel_modes = a2dp_info.channelMode;
+
+  for (auto v : {ChannelMode::MONO, ChannelMode::DUALMONO, ChannelMode::STEREO})
+    if (capabilities.get(GetChannelModeBit(v))) channel_modes.push_back(v);
+
+  /* --- Setup Bitdepth --- */
+
+  a2dp_info.bitdepth.push_back(kBitdepth);
+
+  /* --- Setup Latency --- */
+
+  a2dp_info.lowLatency = capabilities.get(kFrameDuration10ms);
+}
+
+A2dpStatus A2dpOffloadCodecOpus::ParseConfiguration(
+    const std::vector<uint8_t>& configuration,
+    CodecParameters* codec_parameters, OpusParameters* opus_parameters) const {
+  auto& a2dp_info = info.transport.get<CodecInfo::Transport::Tag::a2dp>();
+
+  if (configuration.size() != a2dp_info.capabilities.size())
+    return A2dpStatus::BAD_LENGTH;
+
+  auto config = A2dpBits(configuration);
+  auto lcaps = A2dpBits(a2dp_info.capabilities);
+
+  /* --- Check Sampling Frequency --- */
+
+  int sampling_frequency = config.find_active_bit(kSamplingFrequency);
+  if (sampling_frequency < 0) return A2dpStatus::INVALID_SAMPLING_FREQUENCY;
+  if (!lcaps.get(sampling_frequency))
+    return A2dpStatus::NOT_SUPPORTED_SAMPLING_FREQUENCY;
+
+  /* --- Check Frame Duration --- */
+
+  int frame_duration = config.find_active_bit(kFrameDuration);
+  if (frame_duration < 0) return A2dpStatus::INVALID_CODEC_PARAMETER;
+  if (!lcaps.get(frame_duration))
+    return A2dpStatus::NOT_SUPPORTED_CODEC_PARAMETER;
+
+  /* --- Check Channel Mode --- */
+
+  int channel_mode = config.find_active_bit(kChannelMode);
+  if (channel_mode < 0) return A2dpStatus::INVALID_CHANNEL_MODE;
+  if (!lcaps.get(channel_mode)) return A2dpStatus::NOT_SUPPORTED_CHANNEL_MODE;
+
+  /* --- Return --- */
+
+  codec_parameters->channelMode = GetChannelModeEnum(channel_mode);
+  codec_parameters->samplingFrequencyHz = 48000;
+  codec_parameters->bitdepth = kBitdepth;
+
+  codec_parameters->minBitrate = kMinimumBitrate;
+  codec_parameters->maxBitrate = kMaximumBitrate;
+
+  codec_parameters->lowLatency = (frame_duration == kFrameDuration10ms);
+
+  if (opus_parameters)
+    opus_parameters->frame_duration_us = GetFrameDurationValue(frame_duration);
+
+  return A2dpStatus::OK;
+}
+
+bool A2dpOffloadCodecOpus::BuildConfiguration(
+    const std::vector<uint8_t>& remote_capabilities,
+    const std::optional<CodecParameters>& hint,
+    std::vector<uint8_t>* configuration) const {
+  auto& a2dp_info = info.transport.get<CodecInfo::Transport::Tag::a2dp>();
+
+  if (remote_capabilities.size() != a2dp_info.capabilities.size()) return false;
+
+  auto lcaps = A2dpBits(a2dp_info.capabilities);
+  auto rcaps = A2dpBits(remote_capabilities);
+
+  configuration->resize(a2dp_info.capabilities.size());
+  std::fill(begin(*configuration), end(*configuration), 0);
+  auto config = A2dpBits(*configuration);
+
+  /* --- Select Sampling Frequency --- */
+
+  if (lcaps.get(kSamplingFrequency48000) && rcaps.get(kSamplingFrequency48000))
+    config.set(kSamplingFrequency48000);
+  else
+    return false;
+
+  /* --- Select Frame Duration --- */
+
+  bool low_latency = hint && hint->lowLatency;
+
+  if (low_latency && lcaps.get(kFrameDuration10ms) &&
+      rcaps.get(kFrameDuration10ms))
+    config.set(kFrameDuration10ms);
+  else if (lcaps.get(kFrameDuration20ms) && rcaps.get(kFrameDuration20ms))
+    config.set(kFrameDuration20ms);
+  else if (lcaps.get(kFrameDuration10ms) && rcaps.get(kFrameDuration10ms))
+    config.set(kFrameDuration10ms);
+  else
+    return false;
+
+  /* --- Select Channel Mode --- */
+
+  auto cm_hint = hint ? GetChannelModeBit(hint->channelMode) : -1;
+
+  if (cm_hint >= 0 && lcaps.get(cm_hint) && rcaps.get(cm_hint))
+    config.set(cm_hint);
+  else if (lcaps.get(kChannelModeStereo) && rcaps.get(kChannelModeStereo))
+    config.set(kChannelModeStereo);
+  else if (lcaps.get(kChannelModeDual) && rcaps.get(kChannelModeDual))
+    config.set(kChannelModeDual);
+  else if (lcaps.get(kChannelModeMono) && rcaps.get(kChannelModeMono))
+    config.set(kChannelModeMono);
+  else
+    return false;
+
+  return true;
+}
+
+}  // namespace aidl::android::hardware::bluetooth::audio
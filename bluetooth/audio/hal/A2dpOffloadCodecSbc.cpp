@@ -486,7 +486,7 @@ bool A2dpOffloadCodecSbc::BuildConfiguration(
   }
 
   min_bitpool = std::max(min_bitpool, uint8_t(lcaps.get(kMinimumBitpool)));
-  max_bitpool = std::max(max_bitpool, uint8_t(lcaps.get(kMaximumBitpool)));
+  max_bitpool = std::min(max_bitpool, uint8_t(lcaps.get(kMaximumBitpool)));
 
   if (hint) {
     min_bitpool =
@@ -494,6 +494,7 @@ bool A2dpOffloadCodecSbc::BuildConfiguration(
     if (hint->maxBitrate && hint->maxBitrate >= hint->minBitrate)
       max_bitpool =
           std::min(max_bitpool, GetBitpool(*configuration, hint->maxBitrate));
+    min_bitpool = std::min(min_bitpool, max_bitpool);
   }
 
   config.set(kMinimumBitpool, min_bitpool);
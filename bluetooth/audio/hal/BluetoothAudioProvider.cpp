@@ -22,6 +22,7 @@
 #include <android-base/logging.h>
 
 #include "A2dpOffloadCodecFactory.h"
+#include "DataMQPool.h"
 
 namespace aidl {
 namespace android {
@@ -33,6 +34,25 @@ struct BluetoothAudioProviderContext {
   SessionType session_type;
 };
 
+// Bytes per frame in a software data path, 24 bit samples go unpacked
+static size_t PcmFrameSize(const PcmConfiguration& pcm_config) {
+  size_t channels = 0;
+  switch (pcm_config.channelMode) {
+    case ChannelMode::MONO:
+      channels = 1;
+      break;
+    case ChannelMode::STEREO:
+    case ChannelMode::DUALMONO:
+      channels = 2;
+      break;
+    default:
+      break;
+  }
+  size_t bytes_per_sample =
+      (pcm_config.bitsPerSample == 24) ? 4 : (pcm_config.bitsPerSample / 8);
+  return channels * bytes_per_sample;
+}
+
 static void binderUnlinkedCallbackAidl(void* cookie) {
   LOG(INFO) << __func__;
   BluetoothAudioProviderContext* ctx =
@@ -97,6 +117,8 @@ ndk::ScopedAStatus BluetoothAudioProvider::endSession() {
 
   stack_iface_ = nullptr;
   audio_config_ = nullptr;
+  // The stack is done with the ring, the next session may reuse it
+  DataMQPool::Release(session_type_, std::move(data_mq_));
 
   return ndk::ScopedAStatus::ok();
 }
@@ -145,6 +167,18 @@ ndk::ScopedAStatus BluetoothAudioProvider::updateAudioConfiguration(
     return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
   }
 
+  // The FMQ was sized for the old frames and the stack only gets a new one
+  // from startSession, so other frames need a new session
+  if (data_mq_ != nullptr &&
+      audio_config.getTag() == AudioConfiguration::pcmConfig &&
+      PcmFrameSize(audio_config.get<AudioConfiguration::pcmConfig>()) !=
+          PcmFrameSize(audio_config_->get<AudioConfiguration::pcmConfig>())) {
+    LOG(WARNING) << __func__ << " - SessionType=" << toString(session_type_)
+                 << " cannot change the frame size of its FMQ, "
+                 << audio_config.toString() << " needs a new session";
+    return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
+  }
+
   audio_config_ = std::make_unique<AudioConfiguration>(audio_config);
   BluetoothAudioSessionReport::ReportAudioConfigChanged(session_type_,
                                                         *audio_config_);
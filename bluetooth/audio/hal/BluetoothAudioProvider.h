@@ -147,6 +147,9 @@ class BluetoothAudioProvider : public BnBluetoothAudioProvider {
   std::unique_ptr<AudioConfiguration> audio_config_ = nullptr;
   SessionType session_type_;
   std::vector<LatencyMode> latency_modes_;
+  // audio data queue of software datapaths, from DataMQPool and released
+  // when the session ends so the next session can reuse it
+  std::shared_ptr<DataMQ> data_mq_;
 };
 }  // namespace audio
 }  // namespace bluetooth
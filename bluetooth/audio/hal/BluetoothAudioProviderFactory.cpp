@@ -19,6 +19,7 @@
 #include "BluetoothAudioProviderFactory.h"
 
 #include <BluetoothAudioCodecs.h>
+#include <BluetoothAudioSession.h>
 #include <android-base/logging.h>
 
 #include "A2dpOffloadAudioProvider.h"
@@ -58,9 +59,17 @@ ndk::ScopedAStatus BluetoothAudioProviderFactory::openProvider(
     case SessionType::HEARING_AID_SOFTWARE_ENCODING_DATAPATH:
       provider = ndk::SharedRefBase::make<HearingAidAudioProvider>();
       break;
-    case SessionType::LE_AUDIO_SOFTWARE_ENCODING_DATAPATH:
-      provider = ndk::SharedRefBase::make<LeAudioSoftwareOutputAudioProvider>();
+    case SessionType::LE_AUDIO_SOFTWARE_ENCODING_DATAPATH: {
+      auto le_audio_provider =
+          ndk::SharedRefBase::make<LeAudioSoftwareOutputAudioProvider>();
+      // Stacks that know about it can ask for a ring per audio location
+      auto location_queues =
+          ndk::SharedRefBase::make<LeAudioLocationQueues>(le_audio_provider);
+      AIBinder_setExtension(le_audio_provider->asBinder().get(),
+                            location_queues->asBinder().get());
+      provider = le_audio_provider;
       break;
+    }
     case SessionType::LE_AUDIO_HARDWARE_OFFLOAD_ENCODING_DATAPATH:
       provider = ndk::SharedRefBase::make<LeAudioOffloadOutputAudioProvider>();
       break;
@@ -192,6 +201,14 @@ ndk::ScopedAStatus BluetoothAudioProviderFactory::getProviderInfo(
   return ndk::ScopedAStatus::ok();
 }
 
+binder_status_t BluetoothAudioProviderFactory::dump(int fd, const char** args,
+                                                    uint32_t num_args) {
+  (void)args;
+  (void)num_args;
+  BluetoothAudioSessionInstance::DumpAll(fd);
+  return STATUS_OK;
+}
+
 }  // namespace audio
 }  // namespace bluetooth
 }  // namespace hardware
@@ -43,6 +43,9 @@ class BluetoothAudioProviderFactory : public BnBluetoothAudioProviderFactory {
   ndk::ScopedAStatus getProviderInfo(
       SessionType in_sessionType,
       std::optional<ProviderInfo>* _aidl_return) override;
+
+  // Statistics of every Bluetooth audio session, for dumpsys
+  binder_status_t dump(int fd, const char** args, uint32_t num_args) override;
 };
 
 }  // namespace audio
@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "BTAudioDataMQPool"
+
+#include "DataMQPool.h"
+
+#include <android-base/logging.h>
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace bluetooth {
+namespace audio {
+
+// The interleaved ring and one per location of a stereo LE Audio session
+static constexpr size_t kMaxRingsPerSessionType = 3;
+
+struct PooledRing {
+  std::shared_ptr<DataMQ> data_mq;
+  // Set by endSession(), no reader of the stack is left on it
+  bool released;
+};
+
+static std::mutex pool_mutex;
+static std::map<SessionType, std::vector<PooledRing>> pool_rings;
+
+static void ResetDataMQ(DataMQ& data_mq) {
+  // Drop what the previous session left behind, without copying it out
+  size_t available = data_mq.availableToRead();
+  DataMQ::MemTransaction tx;
+  if (available > 0 && data_mq.beginRead(available, &tx))
+    data_mq.commitRead(available);
+
+  auto event_flag_word = data_mq.getEventFlagWord();
+  if (event_flag_word) event_flag_word->store(0);
+}
+
+std::shared_ptr<DataMQ> DataMQPool::Acquire(const SessionType& session_type,
+                                            size_t size) {
+  std::lock_guard<std::mutex> guard(pool_mutex);
+  auto& rings = pool_rings[session_type];
+
+  // Rings whose provider went away without ending its session can't be
+  // told apart from ones the stack still reads, let them go
+  rings.erase(std::remove_if(rings.begin(), rings.end(),
+                             [](const PooledRing& ring) {
+                               return !ring.released &&
+                                      ring.data_mq.use_count() == 1;
+                             }),
+              rings.end());
+
+  // The last used is at the back
+  for (auto it = rings.rbegin(); it != rings.rend(); ++it) {
+    if (!it->released || it->data_mq.use_count() != 1 ||
+        it->data_mq->getQuantumCount() != size)
+      continue;
+
+    LOG(INFO) << __func__ << " - SessionType=" << toString(session_type)
+              << " reusing " << size << " byte(s)";
+    ResetDataMQ(*it->data_mq);
+
+    auto data_mq = it->data_mq;
+    rings.erase(std::next(it).base());
+    rings.push_back({data_mq, false});
+    return data_mq;
+  }
+
+  LOG(INFO) << __func__ << " - SessionType=" << toString(session_type)
+            << " allocating " << size << " byte(s)";
+
+  auto data_mq = std::make_shared<DataMQ>(size, /* EventFlag */ true);
+  if (!data_mq->isValid()) {
+    LOG(ERROR) << __func__ << " - data MQ is invalid";
+    return nullptr;
+  }
+
+  rings.push_back({data_mq, false});
+
+  // Evict the least recently used released ring past the bound
+  if (rings.size() > kMaxRingsPerSessionType) {
+    auto lru = std::find_if(rings.begin(), rings.end(),
+                            [](const PooledRing& ring) {
+                              return ring.released;
+                            });
+    if (lru != rings.end()) rings.erase(lru);
+  }
+
+  return data_mq;
+}
+
+void DataMQPool::Release(const SessionType& session_type,
+                         std::shared_ptr<DataMQ> data_mq) {
+  if (data_mq == nullptr) return;
+  std::lock_guard<std::mutex> guard(pool_mutex);
+  for (auto& ring : pool_rings[session_type]) {
+    if (ring.data_mq == data_mq) ring.released = true;
+  }
+}
+
+}  // namespace audio
+}  // namespace bluetooth
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "BluetoothAudioProvider.h"
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace bluetooth {
+namespace audio {
+
+/* Shared memory rings kept across provider sessions. A ring is handed out
+ * again to the next session of the same type that asks for the same size,
+ * but only once the stack ended the session that owned it: until then it
+ * may still have the ring mapped and be reading from it. A ring dropped
+ * without endSession() is let go instead */
+class DataMQPool {
+ public:
+  static std::shared_ptr<DataMQ> Acquire(const SessionType& session_type,
+                                         size_t size);
+  // The stack ended the session that got |data_mq|
+  static void Release(const SessionType& session_type,
+                      std::shared_ptr<DataMQ> data_mq);
+};
+
+}  // namespace audio
+}  // namespace bluetooth
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
@@ -22,6 +22,8 @@
 #include <BluetoothAudioSessionReport.h>
 #include <android-base/logging.h>
 
+#include "DataMQPool.h"
+
 namespace aidl {
 namespace android {
 namespace hardware {
@@ -37,21 +39,12 @@ static constexpr uint32_t kBufferCount = 1;  // single buffer
 static constexpr uint32_t kDataMqSize = kBufferSize * kBufferCount;
 
 HearingAidAudioProvider::HearingAidAudioProvider()
-    : BluetoothAudioProvider(), data_mq_(nullptr) {
-  LOG(INFO) << __func__ << " - size of audio buffer " << kDataMqSize
-            << " byte(s)";
-  std::unique_ptr<DataMQ> data_mq(
-      new DataMQ(kDataMqSize, /* EventFlag */ true));
-  if (data_mq && data_mq->isValid()) {
-    data_mq_ = std::move(data_mq);
-    session_type_ = SessionType::HEARING_AID_SOFTWARE_ENCODING_DATAPATH;
-  } else {
-    ALOGE_IF(!data_mq, "failed to allocate data MQ");
-    ALOGE_IF(data_mq && !data_mq->isValid(), "data MQ is invalid");
-  }
+    : BluetoothAudioProvider() {
+  session_type_ = SessionType::HEARING_AID_SOFTWARE_ENCODING_DATAPATH;
 }
+
 bool HearingAidAudioProvider::isValid(const SessionType& sessionType) {
-  return (sessionType == session_type_ && data_mq_ && data_mq_->isValid());
+  return (sessionType == session_type_);
 }
 
 ndk::ScopedAStatus HearingAidAudioProvider::startSession(
@@ -72,6 +65,16 @@ ndk::ScopedAStatus HearingAidAudioProvider::startSession(
     return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
   }
 
+  LOG(INFO) << __func__ << " - size of audio buffer " << kDataMqSize
+            << " byte(s)";
+
+  data_mq_ = nullptr;
+  data_mq_ = DataMQPool::Acquire(session_type_, kDataMqSize);
+  if (data_mq_ == nullptr) {
+    *_aidl_return = DataMQDesc();
+    return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
+  }
+
   return BluetoothAudioProvider::startSession(
       host_if, audio_config, latency_modes, _aidl_return);
 }
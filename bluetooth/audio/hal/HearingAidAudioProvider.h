@@ -37,9 +37,6 @@ class HearingAidAudioProvider : public BluetoothAudioProvider {
       DataMQDesc* _aidl_return);
 
  private:
-  // audio data queue for software encoding
-  std::unique_ptr<DataMQ> data_mq_;
-
   ndk::ScopedAStatus onSessionReady(DataMQDesc* _aidl_return) override;
 };
 
@@ -22,6 +22,8 @@
 #include <BluetoothAudioSessionReport.h>
 #include <android-base/logging.h>
 
+#include "DataMQPool.h"
+
 namespace aidl {
 namespace android {
 namespace hardware {
@@ -41,8 +43,7 @@ HfpSoftwareInputAudioProvider::HfpSoftwareInputAudioProvider()
 }
 
 HfpSoftwareAudioProvider::HfpSoftwareAudioProvider()
-    : BluetoothAudioProvider(), data_mq_(nullptr) {
-}
+    : BluetoothAudioProvider() {}
 
 bool HfpSoftwareAudioProvider::isValid(const SessionType& sessionType) {
   return (sessionType == session_type_);
@@ -73,8 +74,11 @@ ndk::ScopedAStatus HfpSoftwareAudioProvider::startSession(
     isValidConfig = false;
   }
 
+  // CVSD (8 kHz), mSBC (16 kHz), LC3-SWB (32 kHz) and the rates the stack
+  // may run its own codec at, 24 and 48 kHz
   if (pcm_config.sampleRateHz != 8000 && pcm_config.sampleRateHz != 16000 &&
-      pcm_config.sampleRateHz != 32000) {
+      pcm_config.sampleRateHz != 24000 && pcm_config.sampleRateHz != 32000 &&
+      pcm_config.sampleRateHz != 48000) {
     isValidConfig = false;
   }
 
@@ -82,12 +86,14 @@ ndk::ScopedAStatus HfpSoftwareAudioProvider::startSession(
     isValidConfig = false;
   }
 
-  if (pcm_config.dataIntervalUs != 7500) {
+  // The eSCO interval (7.5 ms) or the LC3 frame duration (10 ms)
+  if (pcm_config.dataIntervalUs != 7500 && pcm_config.dataIntervalUs != 10000) {
     isValidConfig = false;
   }
 
   int bytes_per_sample = pcm_config.bitsPerSample / 8;
 
+  // Follows the interval, so that the audio side paces to it
   uint32_t data_mq_size = kBufferCount * bytes_per_sample *
                           (pcm_config.sampleRateHz / 1000) *
                           pcm_config.dataIntervalUs / 1000;
@@ -106,15 +112,12 @@ ndk::ScopedAStatus HfpSoftwareAudioProvider::startSession(
   LOG(INFO) << __func__ << " - size of audio buffer " << data_mq_size
             << " byte(s)";
 
-  std::unique_ptr<DataMQ> temp_data_mq(
-      new DataMQ(data_mq_size, /* EventFlag */ true));
-  if (temp_data_mq == nullptr || !temp_data_mq->isValid()) {
-    ALOGE_IF(!temp_data_mq, "failed to allocate data MQ");
-    ALOGE_IF(temp_data_mq && !temp_data_mq->isValid(), "data MQ is invalid");
+  data_mq_ = nullptr;
+  data_mq_ = DataMQPool::Acquire(session_type_, data_mq_size);
+  if (data_mq_ == nullptr) {
     *_aidl_return = DataMQDesc();
     return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
   }
-  data_mq_ = std::move(temp_data_mq);
 
   return BluetoothAudioProvider::startSession(host_if, audio_config,
                                               latency_modes, _aidl_return);
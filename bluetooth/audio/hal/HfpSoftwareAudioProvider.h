@@ -36,9 +36,6 @@ class HfpSoftwareAudioProvider : public BluetoothAudioProvider {
       const std::vector<LatencyMode>& latency_modes, DataMQDesc* _aidl_return);
 
  private:
-  // audio data queue for software encoding
-  std::unique_ptr<DataMQ> data_mq_;
-
   ndk::ScopedAStatus onSessionReady(DataMQDesc* _aidl_return) override;
 };
 
@@ -0,0 +1,456 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <android-base/file.h>
+#include <benchmark/benchmark.h>
+#include <malloc.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "BluetoothAudioCodecs.h"
+#include "BluetoothLeAudioAseConfigurationSettingProvider.h"
+#include "BluetoothLeAudioCodecsProvider.h"
+#include "LeAudioOffloadAudioProvider.h"
+
+using aidl::android::hardware::bluetooth::audio::AseDirectionRequirement;
+using aidl::android::hardware::bluetooth::audio::AseQosDirectionRequirement;
+using aidl::android::hardware::bluetooth::audio::AudioContext;
+using aidl::android::hardware::bluetooth::audio::
+    AudioSetConfigurationProviderJson;
+using aidl::android::hardware::bluetooth::audio::BluetoothAudioCodecs;
+using aidl::android::hardware::bluetooth::audio::
+    BluetoothLeAudioCodecsProvider;
+using aidl::android::hardware::bluetooth::audio::BroadcastQuality;
+using aidl::android::hardware::bluetooth::audio::CodecId;
+using aidl::android::hardware::bluetooth::audio::CodecSpecificCapabilitiesLtv;
+using aidl::android::hardware::bluetooth::audio::
+    CodecSpecificConfigurationLtv;
+using aidl::android::hardware::bluetooth::audio::IBluetoothAudioProvider;
+using aidl::android::hardware::bluetooth::audio::LeAudioAseConfiguration;
+using aidl::android::hardware::bluetooth::audio::
+    LeAudioBroadcastConfigurationSetting;
+using aidl::android::hardware::bluetooth::audio::LeAudioOffloadAudioProvider;
+using aidl::android::hardware::bluetooth::audio::
+    LeAudioOffloadBroadcastAudioProvider;
+using aidl::android::hardware::bluetooth::audio::
+    LeAudioOffloadOutputAudioProvider;
+using aidl::android::hardware::bluetooth::audio::MetadataLtv;
+
+using LeAudioDeviceCapabilities =
+    IBluetoothAudioProvider::LeAudioDeviceCapabilities;
+using LeAudioConfigurationRequirement =
+    IBluetoothAudioProvider::LeAudioConfigurationRequirement;
+using LeAudioAseQosConfigurationRequirement =
+    IBluetoothAudioProvider::LeAudioAseQosConfigurationRequirement;
+using LeAudioBroadcastConfigurationRequirement =
+    IBluetoothAudioProvider::LeAudioBroadcastConfigurationRequirement;
+using CapabilityList = std::vector<std::optional<LeAudioDeviceCapabilities>>;
+
+/* Allocation accounting, so every query can report how much it allocates
+ * and how far it pushes the heap above where it started */
+namespace {
+
+std::atomic<uint64_t> allocations;
+std::atomic<uint64_t> allocated_bytes;
+std::atomic<int64_t> live_bytes;
+std::atomic<int64_t> peak_live_bytes;
+
+void* CountedAlloc(size_t size) {
+  void* ptr = malloc(size ? size : 1);
+  if (ptr == nullptr) throw std::bad_alloc();
+  size_t usable = malloc_usable_size(ptr);
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  allocated_bytes.fetch_add(usable, std::memory_order_relaxed);
+  int64_t live =
+      live_bytes.fetch_add(usable, std::memory_order_relaxed) + usable;
+  int64_t peak = peak_live_bytes.load(std::memory_order_relaxed);
+  while (live > peak && !peak_live_bytes.compare_exchange_weak(
+                            peak, live, std::memory_order_relaxed)) {
+  }
+  return ptr;
+}
+
+void CountedFree(void* ptr) {
+  if (ptr == nullptr) return;
+  live_bytes.fetch_sub(malloc_usable_size(ptr), std::memory_order_relaxed);
+  free(ptr);
+}
+
+}  // namespace
+
+void* operator new(size_t size) { return CountedAlloc(size); }
+void* operator new[](size_t size) { return CountedAlloc(size); }
+void operator delete(void* ptr) noexcept { CountedFree(ptr); }
+void operator delete[](void* ptr) noexcept { CountedFree(ptr); }
+void operator delete(void* ptr, size_t) noexcept { CountedFree(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { CountedFree(ptr); }
+
+namespace {
+
+/* Measures the allocations of the queries run between Begin() and End() */
+class AllocationMeter {
+ public:
+  void Begin() {
+    start_allocations_ = allocations.load(std::memory_order_relaxed);
+    start_bytes_ = allocated_bytes.load(std::memory_order_relaxed);
+  }
+
+  // Peak tracking restarts from the current heap before each query
+  void BeginQuery() {
+    query_base_ = live_bytes.load(std::memory_order_relaxed);
+    peak_live_bytes.store(query_base_, std::memory_order_relaxed);
+  }
+  void EndQuery() {
+    peak_bytes_ = std::max(
+        peak_bytes_, peak_live_bytes.load(std::memory_order_relaxed) -
+                         query_base_);
+  }
+
+  void End(benchmark::State& state) {
+    auto per_query = benchmark::Counter::kAvgIterations;
+    state.counters["allocs"] = {
+        double(allocations.load(std::memory_order_relaxed) -
+               start_allocations_),
+        per_query};
+    state.counters["alloc_bytes"] = {
+        double(allocated_bytes.load(std::memory_order_relaxed) -
+               start_bytes_),
+        per_query};
+    state.counters["peak_bytes"] = double(peak_bytes_);
+  }
+
+ private:
+  uint64_t start_allocations_ = 0;
+  uint64_t start_bytes_ = 0;
+  int64_t query_base_ = 0;
+  int64_t peak_bytes_ = 0;
+};
+
+// Contexts of the Media and Conversational scenarios, as loaded from
+// audio_set_scenarios.json
+constexpr int32_t kMediaContext =
+    AudioContext::ALERTS | AudioContext::INSTRUCTIONAL |
+    AudioContext::NOTIFICATIONS | AudioContext::EMERGENCY_ALARM |
+    AudioContext::UNSPECIFIED | AudioContext::MEDIA;
+constexpr int32_t kConversationalContext =
+    AudioContext::RINGTONE_ALERTS | AudioContext::CONVERSATIONAL;
+
+struct Lc3Capabilities {
+  int32_t sampling_frequencies;
+  int32_t frame_durations;
+  int32_t channel_counts;
+  int32_t min_octets;
+  int32_t max_octets;
+  int32_t max_frames_per_sdu;
+  int32_t preferred_contexts;
+};
+
+LeAudioDeviceCapabilities MakeDeviceCapabilities(const Lc3Capabilities& lc3) {
+  LeAudioDeviceCapabilities capabilities;
+  capabilities.codecId = CodecId::Core::LC3;
+
+  CodecSpecificCapabilitiesLtv::SupportedSamplingFrequencies frequencies;
+  frequencies.bitmask = lc3.sampling_frequencies;
+  CodecSpecificCapabilitiesLtv::SupportedFrameDurations durations;
+  durations.bitmask = lc3.frame_durations;
+  CodecSpecificCapabilitiesLtv::SupportedAudioChannelCounts channel_counts;
+  channel_counts.bitmask = lc3.channel_counts;
+  CodecSpecificCapabilitiesLtv::SupportedOctetsPerCodecFrame octets;
+  octets.min = lc3.min_octets;
+  octets.max = lc3.max_octets;
+  CodecSpecificCapabilitiesLtv::SupportedMaxCodecFramesPerSDU frames;
+  frames.value = lc3.max_frames_per_sdu;
+  capabilities.codecSpecificCapabilities = {frequencies, durations,
+                                            channel_counts, octets, frames};
+
+  MetadataLtv::PreferredAudioContexts contexts;
+  contexts.values.bitmask = lc3.preferred_contexts;
+  capabilities.metadata =
+      std::vector<std::optional<MetadataLtv>>{MetadataLtv(contexts)};
+  return capabilities;
+}
+
+LeAudioAseConfiguration MakeAseConfiguration(
+    LeAudioAseConfiguration::TargetLatency target_latency,
+    CodecSpecificConfigurationLtv::SamplingFrequency frequency) {
+  LeAudioAseConfiguration configuration;
+  configuration.targetLatency = target_latency;
+  configuration.codecId = CodecId::Core::LC3;
+  configuration.codecConfiguration = {
+      frequency, CodecSpecificConfigurationLtv::FrameDuration::US10000};
+  return configuration;
+}
+
+/* A remote device set and what the stack asks for it */
+struct Profile {
+  std::string name;
+  CapabilityList sink_capabilities;
+  LeAudioConfigurationRequirement requirement;
+  LeAudioAseQosConfigurationRequirement qos_requirement;
+  LeAudioBroadcastConfigurationRequirement broadcast_requirement;
+  bool unicast = true;
+};
+
+Profile MakeUnicastProfile(
+    std::string name, const Lc3Capabilities& lc3, size_t devices,
+    int32_t context, LeAudioAseConfiguration::TargetLatency target_latency,
+    CodecSpecificConfigurationLtv::SamplingFrequency frequency) {
+  Profile profile;
+  profile.name = std::move(name);
+  for (size_t i = 0; i < devices; ++i)
+    profile.sink_capabilities.push_back(MakeDeviceCapabilities(lc3));
+
+  auto ase_configuration = MakeAseConfiguration(target_latency, frequency);
+  profile.requirement.audioContext.bitmask = context;
+  AseDirectionRequirement direction_requirement;
+  direction_requirement.aseConfiguration = ase_configuration;
+  profile.requirement.sinkAseRequirement =
+      std::vector<std::optional<AseDirectionRequirement>>(
+          devices, direction_requirement);
+
+  profile.qos_requirement.audioContext.bitmask = context;
+  AseQosDirectionRequirement qos_requirement;
+  qos_requirement.preferredRetransmissionNum = 0;
+  qos_requirement.maxTransportLatencyMs = 100;
+  qos_requirement.presentationDelayMinMicros = 10000;
+  qos_requirement.presentationDelayMaxMicros = 40000;
+  qos_requirement.aseConfiguration = ase_configuration;
+  profile.qos_requirement.sinkAseQosRequirement = qos_requirement;
+
+  IBluetoothAudioProvider::LeAudioBroadcastSubgroupConfigurationRequirement
+      subgroup;
+  subgroup.audioContext.bitmask = context;
+  subgroup.quality = BroadcastQuality::STANDARD;
+  subgroup.bisNumPerSubgroup = 1;
+  profile.broadcast_requirement.subgroupConfigurationRequirements = {subgroup};
+  return profile;
+}
+
+const std::vector<Profile>& GetProfiles() {
+  using Frequencies =
+      CodecSpecificCapabilitiesLtv::SupportedSamplingFrequencies;
+  using Durations = CodecSpecificCapabilitiesLtv::SupportedFrameDurations;
+  using ChannelCounts =
+      CodecSpecificCapabilitiesLtv::SupportedAudioChannelCounts;
+  using TargetLatency = LeAudioAseConfiguration::TargetLatency;
+  using SamplingFrequency = CodecSpecificConfigurationLtv::SamplingFrequency;
+
+  // Typical TWS earbud: LC3 up to 48 kHz, one channel per device
+  const Lc3Capabilities kEarbud = {
+      Frequencies::HZ16000 | Frequencies::HZ24000 | Frequencies::HZ32000 |
+          Frequencies::HZ48000,
+      Durations::US7500 | Durations::US10000,
+      ChannelCounts::ONE,
+      26,
+      120,
+      1,
+      kMediaContext | kConversationalContext};
+  // Hearing aids stay at 16 / 24 kHz with small frames
+  const Lc3Capabilities kHearingAid = {
+      Frequencies::HZ16000 | Frequencies::HZ24000,
+      Durations::US10000,
+      ChannelCounts::ONE,
+      40,
+      60,
+      1,
+      kMediaContext | kConversationalContext};
+  // Broadcast sinks accept stereo BIS up to the high quality 48 kHz ones
+  const Lc3Capabilities kBroadcastSink = {
+      Frequencies::HZ16000 | Frequencies::HZ24000 | Frequencies::HZ48000,
+      Durations::US7500 | Durations::US10000,
+      ChannelCounts::ONE | ChannelCounts::TWO,
+      30,
+      155,
+      2,
+      kMediaContext};
+
+  static const std::vector<Profile> profiles = [&] {
+    std::vector<Profile> list;
+    list.push_back(MakeUnicastProfile(
+        "SingleEarbud", kEarbud, 1, kMediaContext,
+        TargetLatency::HIGHER_RELIABILITY, SamplingFrequency::HZ48000));
+    list.push_back(MakeUnicastProfile(
+        "StereoPair", kEarbud, 2, kMediaContext,
+        TargetLatency::HIGHER_RELIABILITY, SamplingFrequency::HZ48000));
+    list.push_back(MakeUnicastProfile(
+        "HearingAid", kHearingAid, 2, kConversationalContext,
+        TargetLatency::BALANCED_LATENCY_RELIABILITY,
+        SamplingFrequency::HZ16000));
+    Profile broadcast_sink = MakeUnicastProfile(
+        "BroadcastSink", kBroadcastSink, 1, kMediaContext,
+        TargetLatency::HIGHER_RELIABILITY, SamplingFrequency::HZ48000);
+    broadcast_sink.unicast = false;
+    broadcast_sink.broadcast_requirement.subgroupConfigurationRequirements[0]
+        .quality = BroadcastQuality::HIGH;
+    list.push_back(std::move(broadcast_sink));
+    return list;
+  }();
+  return profiles;
+}
+
+void BM_AseConfiguration(benchmark::State& state, const Profile* profile) {
+  auto provider = ndk::SharedRefBase::make<LeAudioOffloadOutputAudioProvider>();
+  std::optional<CapabilityList> sink_capabilities = profile->sink_capabilities;
+  std::vector<LeAudioConfigurationRequirement> requirements = {
+      profile->requirement};
+  AllocationMeter meter;
+  size_t results = 0;
+  meter.Begin();
+  for (auto _ : state) {
+    std::vector<IBluetoothAudioProvider::LeAudioAseConfigurationSetting>
+        settings;
+    meter.BeginQuery();
+    provider->getLeAudioAseConfiguration(sink_capabilities, std::nullopt,
+                                         requirements, &settings);
+    meter.EndQuery();
+    results = settings.size();
+    benchmark::DoNotOptimize(settings);
+  }
+  meter.End(state);
+  state.counters["results"] = results;
+}
+
+void BM_AseQosConfiguration(benchmark::State& state, const Profile* profile) {
+  auto provider = ndk::SharedRefBase::make<LeAudioOffloadOutputAudioProvider>();
+  AllocationMeter meter;
+  bool matched = false;
+  meter.Begin();
+  for (auto _ : state) {
+    IBluetoothAudioProvider::LeAudioAseQosConfigurationPair qos;
+    meter.BeginQuery();
+    provider->getLeAudioAseQosConfiguration(profile->qos_requirement, &qos);
+    meter.EndQuery();
+    matched = qos.sinkQosConfiguration.has_value();
+    benchmark::DoNotOptimize(qos);
+  }
+  meter.End(state);
+  state.counters["results"] = matched;
+}
+
+void BM_BroadcastConfiguration(benchmark::State& state,
+                               const Profile* profile) {
+  auto provider =
+      ndk::SharedRefBase::make<LeAudioOffloadBroadcastAudioProvider>();
+  std::optional<CapabilityList> sink_capabilities = profile->sink_capabilities;
+  AllocationMeter meter;
+  size_t results = 0;
+  meter.Begin();
+  for (auto _ : state) {
+    LeAudioBroadcastConfigurationSetting setting;
+    meter.BeginQuery();
+    provider->getLeAudioBroadcastConfiguration(
+        sink_capabilities, profile->broadcast_requirement, &setting);
+    meter.EndQuery();
+    results = setting.subgroupsConfigurations.size();
+    benchmark::DoNotOptimize(setting);
+  }
+  meter.End(state);
+  state.counters["results"] = results;
+}
+
+/* The in-tree configuration files, installed next to the benchmark, or
+ * below --le_audio_data_dir */
+struct DataFiles {
+  std::string configurations_schema;
+  std::string configurations;
+  std::string scenarios_schema;
+  std::string scenarios;
+  std::string codec_capabilities;
+};
+
+DataFiles& GetDataFiles() {
+  static DataFiles files;
+  return files;
+}
+
+bool LoadConfigurationData(const std::string& dir) {
+  DataFiles& files = GetDataFiles();
+  files.configurations_schema = dir + "/audio_set_configurations.bfbs";
+  files.configurations =
+      dir + "/le_audio_configuration_set/audio_set_configurations.json";
+  files.scenarios_schema = dir + "/audio_set_scenarios.bfbs";
+  files.scenarios =
+      dir + "/le_audio_configuration_set/audio_set_scenarios.json";
+  files.codec_capabilities =
+      dir + "/le_audio_codec_capabilities/le_audio_codec_capabilities.xml";
+
+  AudioSetConfigurationProviderJson::SetContentFilesForTesting(
+      {files.configurations_schema.c_str(), files.configurations.c_str()},
+      {files.scenarios_schema.c_str(), files.scenarios.c_str()});
+  BluetoothLeAudioCodecsProvider::SetLeAudioOffloadSettingFileForTesting(
+      files.codec_capabilities.c_str());
+
+  // Load once up front, as PreloadCodecData() does in the service, so the
+  // benchmarks only see the matching
+  bool ok = true;
+  if (BluetoothAudioCodecs::GetLeAudioAseConfigurationSettings().empty()) {
+    std::cerr << "No ASE configurations in " << files.configurations << "\n";
+    ok = false;
+  }
+  if (LeAudioOffloadAudioProvider::getBroadcastSettings().entries.empty()) {
+    std::cerr << "No broadcast settings in " << files.codec_capabilities
+              << "\n";
+    ok = false;
+  }
+  return ok;
+}
+
+void RegisterLeAudioBenchmarks() {
+  for (const auto& profile : GetProfiles()) {
+    if (profile.unicast) {
+      benchmark::RegisterBenchmark(
+          ("BM_AseConfiguration/" + profile.name).c_str(),
+          BM_AseConfiguration, &profile);
+      benchmark::RegisterBenchmark(
+          ("BM_AseQosConfiguration/" + profile.name).c_str(),
+          BM_AseQosConfiguration, &profile);
+    }
+    benchmark::RegisterBenchmark(
+        ("BM_BroadcastConfiguration/" + profile.name).c_str(),
+        BM_BroadcastConfiguration, &profile);
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  constexpr std::string_view kDataDirFlag = "--le_audio_data_dir=";
+  std::string data_dir = android::base::GetExecutableDirectory();
+  int kept = 1;
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg(argv[i]);
+    if (arg.substr(0, kDataDirFlag.size()) == kDataDirFlag)
+      data_dir = arg.substr(kDataDirFlag.size());
+    else
+      argv[kept++] = argv[i];
+  }
+  argc = kept;
+
+  if (!LoadConfigurationData(data_dir)) return 1;
+  RegisterLeAudioBenchmarks();
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
@@ -323,16 +323,6 @@ bool LeAudioOffloadAudioProvider::isMatchedAseConfiguration(
   return true;
 }
 
-bool LeAudioOffloadAudioProvider::isMatchedBISConfiguration(
-    LeAudioBisConfiguration bis_cfg,
-    const IBluetoothAudioProvider::LeAudioDeviceCapabilities& capabilities) {
-  if (!isMatchedValidCodec(bis_cfg.codecId, capabilities.codecId)) return false;
-  if (!isCapabilitiesMatchedCodecConfiguration(
-          bis_cfg.codecConfiguration, capabilities.codecSpecificCapabilities))
-    return false;
-  return true;
-}
-
 void LeAudioOffloadAudioProvider::filterCapabilitiesAseDirectionConfiguration(
     std::vector<std::optional<AseDirectionConfiguration>>&
         direction_configurations,
@@ -640,15 +630,113 @@ ndk::ScopedAStatus LeAudioOffloadAudioProvider::onSourceAseMetadataChanged(
   return ndk::ScopedAStatus::fromExceptionCode(EX_UNSUPPORTED_OPERATION);
 };
 
-void LeAudioOffloadAudioProvider::getBroadcastSettings() {
-  if (!broadcast_settings.empty()) return;
+static uint32_t tagBit(CodecSpecificConfigurationLtv::Tag tag) {
+  return 1u << static_cast<uint32_t>(tag);
+}
+
+static BroadcastQuality getBroadcastQuality(int32_t sampling_frequency_hz) {
+  // Auracast high quality streams are 48 kHz, standard ones 16 or 24 kHz
+  return sampling_frequency_hz >= 48000 ? BroadcastQuality::HIGH
+                                        : BroadcastQuality::STANDARD;
+}
+
+static BroadcastBisMatchInfo compileBisConfiguration(
+    const LeAudioBisConfiguration& bis_cfg) {
+  BroadcastBisMatchInfo info;
+  info.codec_id = bis_cfg.codecId;
+  for (auto& cfg : bis_cfg.codecConfiguration) {
+    info.present_tags |= tagBit(cfg.getTag());
+    switch (cfg.getTag()) {
+      case CodecSpecificConfigurationLtv::Tag::samplingFrequency: {
+        auto it = freq_to_support_bitmask_map.find(
+            cfg.get<CodecSpecificConfigurationLtv::Tag::samplingFrequency>());
+        if (it != freq_to_support_bitmask_map.end())
+          info.sampling_freq_bit = it->second;
+        break;
+      }
+      case CodecSpecificConfigurationLtv::Tag::frameDuration: {
+        auto it = fduration_to_support_fduration_map.find(
+            cfg.get<CodecSpecificConfigurationLtv::Tag::frameDuration>());
+        if (it != fduration_to_support_fduration_map.end())
+          info.frame_duration_bit = it->second;
+        break;
+      }
+      case CodecSpecificConfigurationLtv::Tag::octetsPerCodecFrame:
+        info.octets_per_frame =
+            cfg.get<CodecSpecificConfigurationLtv::Tag::octetsPerCodecFrame>()
+                .value;
+        break;
+      case CodecSpecificConfigurationLtv::Tag::codecFrameBlocksPerSDU:
+        info.codec_frames_per_sdu =
+            cfg.get<CodecSpecificConfigurationLtv::Tag::codecFrameBlocksPerSDU>()
+                .value;
+        break;
+      default:
+        break;
+    }
+  }
+  return info;
+}
+
+/* Same rules as isCapabilitiesMatchedCodecConfiguration(), on the compiled
+ * BIS information: every capability needs its configuration counterpart and
+ * the configured value has to fall within the capability */
+static bool isMatchedBisCapabilities(
+    const BroadcastBisMatchInfo& bis,
+    const std::vector<CodecSpecificCapabilitiesLtv>& codec_capabilities) {
+  for (auto& capability : codec_capabilities) {
+    auto cfg_tag = cap_to_cfg_tag_map.find(capability.getTag());
+    if (cfg_tag == cap_to_cfg_tag_map.end()) continue;
+    if (!(bis.present_tags & tagBit(cfg_tag->second))) return false;
+
+    switch (capability.getTag()) {
+      case CodecSpecificCapabilitiesLtv::Tag::supportedSamplingFrequencies:
+        if (!(bis.sampling_freq_bit &
+              capability
+                  .get<CodecSpecificCapabilitiesLtv::Tag::
+                           supportedSamplingFrequencies>()
+                  .bitmask))
+          return false;
+        break;
+      case CodecSpecificCapabilitiesLtv::Tag::supportedFrameDurations:
+        if (!(bis.frame_duration_bit &
+              capability
+                  .get<CodecSpecificCapabilitiesLtv::Tag::
+                           supportedFrameDurations>()
+                  .bitmask))
+          return false;
+        break;
+      case CodecSpecificCapabilitiesLtv::Tag::supportedMaxCodecFramesPerSDU:
+        if (bis.codec_frames_per_sdu >
+            capability
+                .get<CodecSpecificCapabilitiesLtv::Tag::
+                         supportedMaxCodecFramesPerSDU>()
+                .value)
+          return false;
+        break;
+      case CodecSpecificCapabilitiesLtv::Tag::supportedOctetsPerCodecFrame: {
+        auto& octets = capability.get<
+            CodecSpecificCapabilitiesLtv::Tag::supportedOctetsPerCodecFrame>();
+        if (bis.octets_per_frame < octets.min ||
+            bis.octets_per_frame > octets.max)
+          return false;
+        break;
+      }
+      default:
+        // Audio channel counts are not matched, see isMatchedAudioChannel()
+        break;
+    }
+  }
+  return true;
+}
 
+static BroadcastSettingsIndex buildBroadcastSettingsIndex() {
   LOG(INFO) << __func__ << ": Loading broadcast settings from provider info";
 
+  BroadcastSettingsIndex index;
   std::vector<CodecInfo> db_codec_info =
       BluetoothAudioCodecs::GetLeAudioOffloadCodecInfo(
           SessionType::LE_AUDIO_BROADCAST_HARDWARE_OFFLOAD_ENCODING_DATAPATH);
-  broadcast_settings.clear();
   CodecSpecificConfigurationLtv::AudioChannelAllocation default_allocation;
   default_allocation.bitmask =
       CodecSpecificConfigurationLtv::AudioChannelAllocation::FRONT_CENTER;
@@ -680,45 +768,60 @@ void LeAudioOffloadAudioProvider::getBroadcastSettings() {
     sub_cfg.bisConfigurations = {sub_bis_cfg};
     setting.subgroupsConfigurations = {sub_cfg};
 
-    broadcast_settings.push_back(setting);
+    BroadcastSettingsIndex::Entry entry;
+    entry.quality = getBroadcastQuality(transport.samplingFrequencyHz[0]);
+    for (auto& subgroup : setting.subgroupsConfigurations) {
+      auto& compiled = entry.subgroups.emplace_back();
+      for (auto& bis : subgroup.bisConfigurations)
+        compiled.bis.push_back(compileBisConfiguration(bis.bisConfiguration));
+    }
+    entry.setting = std::move(setting);
+
+    index.by_quality[static_cast<size_t>(entry.quality)].push_back(
+        index.entries.size());
+    index.entries.push_back(std::move(entry));
   }
 
-  LOG(INFO) << __func__
-            << ": Done loading broadcast settings from provider info";
+  LOG(INFO) << __func__ << ": Done loading " << index.entries.size()
+            << " broadcast settings from provider info";
+  return index;
 }
 
-/* Get a new LeAudioAseConfigurationSetting by matching a setting with a
- * capabilities. The new setting will have a filtered list of
- * AseDirectionConfiguration that matched the capabilities */
-std::optional<LeAudioBroadcastConfigurationSetting>
-LeAudioOffloadAudioProvider::
-    getCapabilitiesMatchedBroadcastConfigurationSettings(
-        LeAudioBroadcastConfigurationSetting& setting,
-        const IBluetoothAudioProvider::LeAudioDeviceCapabilities&
-            capabilities) {
-  std::vector<IBluetoothAudioProvider::LeAudioBroadcastSubgroupConfiguration>
-      filter_subgroup;
-  for (auto& sub_cfg : setting.subgroupsConfigurations) {
-    std::vector<IBluetoothAudioProvider::LeAudioSubgroupBisConfiguration>
-        filtered_bis_cfg;
-    for (auto& bis_cfg : sub_cfg.bisConfigurations)
-      if (isMatchedBISConfiguration(bis_cfg.bisConfiguration, capabilities)) {
-        filtered_bis_cfg.push_back(bis_cfg);
-      }
-    if (!filtered_bis_cfg.empty()) {
-      IBluetoothAudioProvider::LeAudioBroadcastSubgroupConfiguration
-          subgroup_cfg;
-      subgroup_cfg.bisConfigurations = filtered_bis_cfg;
-      filter_subgroup.push_back(subgroup_cfg);
-    }
-  }
-  if (filter_subgroup.empty()) return std::nullopt;
+const BroadcastSettingsIndex&
+LeAudioOffloadAudioProvider::getBroadcastSettings() {
+  static const BroadcastSettingsIndex index = buildBroadcastSettingsIndex();
+  return index;
+}
 
-  // Create a new LeAudioAseConfigurationSetting and return
-  LeAudioBroadcastConfigurationSetting filtered_setting(setting);
-  filtered_setting.subgroupsConfigurations = filter_subgroup;
+/* Bitmask of the BIS in the subgroup matching the capabilities. Subgroups
+ * with more BIS than fit the mask never match */
+uint32_t LeAudioOffloadAudioProvider::getMatchedBisMask(
+    const BroadcastSettingsIndex::Subgroup& subgroup,
+    const IBluetoothAudioProvider::LeAudioDeviceCapabilities& capabilities) {
+  if (subgroup.bis.size() > BroadcastSettingsIndex::kMaxBisPerSubgroup)
+    return 0;
+  uint32_t mask = 0;
+  for (size_t i = 0; i < subgroup.bis.size(); ++i) {
+    auto& bis = subgroup.bis[i];
+    if (!isMatchedValidCodec(bis.codec_id, capabilities.codecId)) continue;
+    if (!isMatchedBisCapabilities(bis, capabilities.codecSpecificCapabilities))
+      continue;
+    mask |= 1u << i;
+  }
+  return mask;
+}
 
-  return filtered_setting;
+bool LeAudioOffloadAudioProvider::isMatchedBroadcastRequirement(
+    size_t matched_bis_count,
+    const IBluetoothAudioProvider::LeAudioBroadcastConfigurationRequirement&
+        requirement) {
+  // No requirement accepts any subgroup with a matching BIS
+  if (requirement.subgroupConfigurationRequirements.empty()) return true;
+  for (auto& sub_req : requirement.subgroupConfigurationRequirements) {
+    // Matching number of BIS, context is not carried by the settings
+    if (sub_req.bisNumPerSubgroup == matched_bis_count) return true;
+  }
+  return false;
 }
 
 ndk::ScopedAStatus
@@ -729,64 +832,74 @@ LeAudioOffloadAudioProvider::getLeAudioBroadcastConfiguration(
     const IBluetoothAudioProvider::LeAudioBroadcastConfigurationRequirement&
         in_requirement,
     LeAudioBroadcastConfigurationSetting* _aidl_return) {
-  getBroadcastSettings();
-  _aidl_return = nullptr;
+  const BroadcastSettingsIndex& broadcast_settings = getBroadcastSettings();
+  *_aidl_return = LeAudioBroadcastConfigurationSetting();
 
-  // Match and filter capability
-  std::vector<LeAudioBroadcastConfigurationSetting> filtered_settings;
   if (!in_remoteSinkAudioCapabilities.has_value()) {
     LOG(WARNING) << __func__ << ": Empty capability";
     return ndk::ScopedAStatus::ok();
   }
-  for (auto& setting : broadcast_settings) {
-    for (auto& capability : in_remoteSinkAudioCapabilities.value()) {
-      if (!capability.has_value()) continue;
-      auto filtered_setting =
-          getCapabilitiesMatchedBroadcastConfigurationSettings(
-              setting, capability.value());
-      if (filtered_setting.has_value())
-        filtered_settings.push_back(filtered_setting.value());
-    }
-  }
-
-  if (filtered_settings.empty()) {
-    LOG(WARNING) << __func__ << ": Cannot match any remote capability";
-    return ndk::ScopedAStatus::ok();
-  }
 
-  // Match and return the first matched requirement
-  if (in_requirement.subgroupConfigurationRequirements.empty()) {
-    LOG(INFO) << __func__ << ": Empty requirement";
-    *_aidl_return = filtered_settings[0];
-    return ndk::ScopedAStatus::ok();
-  }
-
-  for (auto& setting : filtered_settings) {
-    // Further filter out bis configuration
-    LeAudioBroadcastConfigurationSetting filtered_setting(setting);
-    filtered_setting.subgroupsConfigurations.clear();
-    for (auto& sub_cfg : setting.subgroupsConfigurations) {
-      bool isMatched = false;
-      for (auto& sub_req : in_requirement.subgroupConfigurationRequirements) {
-        // Matching number of BIS
-        if (sub_req.bisNumPerSubgroup != sub_cfg.bisConfigurations.size())
-          continue;
-        // Currently will ignore quality and context hint.
-        isMatched = true;
-        break;
+  // Settings of the requested quality come first, the others stay as a
+  // fallback in their original order
+  size_t preferred = static_cast<size_t>(BroadcastQuality::STANDARD);
+  if (!in_requirement.subgroupConfigurationRequirements.empty())
+    preferred = static_cast<size_t>(
+        in_requirement.subgroupConfigurationRequirements[0].quality);
+  if (preferred >= broadcast_settings.by_quality.size())
+    preferred = static_cast<size_t>(BroadcastQuality::STANDARD);
+
+  bool capability_matched = false;
+  for (size_t pass = 0; pass < broadcast_settings.by_quality.size(); ++pass) {
+    size_t quality = pass == 0 ? preferred : (pass == preferred ? 0 : pass);
+    for (uint16_t entry_idx : broadcast_settings.by_quality[quality]) {
+      auto& entry = broadcast_settings.entries[entry_idx];
+      for (auto& capability : in_remoteSinkAudioCapabilities.value()) {
+        if (!capability.has_value()) continue;
+
+        // First pass only decides whether this pair is a match, the
+        // filtered setting is built once a match is found
+        bool any_subgroup_matched = false;
+        bool requirement_matched = false;
+        for (auto& subgroup : entry.subgroups) {
+          uint32_t mask = getMatchedBisMask(subgroup, capability.value());
+          if (!mask) continue;
+          any_subgroup_matched = true;
+          if (isMatchedBroadcastRequirement(__builtin_popcount(mask),
+                                            in_requirement)) {
+            requirement_matched = true;
+            break;
+          }
+        }
+        capability_matched |= any_subgroup_matched;
+        if (!requirement_matched) continue;
+
+        LeAudioBroadcastConfigurationSetting& result = *_aidl_return;
+        result = entry.setting;
+        result.subgroupsConfigurations.clear();
+        for (size_t i = 0; i < entry.subgroups.size(); ++i) {
+          uint32_t mask =
+              getMatchedBisMask(entry.subgroups[i], capability.value());
+          if (!mask || !isMatchedBroadcastRequirement(__builtin_popcount(mask),
+                                                      in_requirement))
+            continue;
+          auto& sub_cfg = entry.setting.subgroupsConfigurations[i];
+          auto& filtered = result.subgroupsConfigurations.emplace_back();
+          for (size_t bis = 0; bis < sub_cfg.bisConfigurations.size(); ++bis)
+            if (mask & (1u << bis))
+              filtered.bisConfigurations.push_back(
+                  sub_cfg.bisConfigurations[bis]);
+        }
+        LOG(INFO) << __func__ << ": Matched requirement";
+        return ndk::ScopedAStatus::ok();
       }
-      if (isMatched)
-        filtered_setting.subgroupsConfigurations.push_back(sub_cfg);
-    }
-    // Return the first match
-    if (!filtered_setting.subgroupsConfigurations.empty()) {
-      LOG(INFO) << __func__ << ": Matched requirement";
-      *_aidl_return = filtered_setting;
-      return ndk::ScopedAStatus::ok();
     }
   }
 
-  LOG(WARNING) << __func__ << ": Cannot match any requirement";
+  if (!capability_matched)
+    LOG(WARNING) << __func__ << ": Cannot match any remote capability";
+  else
+    LOG(WARNING) << __func__ << ": Cannot match any requirement";
   return ndk::ScopedAStatus::ok();
 };
 
@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include <array>
 #include <map>
 
 #include "BluetoothAudioProvider.h"
@@ -41,6 +42,42 @@ using LeAudioAseQosConfiguration =
     IBluetoothAudioProvider::LeAudioAseQosConfiguration;
 using LeAudioBroadcastConfigurationSetting =
     IBluetoothAudioProvider::LeAudioBroadcastConfigurationSetting;
+using BroadcastQuality = IBluetoothAudioProvider::BroadcastQuality;
+
+/* A BIS configuration flattened into the bitmasks the remote capabilities
+ * are expressed in, so matching is a handful of integer compares */
+struct BroadcastBisMatchInfo {
+  CodecId codec_id;
+  // Bit per CodecSpecificConfigurationLtv::Tag present in the configuration
+  uint32_t present_tags = 0;
+  // SupportedSamplingFrequencies/SupportedFrameDurations bit for the
+  // configured value, 0 when the value has no capability counterpart
+  uint32_t sampling_freq_bit = 0;
+  uint32_t frame_duration_bit = 0;
+  int32_t octets_per_frame = 0;
+  int32_t codec_frames_per_sdu = 0;
+};
+
+/* Broadcast settings compiled once from the codec info DB. Every setting
+ * keeps its match info per subgroup and per BIS, and the settings are
+ * indexed by broadcast quality. The codec info DB carries no audio context,
+ * so every setting is a candidate for every context */
+struct BroadcastSettingsIndex {
+  static constexpr size_t kMaxBisPerSubgroup = 32;
+
+  struct Subgroup {
+    std::vector<BroadcastBisMatchInfo> bis;
+  };
+  struct Entry {
+    LeAudioBroadcastConfigurationSetting setting;
+    BroadcastQuality quality;
+    std::vector<Subgroup> subgroups;
+  };
+
+  std::vector<Entry> entries;
+  // Indices into entries, grouped by BroadcastQuality
+  std::array<std::vector<uint16_t>, 2> by_quality;
+};
 
 class LeAudioOffloadAudioProvider : public BluetoothAudioProvider {
  public:
@@ -89,10 +126,12 @@ class LeAudioOffloadAudioProvider : public BluetoothAudioProvider {
           in_requirement,
       LeAudioBroadcastConfigurationSetting* _aidl_return) override;
 
+  // Built on first use and shared by every provider instance.
+  static const BroadcastSettingsIndex& getBroadcastSettings();
+
  private:
   ndk::ScopedAStatus onSessionReady(DataMQDesc* _aidl_return) override;
   std::map<CodecId, uint32_t> codec_priority_map_;
-  std::vector<LeAudioBroadcastConfigurationSetting> broadcast_settings;
 
   // Private matching function definitions
   bool isMatchedValidCodec(CodecId cfg_codec, CodecId req_codec);
@@ -124,9 +163,6 @@ class LeAudioOffloadAudioProvider : public BluetoothAudioProvider {
       std::vector<CodecSpecificCapabilitiesLtv> codec_capabilities);
   bool isMatchedAseConfiguration(LeAudioAseConfiguration setting_cfg,
                                  LeAudioAseConfiguration requirement_cfg);
-  bool isMatchedBISConfiguration(
-      LeAudioBisConfiguration bis_cfg,
-      const IBluetoothAudioProvider::LeAudioDeviceCapabilities& capabilities);
   void filterCapabilitiesAseDirectionConfiguration(
       std::vector<std::optional<AseDirectionConfiguration>>&
           direction_configurations,
@@ -152,11 +188,13 @@ class LeAudioOffloadAudioProvider : public BluetoothAudioProvider {
           requirement);
   bool isMatchedQosRequirement(LeAudioAseQosConfiguration setting_qos,
                                AseQosDirectionRequirement requirement_qos);
-  std::optional<LeAudioBroadcastConfigurationSetting>
-  getCapabilitiesMatchedBroadcastConfigurationSettings(
-      LeAudioBroadcastConfigurationSetting& setting,
+  uint32_t getMatchedBisMask(
+      const BroadcastSettingsIndex::Subgroup& subgroup,
       const IBluetoothAudioProvider::LeAudioDeviceCapabilities& capabilities);
-  void getBroadcastSettings();
+  bool isMatchedBroadcastRequirement(
+      size_t matched_bis_count,
+      const IBluetoothAudioProvider::LeAudioBroadcastConfigurationRequirement&
+          requirement);
 };
 
 class LeAudioOffloadOutputAudioProvider : public LeAudioOffloadAudioProvider {
@@ -24,6 +24,8 @@
 
 #include <cstdint>
 
+#include "DataMQPool.h"
+
 namespace aidl {
 namespace android {
 namespace hardware {
@@ -61,7 +63,7 @@ LeAudioSoftwareBroadcastAudioProvider::LeAudioSoftwareBroadcastAudioProvider()
 }
 
 LeAudioSoftwareAudioProvider::LeAudioSoftwareAudioProvider()
-    : BluetoothAudioProvider(), data_mq_(nullptr) {}
+    : BluetoothAudioProvider() {}
 
 bool LeAudioSoftwareAudioProvider::isValid(const SessionType& sessionType) {
   return (sessionType == session_type_);
@@ -114,15 +116,12 @@ ndk::ScopedAStatus LeAudioSoftwareAudioProvider::startSession(
   LOG(INFO) << __func__ << " - size of audio buffer " << data_mq_size
             << " byte(s)";
 
-  std::unique_ptr<DataMQ> temp_data_mq(
-      new DataMQ(data_mq_size, /* EventFlag */ true));
-  if (temp_data_mq == nullptr || !temp_data_mq->isValid()) {
-    ALOGE_IF(!temp_data_mq, "failed to allocate data MQ");
-    ALOGE_IF(temp_data_mq && !temp_data_mq->isValid(), "data MQ is invalid");
+  data_mq_ = nullptr;
+  data_mq_ = DataMQPool::Acquire(session_type_, data_mq_size);
+  if (data_mq_ == nullptr) {
     *_aidl_return = DataMQDesc();
     return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
   }
-  data_mq_ = std::move(temp_data_mq);
 
   return BluetoothAudioProvider::startSession(
       host_if, audio_config, latency_modes, _aidl_return);
@@ -141,6 +140,82 @@ ndk::ScopedAStatus LeAudioSoftwareAudioProvider::onSessionReady(
   return ndk::ScopedAStatus::ok();
 }
 
+ndk::ScopedAStatus LeAudioSoftwareOutputAudioProvider::endSession() {
+  auto status = LeAudioSoftwareAudioProvider::endSession();
+  std::lock_guard<std::mutex> guard(location_mutex_);
+  for (auto& location_mq : location_mqs_)
+    DataMQPool::Release(session_type_, std::move(location_mq));
+  location_mqs_.clear();
+  return status;
+}
+
+ndk::ScopedAStatus LeAudioSoftwareOutputAudioProvider::startLocationQueues(
+    const std::vector<int32_t>& audio_locations,
+    std::vector<DataMQDesc>* _aidl_return) {
+  std::lock_guard<std::mutex> guard(location_mutex_);
+  if (stack_iface_ == nullptr || audio_config_ == nullptr ||
+      data_mq_ == nullptr) {
+    LOG(INFO) << __func__ << " - SessionType=" << toString(session_type_)
+              << " has NO session";
+    return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_STATE);
+  }
+
+  // One location bit per channel, in channel order
+  const auto& pcm_config = audio_config_->get<AudioConfiguration::pcmConfig>();
+  uint32_t channels = channel_mode_to_channel_count(pcm_config.channelMode);
+  bool valid = channels >= 2 && audio_locations.size() == channels;
+  for (size_t i = 0; valid && i < audio_locations.size(); i++) {
+    uint32_t location = audio_locations[i];
+    valid = location != 0 && (location & (location - 1)) == 0 &&
+            (i == 0 || location > static_cast<uint32_t>(audio_locations[i - 1]));
+  }
+  if (!valid) {
+    LOG(WARNING) << __func__ << " - SessionType=" << toString(session_type_)
+                 << " can't split " << pcm_config.toString() << " over "
+                 << audio_locations.size() << " audio location(s)";
+    return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
+  }
+
+  // Each location gets its share of the interleaved ring
+  size_t data_mq_size = data_mq_->getQuantumCount() / channels;
+  std::vector<std::shared_ptr<DataMQ>> location_mqs;
+  std::vector<DataMQDesc> descs;
+  for (uint32_t i = 0; i < channels; i++) {
+    auto location_mq = DataMQPool::Acquire(session_type_, data_mq_size);
+    if (location_mq == nullptr) {
+      return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_STATE);
+    }
+    descs.push_back(location_mq->dupeDesc());
+    location_mqs.push_back(std::move(location_mq));
+  }
+  if (!BluetoothAudioSessionReport::OnLocationQueuesStarted(session_type_,
+                                                            descs)) {
+    return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
+  }
+
+  // Rings of a previous call aren't released, the stack may still read them
+  location_mqs_ = std::move(location_mqs);
+  *_aidl_return = std::move(descs);
+  LOG(INFO) << __func__ << " - SessionType=" << toString(session_type_)
+            << " " << channels << " ring(s) of " << data_mq_size
+            << " byte(s)";
+  return ndk::ScopedAStatus::ok();
+}
+
+LeAudioLocationQueues::LeAudioLocationQueues(
+    const std::shared_ptr<LeAudioSoftwareOutputAudioProvider>& provider)
+    : provider_(provider) {}
+
+ndk::ScopedAStatus LeAudioLocationQueues::startLocationQueues(
+    const std::vector<int32_t>& audio_locations,
+    std::vector<DataMQDesc>* _aidl_return) {
+  auto provider = provider_.lock();
+  if (provider == nullptr) {
+    return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_STATE);
+  }
+  return provider->startLocationQueues(audio_locations, _aidl_return);
+}
+
 }  // namespace audio
 }  // namespace bluetooth
 }  // namespace hardware
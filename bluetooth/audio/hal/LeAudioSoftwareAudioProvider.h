@@ -16,6 +16,10 @@
 
 #pragma once
 
+#include <aidl/me/phh/bluetooth/audio/BnLeAudioLocationQueues.h>
+
+#include <mutex>
+
 #include "BluetoothAudioProvider.h"
 
 namespace aidl {
@@ -37,15 +41,41 @@ class LeAudioSoftwareAudioProvider : public BluetoothAudioProvider {
       DataMQDesc* _aidl_return);
 
  private:
-  // audio data queue for software encoding
-  std::unique_ptr<DataMQ> data_mq_;
-
   ndk::ScopedAStatus onSessionReady(DataMQDesc* _aidl_return) override;
 };
 
 class LeAudioSoftwareOutputAudioProvider : public LeAudioSoftwareAudioProvider {
  public:
   LeAudioSoftwareOutputAudioProvider();
+
+  ndk::ScopedAStatus endSession() override;
+  // See ILeAudioLocationQueues
+  ndk::ScopedAStatus startLocationQueues(
+      const std::vector<int32_t>& audio_locations,
+      std::vector<DataMQDesc>* _aidl_return);
+
+ private:
+  std::mutex location_mutex_;
+  // one ring per audio location, from DataMQPool like data_mq_
+  std::vector<std::shared_ptr<DataMQ>> location_mqs_;
+};
+
+/* The ILeAudioLocationQueues extension of a LeAudioSoftwareOutputAudioProvider
+ * binder */
+class LeAudioLocationQueues
+    : public ::aidl::me::phh::bluetooth::audio::BnLeAudioLocationQueues {
+ public:
+  LeAudioLocationQueues(
+      const std::shared_ptr<LeAudioSoftwareOutputAudioProvider>& provider);
+
+  ndk::ScopedAStatus startLocationQueues(
+      const std::vector<int32_t>& audio_locations,
+      std::vector<DataMQDesc>* _aidl_return) override;
+
+ private:
+  // The extension lives as long as the provider's binder, which may outlive
+  // the provider itself
+  std::weak_ptr<LeAudioSoftwareOutputAudioProvider> provider_;
 };
 
 class LeAudioSoftwareInputAudioProvider : public LeAudioSoftwareAudioProvider {
@@ -19,6 +19,11 @@
 #include <dlfcn.h>
 #include <signal.h>
 
+#include <chrono>
+#include <cinttypes>
+#include <thread>
+
+#include <android-base/properties.h>
 #include <android/binder_manager.h>
 #include <android/binder_process.h>
 #include <utils/Log.h>
@@ -26,10 +31,15 @@
 #include <hwbinder/ProcessState.h>
 #include <binder/ProcessState.h>
 
+#include "BluetoothAudioCodecs.h"
 #include "BluetoothAudioProviderFactory.h"
+#include "LeAudioOffloadAudioProvider.h"
 
+using ::aidl::android::hardware::bluetooth::audio::BluetoothAudioCodecs;
 using ::aidl::android::hardware::bluetooth::audio::
     BluetoothAudioProviderFactory;
+using ::aidl::android::hardware::bluetooth::audio::
+    LeAudioOffloadAudioProvider;
 
 #if defined(__LP64__)
 #define HAL_LIBRARY_PATH "/system/lib64/hw"
@@ -67,9 +77,35 @@ void registerAudioInterfaces() {
   }
 }
 
+static int64_t msSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+// Parse the LE Audio capability XML and set configuration JSON while the
+// threadpools come up, rather than on the first call from the Bluetooth stack.
+void preloadCodecData(std::chrono::steady_clock::time_point start) {
+  if (!::android::base::GetBoolProperty(
+          "persist.bluetooth.system_audio_hal.preload", true)) {
+    ALOGI("Codec data preload disabled");
+    return;
+  }
+
+  std::thread([start] {
+    ALOGI("Codec data preload started at +%" PRId64 "ms", msSince(start));
+    BluetoothAudioCodecs::PreloadCodecData();
+    LeAudioOffloadAudioProvider::getBroadcastSettings();
+    ALOGI("Codec data preload finished at +%" PRId64 "ms", msSince(start));
+  }).detach();
+}
+
 int main() {
+  const auto start = std::chrono::steady_clock::now();
   signal(SIGPIPE, SIG_IGN);
 
+  preloadCodecData(start);
+
   ::android::hardware::configureRpcThreadpool(16, true);
   ::android::ProcessState::initWithDriver("/dev/binder");
   // start a threadpool for binder / hwbinder interactions
@@ -83,10 +119,13 @@ int main() {
       factory->asBinder().get(), instance_name.c_str());
   ALOGW_IF(aidl_status != STATUS_OK, "Could not register %s, status=%d",
            instance_name.c_str(), aidl_status);
+  ALOGI("Registered %s at +%" PRId64 "ms", instance_name.c_str(),
+        msSince(start));
 
   // We must also implement audio HAL interfaces in order to serve audio.sysbta.default.so
   // It must be served in the *same* process to access the same libbluetooth_audio_session
   registerAudioInterfaces();
+  ALOGI("Registered audio HAL interfaces at +%" PRId64 "ms", msSince(start));
 
   ::android::hardware::joinRpcThreadpool();
 }
@@ -0,0 +1,106 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <string>
+#include <utility>
+
+#include "datapath_harness.h"
+
+namespace {
+
+using ::android::bluetooth::audio::harness::DatapathConfig;
+using ::android::bluetooth::audio::harness::DatapathOptions;
+using ::android::bluetooth::audio::harness::DatapathReport;
+using ::android::bluetooth::audio::harness::DriveMode;
+using ::android::bluetooth::audio::harness::GetDatapathConfigs;
+using ::android::bluetooth::audio::harness::RunDatapath;
+
+// Arg: stack pace in percent of real time, 0 runs the stack free
+void BM_Datapath(benchmark::State& state, const DatapathConfig* config,
+                 DriveMode mode) {
+  DatapathOptions options;
+  options.mode = mode;
+  options.speed = state.range(0) / 100.0;
+
+  DatapathReport total;
+  for (auto _ : state) {
+    DatapathReport report = RunDatapath(*config, options);
+    if (!report.ok) {
+      state.SkipWithError("data path did not run through");
+      return;
+    }
+    state.SetIterationTime(report.seconds);
+    total.bytes += report.bytes;
+    total.stack_wakeups += report.stack_wakeups;
+    total.calls += report.calls;
+    total.short_calls += report.short_calls;
+    total.underruns += report.underruns;
+    total.overruns += report.overruns;
+    total.corrupted_bytes += report.corrupted_bytes;
+    for (auto [worst, latency_us] :
+         {std::pair{&total.latency_p50_us, report.latency_p50_us},
+          std::pair{&total.latency_p90_us, report.latency_p90_us},
+          std::pair{&total.latency_p99_us, report.latency_p99_us},
+          std::pair{&total.latency_max_us, report.latency_max_us}})
+      *worst = std::max(*worst, latency_us);
+  }
+
+  state.SetBytesProcessed(total.bytes);
+  auto per_run = benchmark::Counter::kAvgIterations;
+  state.counters["stack_wakeups"] = {double(total.stack_wakeups), per_run};
+  state.counters["calls"] = {double(total.calls), per_run};
+  state.counters["short_calls"] = {double(total.short_calls), per_run};
+  state.counters["underruns"] = {double(total.underruns), per_run};
+  state.counters["overruns"] = {double(total.overruns), per_run};
+  state.counters["corrupted_bytes"] = double(total.corrupted_bytes);
+  // Worst of the runs
+  state.counters["p50_us"] = total.latency_p50_us;
+  state.counters["p90_us"] = total.latency_p90_us;
+  state.counters["p99_us"] = total.latency_p99_us;
+  state.counters["max_us"] = total.latency_max_us;
+}
+
+void RegisterDatapathBenchmarks() {
+  for (const auto& config : GetDatapathConfigs()) {
+    for (auto mode : {DriveMode::kSession, DriveMode::kStream}) {
+      if (mode == DriveMode::kStream && config.device == AUDIO_DEVICE_NONE)
+        continue;
+      std::string name = "BM_Datapath/" + config.name +
+                         (mode == DriveMode::kStream ? "/Stream" : "/Session");
+      benchmark::RegisterBenchmark(name.c_str(), BM_Datapath, &config, mode)
+          ->Arg(100)
+          ->Arg(1000)
+          ->Arg(0)
+          ->UseManualTime()
+          ->Iterations(3)
+          ->Unit(benchmark::kMillisecond);
+    }
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  RegisterDatapathBenchmarks();
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
@@ -0,0 +1,657 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "BTAudioHalDatapathHarness"
+
+#include "datapath_harness.h"
+
+#include <aidl/android/hardware/bluetooth/audio/BnBluetoothAudioPort.h>
+#include <android-base/logging.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <ostream>
+#include <thread>
+
+#include "BluetoothAudioSession.h"
+#include "stream_apis.h"
+
+namespace android {
+namespace bluetooth {
+namespace audio {
+namespace harness {
+
+using ::aidl::android::hardware::audio::common::SinkMetadata;
+using ::aidl::android::hardware::audio::common::SourceMetadata;
+using ::aidl::android::hardware::bluetooth::audio::AudioConfiguration;
+using ::aidl::android::hardware::bluetooth::audio::BluetoothAudioSession;
+using ::aidl::android::hardware::bluetooth::audio::
+    BluetoothAudioSessionInstance;
+using ::aidl::android::hardware::bluetooth::audio::BluetoothAudioStatus;
+using ::aidl::android::hardware::bluetooth::audio::BnBluetoothAudioPort;
+using ::aidl::android::hardware::bluetooth::audio::ChannelMode;
+using ::aidl::android::hardware::bluetooth::audio::CodecType;
+using ::aidl::android::hardware::bluetooth::audio::DataMQ;
+using ::aidl::android::hardware::bluetooth::audio::DataMQDesc;
+using ::aidl::android::hardware::bluetooth::audio::LatencyMode;
+using ::aidl::android::hardware::bluetooth::audio::MQDataType;
+using ::aidl::android::hardware::bluetooth::audio::PresentationPosition;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Payload bytes are numbered modulo a prime, so a dropped, repeated or
+// reordered chunk shows up whatever the frame size is
+constexpr uint64_t kPatternModulo = 251;
+// Consecutive calls moving nothing before the run is given up
+constexpr int kMaxStalledCalls = 8;
+// Time the stack gets to drain the FMQ once the audio side is done
+constexpr auto kDrainTimeout = std::chrono::seconds(2);
+
+void FillPattern(MQDataType* buffer, size_t bytes, uint64_t offset) {
+  for (size_t i = 0; i < bytes; ++i)
+    buffer[i] = static_cast<MQDataType>((offset + i) % kPatternModulo);
+}
+
+uint64_t CountMismatches(const MQDataType* buffer, size_t bytes,
+                         uint64_t offset) {
+  uint64_t mismatches = 0;
+  for (size_t i = 0; i < bytes; ++i)
+    mismatches +=
+        buffer[i] != static_cast<MQDataType>((offset + i) % kPatternModulo);
+  return mismatches;
+}
+
+size_t ChannelCount(ChannelMode channel_mode) {
+  switch (channel_mode) {
+    case ChannelMode::MONO:
+      return 1;
+    case ChannelMode::STEREO:
+      return 2;
+    default:
+      return 0;
+  }
+}
+
+PcmConfiguration MakePcmConfig(int32_t sample_rate_hz, ChannelMode mode,
+                               int32_t data_interval_us) {
+  PcmConfiguration pcm_config;
+  pcm_config.sampleRateHz = sample_rate_hz;
+  pcm_config.channelMode = mode;
+  pcm_config.bitsPerSample = 16;
+  pcm_config.dataIntervalUs = data_interval_us;
+  return pcm_config;
+}
+
+// A2dpSoftwareEncodingAudioProvider: 10 RTP frames of 96 stereo 16 bit
+// frames, double buffered
+constexpr size_t kA2dpDataMqSize = 4 * 96 * 10 * 2;
+
+// LeAudioSoftwareAudioProvider and HfpSoftwareAudioProvider: two data
+// intervals
+size_t TwoIntervals(const PcmConfiguration& pcm_config) {
+  return 2 * static_cast<size_t>(pcm_config.sampleRateHz) *
+         ChannelCount(pcm_config.channelMode) * pcm_config.bitsPerSample / 8 *
+         pcm_config.dataIntervalUs / 1000000;
+}
+
+DatapathConfig MakeConfig(std::string name, SessionType session_type,
+                          const PcmConfiguration& pcm_config,
+                          audio_devices_t device) {
+  size_t data_mq_size =
+      session_type == SessionType::A2DP_SOFTWARE_ENCODING_DATAPATH
+          ? kA2dpDataMqSize
+          : TwoIntervals(pcm_config);
+  return DatapathConfig{std::move(name), session_type, pcm_config,
+                        data_mq_size, device};
+}
+
+double Percentile(const std::vector<double>& sorted, double percentile) {
+  if (sorted.empty()) return 0;
+  size_t index = static_cast<size_t>(percentile / 100 * (sorted.size() - 1));
+  return sorted[index];
+}
+
+/***
+ * Plays the Bluetooth stack: acknowledges stream control requests the way
+ * the stack does through the provider, and once streaming moves one data
+ * interval through the FMQ per tick, counting everything it sees
+ ***/
+class FakeStackPort : public BnBluetoothAudioPort {
+ public:
+  FakeStackPort(const DatapathConfig& config, DataMQ* data_mq, double speed)
+      : config_(config),
+        data_mq_(data_mq),
+        interval_bytes_(config.BytesPerInterval()),
+        scratch_(interval_bytes_) {
+    if (speed > 0)
+      tick_ = std::chrono::duration_cast<Clock::duration>(
+          std::chrono::microseconds(config.pcm_config.dataIntervalUs) / speed);
+  }
+
+  ndk::ScopedAStatus startStream(bool /*in_isLowLatency*/) override {
+    RequestControl(Control::kStart);
+    return ndk::ScopedAStatus::ok();
+  }
+  ndk::ScopedAStatus suspendStream() override {
+    RequestControl(Control::kSuspend);
+    return ndk::ScopedAStatus::ok();
+  }
+  ndk::ScopedAStatus stopStream() override {
+    streaming_ = false;
+    return ndk::ScopedAStatus::ok();
+  }
+  ndk::ScopedAStatus getPresentationPosition(
+      PresentationPosition* _aidl_return) override {
+    _aidl_return->remoteDeviceAudioDelayNanos = 0;
+    _aidl_return->transmittedOctets = moved_;
+    _aidl_return->transmittedOctetsTimestamp.tvSec = 0;
+    _aidl_return->transmittedOctetsTimestamp.tvNSec =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            Clock::now().time_since_epoch())
+            .count();
+    return ndk::ScopedAStatus::ok();
+  }
+  ndk::ScopedAStatus updateSourceMetadata(const SourceMetadata&) override {
+    return ndk::ScopedAStatus::ok();
+  }
+  ndk::ScopedAStatus updateSinkMetadata(const SinkMetadata&) override {
+    return ndk::ScopedAStatus::ok();
+  }
+  ndk::ScopedAStatus setLatencyMode(LatencyMode) override {
+    return ndk::ScopedAStatus::ok();
+  }
+  ndk::ScopedAStatus setCodecType(CodecType) override {
+    return ndk::ScopedAStatus::ok();
+  }
+
+  void Start(uint64_t total_bytes) {
+    total_bytes_ = total_bytes;
+    thread_ = std::thread([this] { Loop(); });
+  }
+
+  void Stop() {
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      stopping_ = true;
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) thread_.join();
+  }
+
+  // Waits until the stack has moved every byte of the run
+  bool WaitDone(Clock::duration timeout) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return cv_.wait_for(lock, timeout, [this] { return done_; });
+  }
+
+  // While the audio side runs, a tick short of data is an underrun
+  void SetAudioSideRunning(bool running) { audio_side_running_ = running; }
+
+  // Reads one FMQ per channel instead of the interleaved one, before Start()
+  void SetLocationQueues(std::vector<DataMQ*> location_mqs) {
+    location_mqs_ = std::move(location_mqs);
+  }
+
+  uint64_t moved() const { return moved_; }
+  uint64_t wakeups() const { return wakeups_; }
+  uint64_t underruns() const { return underruns_; }
+  uint64_t overruns() const { return overruns_; }
+  uint64_t corrupted_bytes() const { return corrupted_bytes_; }
+  Clock::time_point done_time() const { return done_time_; }
+
+ private:
+  enum class Control { kNone, kStart, kSuspend };
+
+  void RequestControl(Control control) {
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      pending_control_ = control;
+    }
+    cv_.notify_all();
+  }
+
+  // The stack answers asynchronously, as it would over binder
+  void ReportControl(Control control) {
+    streaming_ = control == Control::kStart;
+    auto session =
+        BluetoothAudioSessionInstance::GetSessionInstance(config_.session_type);
+    if (session != nullptr)
+      session->ReportControlStatus(control == Control::kStart,
+                                   BluetoothAudioStatus::SUCCESS);
+  }
+
+  void Loop() {
+    auto next_tick = Clock::now();
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+      cv_.wait_until(lock, next_tick, [this] {
+        return stopping_ || pending_control_ != Control::kNone;
+      });
+      if (stopping_) break;
+      if (pending_control_ != Control::kNone) {
+        Control control = pending_control_;
+        pending_control_ = Control::kNone;
+        lock.unlock();
+        ReportControl(control);
+        lock.lock();
+        continue;
+      }
+      auto now = Clock::now();
+      if (now < next_tick) continue;
+      next_tick = tick_.count() ? next_tick + tick_ : now;
+      if (!streaming_ || done_) {
+        if (!tick_.count()) std::this_thread::yield();
+        continue;
+      }
+
+      lock.unlock();
+      ++wakeups_;
+      if (config_.IsInput())
+        Produce();
+      else
+        Consume();
+      if (!tick_.count()) std::this_thread::yield();
+      lock.lock();
+
+      if (moved_ == total_bytes_) {
+        done_ = true;
+        done_time_ = Clock::now();
+        cv_.notify_all();
+      }
+    }
+  }
+
+  void Consume() {
+    size_t want = std::min<uint64_t>(interval_bytes_, total_bytes_ - moved_);
+    if (!location_mqs_.empty()) {
+      ConsumeLocations(want);
+      return;
+    }
+    size_t available = data_mq_->availableToRead();
+    if (available < want && audio_side_running_ && moved_ > 0) ++underruns_;
+    size_t bytes = std::min(available, want);
+    if (bytes == 0 || !data_mq_->read(scratch_.data(), bytes)) return;
+    corrupted_bytes_ += CountMismatches(scratch_.data(), bytes, moved_);
+    moved_ += bytes;
+  }
+
+  // Takes the same number of samples out of every location and interleaves
+  // them again, as the PCM was before the HAL split it
+  void ConsumeLocations(size_t want) {
+    size_t channels = location_mqs_.size();
+    size_t sample_size = config_.FrameSize() / channels;
+    size_t frames = want / config_.FrameSize();
+    size_t available = frames;
+    for (auto location_mq : location_mqs_)
+      available =
+          std::min(available, location_mq->availableToRead() / sample_size);
+    if (available < frames && audio_side_running_ && moved_ > 0) ++underruns_;
+    if (available == 0) return;
+
+    std::vector<MQDataType> samples(available * sample_size);
+    for (size_t channel = 0; channel < channels; ++channel) {
+      if (!location_mqs_[channel]->read(samples.data(), samples.size()))
+        return;
+      for (size_t frame = 0; frame < available; ++frame)
+        std::copy_n(&samples[frame * sample_size], sample_size,
+                    &scratch_[(frame * channels + channel) * sample_size]);
+    }
+    size_t bytes = available * config_.FrameSize();
+    corrupted_bytes_ += CountMismatches(scratch_.data(), bytes, moved_);
+    moved_ += bytes;
+  }
+
+  void Produce() {
+    size_t want = std::min<uint64_t>(interval_bytes_, total_bytes_ - moved_);
+    size_t space = data_mq_->availableToWrite();
+    if (space < want && audio_side_running_) ++overruns_;
+    // What does not fit stays with the stack for the next tick
+    size_t bytes = std::min(space, want);
+    if (bytes == 0) return;
+    FillPattern(scratch_.data(), bytes, moved_);
+    if (data_mq_->write(scratch_.data(), bytes)) moved_ += bytes;
+  }
+
+  const DatapathConfig& config_;
+  DataMQ* data_mq_;
+  std::vector<DataMQ*> location_mqs_;
+  const size_t interval_bytes_;
+  std::vector<MQDataType> scratch_;
+  Clock::duration tick_{0};
+  uint64_t total_bytes_ = 0;
+
+  std::thread thread_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  Control pending_control_ = Control::kNone;
+  bool stopping_ = false;
+  bool done_ = false;
+  Clock::time_point done_time_;
+
+  std::atomic<bool> streaming_ = false;
+  std::atomic<bool> audio_side_running_ = false;
+  std::atomic<uint64_t> moved_ = 0;
+  std::atomic<uint64_t> wakeups_ = 0;
+  std::atomic<uint64_t> underruns_ = 0;
+  std::atomic<uint64_t> overruns_ = 0;
+  std::atomic<uint64_t> corrupted_bytes_ = 0;
+};
+
+/***
+ * The audio side of a run: either BluetoothAudioSession itself or a sysbta
+ * stream opened on the session's device. Transfer() returns the bytes moved
+ * or a negative errno
+ ***/
+class AudioSide {
+ public:
+  virtual ~AudioSide() = default;
+  virtual bool Open() = 0;
+  virtual size_t PreferredCallBytes() const = 0;
+  virtual ssize_t Transfer(MQDataType* buffer, size_t bytes) = 0;
+  virtual void Close() = 0;
+};
+
+class SessionAudioSide : public AudioSide {
+ public:
+  explicit SessionAudioSide(const DatapathConfig& config) : config_(config) {}
+
+  bool Open() override {
+    session_ = BluetoothAudioSessionInstance::GetSessionInstance(
+        config_.session_type);
+    return session_ != nullptr && session_->StartStream(false);
+  }
+  size_t PreferredCallBytes() const override {
+    return config_.BytesPerInterval();
+  }
+  ssize_t Transfer(MQDataType* buffer, size_t bytes) override {
+    return config_.IsInput() ? session_->InReadPcmData(buffer, bytes)
+                             : session_->OutWritePcmData(buffer, bytes);
+  }
+  void Close() override {
+    if (session_ != nullptr) session_->StopStream();
+  }
+
+ private:
+  const DatapathConfig& config_;
+  std::shared_ptr<BluetoothAudioSession> session_;
+};
+
+class StreamAudioSide : public AudioSide {
+ public:
+  explicit StreamAudioSide(const DatapathConfig& config) : config_(config) {}
+
+  bool Open() override {
+    if (config_.device == AUDIO_DEVICE_NONE) return false;
+    audio_config config = AUDIO_CONFIG_INITIALIZER;
+    config.sample_rate = config_.pcm_config.sampleRateHz;
+    config.format = AUDIO_FORMAT_PCM_16_BIT;
+    auto* device = &device_.audio_device_;
+    if (config_.IsInput()) {
+      config.channel_mask =
+          config_.pcm_config.channelMode == ChannelMode::MONO
+              ? AUDIO_CHANNEL_IN_MONO
+              : AUDIO_CHANNEL_IN_STEREO;
+      return adev_open_input_stream(device, 0, config_.device, &config,
+                                    &stream_in_, AUDIO_INPUT_FLAG_NONE, "",
+                                    AUDIO_SOURCE_DEFAULT) == 0;
+    }
+    config.channel_mask = config_.pcm_config.channelMode == ChannelMode::MONO
+                              ? AUDIO_CHANNEL_OUT_MONO
+                              : AUDIO_CHANNEL_OUT_STEREO;
+    return adev_open_output_stream(device, 0, config_.device,
+                                   AUDIO_OUTPUT_FLAG_NONE, &config,
+                                   &stream_out_, "") == 0;
+  }
+  size_t PreferredCallBytes() const override {
+    return stream_in_ ? stream_in_->common.get_buffer_size(&stream_in_->common)
+                      : stream_out_->common.get_buffer_size(
+                            &stream_out_->common);
+  }
+  ssize_t Transfer(MQDataType* buffer, size_t bytes) override {
+    return stream_in_ ? stream_in_->read(stream_in_, buffer, bytes)
+                      : stream_out_->write(stream_out_, buffer, bytes);
+  }
+  void Close() override {
+    if (stream_in_) {
+      stream_in_->common.standby(&stream_in_->common);
+      adev_close_input_stream(&device_.audio_device_, stream_in_);
+      stream_in_ = nullptr;
+    }
+    if (stream_out_) {
+      stream_out_->common.standby(&stream_out_->common);
+      adev_close_output_stream(&device_.audio_device_, stream_out_);
+      stream_out_ = nullptr;
+    }
+  }
+
+ private:
+  const DatapathConfig& config_;
+  BluetoothAudioDevice device_;
+  audio_stream_in* stream_in_ = nullptr;
+  audio_stream_out* stream_out_ = nullptr;
+};
+
+}  // namespace
+
+bool DatapathConfig::IsInput() const {
+  return session_type == SessionType::LE_AUDIO_SOFTWARE_DECODING_DATAPATH ||
+         session_type == SessionType::HFP_SOFTWARE_DECODING_DATAPATH ||
+         session_type == SessionType::A2DP_SOFTWARE_DECODING_DATAPATH;
+}
+
+size_t DatapathConfig::FrameSize() const {
+  return ChannelCount(pcm_config.channelMode) * pcm_config.bitsPerSample / 8;
+}
+
+size_t DatapathConfig::BytesPerInterval() const {
+  return static_cast<size_t>(pcm_config.sampleRateHz) *
+         pcm_config.dataIntervalUs / 1000000 * FrameSize();
+}
+
+const std::vector<DatapathConfig>& GetDatapathConfigs() {
+  static const std::vector<DatapathConfig> configs = {
+      MakeConfig("A2dp44k1Stereo", SessionType::A2DP_SOFTWARE_ENCODING_DATAPATH,
+                 MakePcmConfig(44100, ChannelMode::STEREO, 20000),
+                 AUDIO_DEVICE_OUT_BLUETOOTH_A2DP),
+      MakeConfig("A2dp48kStereo", SessionType::A2DP_SOFTWARE_ENCODING_DATAPATH,
+                 MakePcmConfig(48000, ChannelMode::STEREO, 20000),
+                 AUDIO_DEVICE_OUT_BLUETOOTH_A2DP),
+      MakeConfig("LeAudioOut48kStereo",
+                 SessionType::LE_AUDIO_SOFTWARE_ENCODING_DATAPATH,
+                 MakePcmConfig(48000, ChannelMode::STEREO, 10000),
+                 AUDIO_DEVICE_OUT_BLE_HEADSET),
+      MakeConfig("LeAudioIn16kMono",
+                 SessionType::LE_AUDIO_SOFTWARE_DECODING_DATAPATH,
+                 MakePcmConfig(16000, ChannelMode::MONO, 10000),
+                 AUDIO_DEVICE_IN_BLE_HEADSET),
+      MakeConfig("LeAudioBroadcast48kStereo",
+                 SessionType::LE_AUDIO_BROADCAST_SOFTWARE_ENCODING_DATAPATH,
+                 MakePcmConfig(48000, ChannelMode::STEREO, 10000),
+                 AUDIO_DEVICE_OUT_BLE_BROADCAST),
+      // sysbta opens mono outputs as stereo and downmixes them, which the
+      // byte pattern does not survive, so HFP output runs on the session only
+      MakeConfig("HfpOut16kMono", SessionType::HFP_SOFTWARE_ENCODING_DATAPATH,
+                 MakePcmConfig(16000, ChannelMode::MONO, 7500),
+                 AUDIO_DEVICE_NONE),
+      MakeConfig("HfpIn16kMono", SessionType::HFP_SOFTWARE_DECODING_DATAPATH,
+                 MakePcmConfig(16000, ChannelMode::MONO, 7500),
+                 AUDIO_DEVICE_IN_BLUETOOTH_SCO_HEADSET),
+      MakeConfig("HfpOut48kMono", SessionType::HFP_SOFTWARE_ENCODING_DATAPATH,
+                 MakePcmConfig(48000, ChannelMode::MONO, 10000),
+                 AUDIO_DEVICE_NONE),
+      MakeConfig("HfpIn48kMono", SessionType::HFP_SOFTWARE_DECODING_DATAPATH,
+                 MakePcmConfig(48000, ChannelMode::MONO, 10000),
+                 AUDIO_DEVICE_IN_BLUETOOTH_SCO_HEADSET),
+  };
+  return configs;
+}
+
+bool IsDatapathAvailable() {
+  return BluetoothAudioSession::IsAidlAvailable();
+}
+
+DatapathReport RunDatapath(const DatapathConfig& config,
+                           const DatapathOptions& options) {
+  DatapathReport report;
+  if (!IsDatapathAvailable()) {
+    LOG(ERROR) << __func__ << ": " << config.name
+               << " needs the sysbta audio provider";
+    return report;
+  }
+
+  auto session =
+      BluetoothAudioSessionInstance::GetSessionInstance(config.session_type);
+  auto data_mq =
+      std::make_unique<DataMQ>(config.data_mq_size, /* EventFlag */ true);
+  if (session == nullptr || !data_mq->isValid()) {
+    LOG(ERROR) << __func__ << ": " << config.name << " has no data path";
+    return report;
+  }
+  DataMQDesc mq_desc = data_mq->dupeDesc();
+  auto port = ndk::SharedRefBase::make<FakeStackPort>(config, data_mq.get(),
+                                                      options.speed);
+  session->OnSessionStarted(port, &mq_desc,
+                            AudioConfiguration(config.pcm_config),
+                            {LatencyMode::FREE});
+  if (!session->IsSessionReady()) {
+    LOG(ERROR) << __func__ << ": " << config.name << " session not ready";
+    return report;
+  }
+
+  // Each location gets its share of the interleaved FMQ, as the provider does
+  std::vector<std::unique_ptr<DataMQ>> location_mqs;
+  if (options.location_queues) {
+    size_t channels = ChannelCount(config.pcm_config.channelMode);
+    std::vector<DataMQDesc> location_descs;
+    std::vector<DataMQ*> location_ptrs;
+    for (size_t i = 0; i < channels; ++i) {
+      location_mqs.push_back(std::make_unique<DataMQ>(
+          config.data_mq_size / channels, /* EventFlag */ true));
+      location_descs.push_back(location_mqs.back()->dupeDesc());
+      location_ptrs.push_back(location_mqs.back().get());
+    }
+    if (!session->OnLocationQueuesStarted(location_descs)) {
+      LOG(ERROR) << __func__ << ": " << config.name
+                 << " has no audio location FMQs";
+      session->OnSessionEnded();
+      return report;
+    }
+    port->SetLocationQueues(std::move(location_ptrs));
+  }
+
+  const uint64_t bytes_per_ms = static_cast<uint64_t>(
+      config.pcm_config.sampleRateHz * config.FrameSize() / 1000);
+  const uint64_t total_bytes = bytes_per_ms * options.duration.count();
+  port->Start(total_bytes);
+
+  std::unique_ptr<AudioSide> audio_side;
+  if (options.mode == DriveMode::kStream)
+    audio_side = std::make_unique<StreamAudioSide>(config);
+  else
+    audio_side = std::make_unique<SessionAudioSide>(config);
+
+  report.ok = audio_side->Open();
+  if (report.ok) {
+    size_t call_bytes = options.call_bytes ? options.call_bytes
+                                           : audio_side->PreferredCallBytes();
+    std::vector<MQDataType> buffer(call_bytes);
+    std::vector<double> latencies_us;
+    latencies_us.reserve(total_bytes / call_bytes + 1);
+
+    port->SetAudioSideRunning(true);
+    auto start = Clock::now();
+    uint64_t transferred = 0;
+    int stalled_calls = 0;
+    while (transferred < total_bytes) {
+      size_t bytes = std::min<uint64_t>(call_bytes, total_bytes - transferred);
+      if (!config.IsInput()) FillPattern(buffer.data(), bytes, transferred);
+
+      auto call_start = Clock::now();
+      ssize_t result = audio_side->Transfer(buffer.data(), bytes);
+      latencies_us.push_back(
+          std::chrono::duration<double, std::micro>(Clock::now() - call_start)
+              .count());
+
+      ++report.calls;
+      size_t moved = result > 0 ? result : 0;
+      if (moved < bytes) ++report.short_calls;
+      if (config.IsInput())
+        report.corrupted_bytes +=
+            CountMismatches(buffer.data(), moved, transferred);
+      transferred += moved;
+      stalled_calls = moved ? 0 : stalled_calls + 1;
+      if (result < 0 || stalled_calls >= kMaxStalledCalls) {
+        LOG(ERROR) << __func__ << ": " << config.name << " stalled at "
+                   << transferred << "/" << total_bytes << " bytes";
+        report.ok = false;
+        break;
+      }
+    }
+    port->SetAudioSideRunning(false);
+
+    auto end = Clock::now();
+    if (!config.IsInput()) {
+      // Output is delivered once the stack has drained it
+      if (port->WaitDone(kDrainTimeout))
+        end = port->done_time();
+      else
+        report.ok = false;
+    }
+    report.bytes = config.IsInput() ? transferred : port->moved();
+    report.seconds = std::chrono::duration<double>(end - start).count();
+
+    std::sort(latencies_us.begin(), latencies_us.end());
+    report.latency_p50_us = Percentile(latencies_us, 50);
+    report.latency_p90_us = Percentile(latencies_us, 90);
+    report.latency_p99_us = Percentile(latencies_us, 99);
+    report.latency_max_us = Percentile(latencies_us, 100);
+  } else {
+    LOG(ERROR) << __func__ << ": " << config.name << " cannot be driven";
+  }
+  audio_side->Close();
+
+  port->Stop();
+  report.stack_wakeups = port->wakeups();
+  report.underruns = port->underruns();
+  report.overruns = port->overruns();
+  report.corrupted_bytes += port->corrupted_bytes();
+  session->OnSessionEnded();
+  return report;
+}
+
+std::ostream& operator<<(std::ostream& os, const DatapathReport& report) {
+  return os << "bytes=" << report.bytes << ", seconds=" << report.seconds
+            << ", bytes_per_second=" << report.BytesPerSecond()
+            << ", stack_wakeups=" << report.stack_wakeups
+            << ", calls=" << report.calls
+            << ", short_calls=" << report.short_calls
+            << ", underruns=" << report.underruns
+            << ", overruns=" << report.overruns
+            << ", corrupted_bytes=" << report.corrupted_bytes
+            << ", latency_us=[p50=" << report.latency_p50_us
+            << ", p90=" << report.latency_p90_us
+            << ", p99=" << report.latency_p99_us
+            << ", max=" << report.latency_max_us << "]";
+}
+
+}  // namespace harness
+}  // namespace audio
+}  // namespace bluetooth
+}  // namespace android
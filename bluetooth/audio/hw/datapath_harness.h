@@ -0,0 +1,123 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <aidl/android/hardware/bluetooth/audio/PcmConfiguration.h>
+#include <aidl/android/hardware/bluetooth/audio/SessionType.h>
+#include <system/audio.h>
+
+#include <chrono>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+namespace android {
+namespace bluetooth {
+namespace audio {
+namespace harness {
+
+using ::aidl::android::hardware::bluetooth::audio::PcmConfiguration;
+using ::aidl::android::hardware::bluetooth::audio::SessionType;
+
+/***
+ * A software data path as the Bluetooth stack would start it: the session
+ * type, the PCM configuration and the FMQ size the provider allocates for it
+ ***/
+struct DatapathConfig {
+  std::string name;
+  SessionType session_type;
+  PcmConfiguration pcm_config;
+  size_t data_mq_size;
+  // The sysbta device routed to this session, AUDIO_DEVICE_NONE if the
+  // session is only reachable through BluetoothAudioSession
+  audio_devices_t device;
+
+  bool IsInput() const;
+  size_t FrameSize() const;
+  // Bytes the stack moves per data interval
+  size_t BytesPerInterval() const;
+};
+
+// A2DP, LE Audio and HFP software data paths, sized like the providers
+const std::vector<DatapathConfig>& GetDatapathConfigs();
+
+enum class DriveMode {
+  // BluetoothAudioSession::OutWritePcmData / InReadPcmData
+  kSession,
+  // sysbta out_write / in_read through an opened audio stream
+  kStream,
+};
+
+struct DatapathOptions {
+  DriveMode mode = DriveMode::kSession;
+  // Pace of the fake stack relative to real time, 0 runs it free
+  double speed = 1.0;
+  // Amount of audio pushed through the data path
+  std::chrono::milliseconds duration = std::chrono::milliseconds(500);
+  // Bytes per write / read call, 0 uses one data interval in kSession mode
+  // and the stream buffer size in kStream mode
+  size_t call_bytes = 0;
+  // Moves a multichannel output session onto one FMQ per audio location,
+  // which the fake stack reads and interleaves back
+  bool location_queues = false;
+};
+
+struct DatapathReport {
+  // Payload delivered end to end and the wall time it took
+  uint64_t bytes = 0;
+  double seconds = 0;
+  // Times the fake stack woke up to drain or fill the FMQ
+  uint64_t stack_wakeups = 0;
+  // Write / read calls made by the audio side, and those moving less than
+  // they were asked to
+  uint64_t calls = 0;
+  uint64_t short_calls = 0;
+  // Stack wakeups that found less than one data interval to read (output)
+  // or to write into (input) while the audio side was still running
+  uint64_t underruns = 0;
+  uint64_t overruns = 0;
+  // Bytes that did not arrive in the order they were sent
+  uint64_t corrupted_bytes = 0;
+  // Per-call latency percentiles of the audio side
+  double latency_p50_us = 0;
+  double latency_p90_us = 0;
+  double latency_p99_us = 0;
+  double latency_max_us = 0;
+  // False if the session or the stream could not be brought up
+  bool ok = false;
+
+  double BytesPerSecond() const { return seconds > 0 ? bytes / seconds : 0; }
+};
+
+// False where the sysbta audio provider is not registered: the audio side
+// would then take the HIDL path, which the fake stack does not serve
+bool IsDatapathAvailable();
+
+/***
+ * Starts the session of the given config against a fake IBluetoothAudioPort
+ * which drains (or fills) the FMQ once per data interval, pushes
+ * options.duration of audio through it and ends the session again
+ ***/
+DatapathReport RunDatapath(const DatapathConfig& config,
+                           const DatapathOptions& options);
+
+std::ostream& operator<<(std::ostream& os, const DatapathReport& report);
+
+}  // namespace harness
+}  // namespace audio
+}  // namespace bluetooth
+}  // namespace android
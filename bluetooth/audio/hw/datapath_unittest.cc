@@ -0,0 +1,98 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include "datapath_harness.h"
+
+namespace {
+
+using ::aidl::android::hardware::bluetooth::audio::ChannelMode;
+using ::aidl::android::hardware::bluetooth::audio::SessionType;
+using ::android::bluetooth::audio::harness::DatapathConfig;
+using ::android::bluetooth::audio::harness::DatapathOptions;
+using ::android::bluetooth::audio::harness::DatapathReport;
+using ::android::bluetooth::audio::harness::DriveMode;
+using ::android::bluetooth::audio::harness::GetDatapathConfigs;
+using ::android::bluetooth::audio::harness::IsDatapathAvailable;
+using ::android::bluetooth::audio::harness::RunDatapath;
+
+class DatapathTest : public testing::TestWithParam<DatapathConfig> {
+ protected:
+  void SetUp() override {
+    if (!IsDatapathAvailable())
+      GTEST_SKIP() << "the sysbta audio provider is not running";
+  }
+
+  DatapathReport Run(DriveMode mode, bool location_queues = false) {
+    DatapathOptions options;
+    options.mode = mode;
+    options.location_queues = location_queues;
+    // Free running stack, so the data path is checked as fast as it goes
+    options.speed = 0;
+    options.duration = std::chrono::milliseconds(200);
+    return RunDatapath(GetParam(), options);
+  }
+
+  uint64_t ExpectedBytes() const {
+    const auto& pcm_config = GetParam().pcm_config;
+    return static_cast<uint64_t>(pcm_config.sampleRateHz) *
+           GetParam().FrameSize() / 1000 * 200;
+  }
+};
+
+TEST_P(DatapathTest, SessionDeliversEveryByteInOrder) {
+  DatapathReport report = Run(DriveMode::kSession);
+  ASSERT_TRUE(report.ok) << report;
+  EXPECT_EQ(report.bytes, ExpectedBytes()) << report;
+  EXPECT_EQ(report.corrupted_bytes, 0u) << report;
+  EXPECT_GT(report.stack_wakeups, 0u) << report;
+}
+
+TEST_P(DatapathTest, StreamDeliversEveryByteInOrder) {
+  if (GetParam().device == AUDIO_DEVICE_NONE) {
+    GTEST_SKIP() << GetParam().name << " has no sysbta stream";
+  }
+  DatapathReport report = Run(DriveMode::kStream);
+  ASSERT_TRUE(report.ok) << report;
+  EXPECT_EQ(report.bytes, ExpectedBytes()) << report;
+  EXPECT_EQ(report.corrupted_bytes, 0u) << report;
+}
+
+TEST_P(DatapathTest, LocationQueuesDeliverEveryByteInOrder) {
+  if (GetParam().session_type !=
+          SessionType::LE_AUDIO_SOFTWARE_ENCODING_DATAPATH ||
+      GetParam().pcm_config.channelMode != ChannelMode::STEREO) {
+    GTEST_SKIP() << GetParam().name << " has no audio locations to split";
+  }
+  DatapathReport report = Run(DriveMode::kSession, /* location_queues */ true);
+  ASSERT_TRUE(report.ok) << report;
+  EXPECT_EQ(report.bytes, ExpectedBytes()) << report;
+  EXPECT_EQ(report.corrupted_bytes, 0u) << report;
+
+  report = Run(DriveMode::kStream, /* location_queues */ true);
+  ASSERT_TRUE(report.ok) << report;
+  EXPECT_EQ(report.bytes, ExpectedBytes()) << report;
+  EXPECT_EQ(report.corrupted_bytes, 0u) << report;
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    Configs, DatapathTest, testing::ValuesIn(GetDatapathConfigs()),
+    [](const testing::TestParamInfo<DatapathConfig>& info) {
+      return info.param.name;
+    });
+
+}  // namespace
@@ -162,10 +162,23 @@ bool BluetoothAudioPortAidl::SetUp(audio_devices_t devices) {
     }
     port->SessionChangedHandler();
   };
-  // TODO: Add audio_config_changed_cb
+  auto audio_config_changed_cb = [port = this](uint16_t cookie) {
+    if (!port->in_use()) {
+      LOG(ERROR)
+          << "audio_config_changed_cb: BluetoothAudioPortAidl is not in use";
+      return;
+    }
+    if (port->cookie_ != cookie) {
+      LOG(ERROR) << "audio_config_changed_cb: proxy of device port (cookie="
+                 << StringPrintf("%#hx", cookie) << ") is corrupted";
+      return;
+    }
+    port->AudioConfigChangedHandler();
+  };
   PortStatusCallbacks cbacks = {
       .control_result_cb_ = control_result_cb,
       .session_changed_cb_ = session_changed_cb,
+      .audio_configuration_changed_cb_ = audio_config_changed_cb,
   };
   cookie_ = BluetoothAudioSessionControl::RegisterControlResultCback(
       session_type_, cbacks);
@@ -219,6 +232,21 @@ bool BluetoothAudioPortAidl::init_session_type(audio_devices_t device) {
       session_type_ =
           SessionType::LE_AUDIO_BROADCAST_SOFTWARE_ENCODING_DATAPATH;
       break;
+    case AUDIO_DEVICE_OUT_BLUETOOTH_SCO:
+    case AUDIO_DEVICE_OUT_BLUETOOTH_SCO_HEADSET:
+    case AUDIO_DEVICE_OUT_BLUETOOTH_SCO_CARKIT:
+      LOG(VERBOSE)
+          << __func__
+          << ": device=AUDIO_DEVICE_OUT_BLUETOOTH_SCO (HEADSET/CARKIT) ("
+          << StringPrintf("%#x", device) << ")";
+      session_type_ = SessionType::HFP_SOFTWARE_ENCODING_DATAPATH;
+      break;
+    case AUDIO_DEVICE_IN_BLUETOOTH_SCO_HEADSET:
+      LOG(VERBOSE) << __func__
+                   << ": device=AUDIO_DEVICE_IN_BLUETOOTH_SCO_HEADSET (VOICE) ("
+                   << StringPrintf("%#x", device) << ")";
+      session_type_ = SessionType::HFP_SOFTWARE_DECODING_DATAPATH;
+      break;
     default:
       LOG(ERROR) << __func__
                  << ": unknown device=" << StringPrintf("%#x", device);
@@ -318,16 +346,46 @@ void BluetoothAudioPortAidl::SessionChangedHandler() {
     LOG(ERROR) << __func__ << ": BluetoothAudioPortAidl is not in use";
     return;
   }
+  // Invoked by both OnSessionStarted and OnSessionEnded, under the session's
+  // recursive mutex
+  bool session_ready =
+      BluetoothAudioSessionControl::IsSessionReady(session_type_);
   std::unique_lock<std::mutex> port_lock(cv_mutex_);
   BluetoothStreamState previous_state = state_;
   LOG(INFO) << "session_changed_cb: session_type=" << toString(session_type_)
             << ", cookie=" << StringPrintf("%#hx", cookie_)
-            << ", previous_state=" << previous_state;
-  state_ = BluetoothStreamState::DISABLED;
+            << ", previous_state=" << previous_state
+            << ", session_ready=" << (session_ready ? "true" : "false");
+  config_generation_++;
+  if (!session_ready) {
+    // Unless A2dpSuspended=true / closing=true had disabled it already
+    session_lost_ |= previous_state != BluetoothStreamState::DISABLED;
+    state_ = BluetoothStreamState::DISABLED;
+  } else if (previous_state != BluetoothStreamState::DISABLED ||
+             session_lost_) {
+    // The stack restarted the session, e.g. to switch codecs. The port keeps
+    // its registration and the next write starts the new session.
+    session_lost_ = false;
+    state_ = BluetoothStreamState::STANDBY;
+  }
   port_lock.unlock();
   internal_cv_.notify_all();
 }
 
+void BluetoothAudioPortAidl::AudioConfigChangedHandler() {
+  if (!in_use()) {
+    LOG(ERROR) << __func__ << ": BluetoothAudioPortAidl is not in use";
+    return;
+  }
+  LOG(INFO) << "audio_config_changed_cb: session_type="
+            << toString(session_type_)
+            << ", cookie=" << StringPrintf("%#hx", cookie_)
+            << ", state=" << state_;
+  // The data path stays, the stream converts into the new configuration at
+  // its next buffer boundary
+  config_generation_++;
+}
+
 bool BluetoothAudioPortAidl::in_use() const {
   return (
       cookie_ !=
@@ -537,6 +595,7 @@ void BluetoothAudioPortAidl::Stop() {
             << ", cookie=" << StringPrintf("%#hx", cookie_)
             << ", state=" << state_ << " request";
   state_ = BluetoothStreamState::DISABLED;
+  session_lost_ = false;
   BluetoothAudioSessionControl::StopStream(session_type_);
   LOG(INFO) << __func__ << ": session_type=" << toString(session_type_)
             << ", cookie=" << StringPrintf("%#hx", cookie_)
@@ -551,16 +610,14 @@ size_t BluetoothAudioPortAidlOut::WriteData(const void* buffer,
                                                          bytes);
   }
 
-  // WAR to mix the stereo into Mono (16 bits per sample)
-  const size_t write_frames = bytes >> 2;
-  if (write_frames == 0) return 0;
-  auto src = static_cast<const int16_t*>(buffer);
-  std::unique_ptr<int16_t[]> dst{new int16_t[write_frames]};
-  downmix_to_mono_i16_from_stereo_i16(dst.get(), src, write_frames);
-  // a frame is 16 bits, and the size of a mono frame is equal to half a stereo.
-  return BluetoothAudioSessionControl::OutWritePcmData(session_type_, dst.get(),
-                                                       write_frames * 2) *
-         2;
+  // WAR to mix the stereo into Mono (16 bits per sample), straight into FMQ
+  return BluetoothAudioSessionControl::OutWritePcmData(
+      session_type_, buffer, bytes, 2 * sizeof(int16_t), sizeof(int16_t),
+      [](void* dst, const void* src, size_t frames) {
+        downmix_to_mono_i16_from_stereo_i16(static_cast<int16_t*>(dst),
+                                            static_cast<const int16_t*>(src),
+                                            frames);
+      });
 }
 
 size_t BluetoothAudioPortAidlIn::ReadData(void* buffer, size_t bytes) const {
@@ -580,6 +637,10 @@ bool BluetoothAudioPortAidl::GetPresentationPosition(
       session_type_, presentation_position);
   *delay_ns = presentation_position.remoteDeviceAudioDelayNanos;
   *bytes = presentation_position.transmittedOctets;
+  if (is_stereo_to_mono_) {
+    // Counted at the FMQ, which carries half of the stream's bytes
+    *bytes *= 2;
+  }
   *timestamp = {.tv_sec = static_cast<__kernel_old_time_t>(
                     presentation_position.transmittedOctetsTimestamp.tvSec),
                 .tv_nsec = static_cast<long>(
@@ -652,6 +713,7 @@ BluetoothStreamState BluetoothAudioPortAidl::GetState() const { return state_; }
 
 void BluetoothAudioPortAidl::SetState(BluetoothStreamState state) {
   state_ = state;
+  session_lost_ = false;
 }
 
 }  // namespace aidl
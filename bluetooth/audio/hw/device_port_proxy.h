@@ -22,6 +22,7 @@
 #include <aidl/android/hardware/bluetooth/audio/SessionType.h>
 #include <hardware/audio.h>
 
+#include <atomic>
 #include <condition_variable>
 #include <mutex>
 #include <unordered_map>
@@ -115,6 +116,13 @@ class BluetoothAudioPort {
     return false;
   };
 
+  /***
+   * Bumped whenever the Bluetooth stack restarts the session or changes its
+   * audio configuration, so the stream can follow at its next buffer boundary
+   * instead of being closed and reopened
+   ***/
+  virtual uint32_t GetConfigGeneration() const { return 0; }
+
   virtual size_t WriteData(const void* buffer, size_t bytes) const {
     return 0;
   };
@@ -178,17 +186,24 @@ class BluetoothAudioPortAidl : public BluetoothAudioPort {
 
   bool GetPreferredDataIntervalUs(size_t* interval_us) const override;
 
+  uint32_t GetConfigGeneration() const override { return config_generation_; }
+
  protected:
   uint16_t cookie_;
   BluetoothStreamState state_;
   SessionType session_type_;
-  // WR to support Mono: True if fetching Stereo and mixing into Mono
-  bool is_stereo_to_mono_ = false;
+  // WR to support Mono: True if fetching Stereo and mixing into Mono. Set by
+  // the writing thread, read by presentation position queries as well
+  std::atomic<bool> is_stereo_to_mono_{false};
   virtual bool in_use() const;
 
  private:
   mutable std::mutex cv_mutex_;
   std::condition_variable internal_cv_;
+  std::atomic<uint32_t> config_generation_ = 0;
+  // The session ended under a live stream, which a restarted session resumes
+  // rather than leaving it DISABLED until AudioPolicy reopens it
+  bool session_lost_ = false;
 
   // Check and initialize session type for |devices| If failed, this
   // BluetoothAudioPortAidl is not initialized and must be deleted.
@@ -198,6 +213,7 @@ class BluetoothAudioPortAidl : public BluetoothAudioPort {
 
   void ControlResultHandler(const BluetoothAudioStatus& status);
   void SessionChangedHandler();
+  void AudioConfigChangedHandler();
 };
 
 class BluetoothAudioPortAidlOut : public BluetoothAudioPortAidl {
@@ -19,6 +19,7 @@
 #include <android/hardware/bluetooth/audio/2.1/types.h>
 #include <hardware/audio.h>
 
+#include <atomic>
 #include <condition_variable>
 #include <mutex>
 #include <unordered_map>
@@ -85,8 +86,9 @@ class BluetoothAudioPortHidl : public BluetoothAudioPort {
   SessionType_2_1 session_type_hidl_;
   uint16_t cookie_;
   BluetoothStreamState state_;
-  // WR to support Mono: True if fetching Stereo and mixing into Mono
-  bool is_stereo_to_mono_ = false;
+  // WR to support Mono: True if fetching Stereo and mixing into Mono. Set by
+  // the writing thread, read by presentation position queries as well
+  std::atomic<bool> is_stereo_to_mono_{false};
 
   bool in_use() const;
 
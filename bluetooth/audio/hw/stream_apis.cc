@@ -39,7 +39,6 @@ using ::android::bluetooth::audio::utils::ParseAudioParams;
 
 namespace {
 
-constexpr unsigned int kMinimumDelayMs = 50;
 constexpr unsigned int kMaximumDelayMs = 1000;
 constexpr int kExtraAudioSyncMs = 200;
 
@@ -49,6 +48,69 @@ std::ostream& operator<<(std::ostream& os, const audio_config& config) {
             << ", format=" << config.format << "]";
 }
 
+audio_config_t StableMixPortConfig() {
+  audio_config_t config = AUDIO_CONFIG_INITIALIZER;
+  config.sample_rate = kBluetoothStableMixPortSampleRate;
+  config.channel_mask = kBluetoothStableMixPortChannelMask;
+  config.format = kBluetoothStableMixPortFormat;
+  return config;
+}
+
+bool SameConfig(const audio_config_t& a, const audio_config_t& b) {
+  return a.sample_rate == b.sample_rate && a.channel_mask == b.channel_mask &&
+         a.format == b.format;
+}
+
+// Follows the session format without reopening the stream: the stream keeps
+// the format it was opened with and a converter bridges into the session's
+// if they differ. Must only happen between two buffers, and leaves the
+// converter stale if the session format cannot be followed. Locked by
+// out->mutex_
+void out_update_converter(BluetoothStreamOut* out) {
+  out->config_generation_ = out->bluetooth_output_->GetConfigGeneration();
+  // Whatever the FMQ did not take belongs to the old session
+  out->converted_tail_.clear();
+  // The mono WAR is decided again from the session's own channels
+  out->bluetooth_output_->ForcePcmStereoToMono(false);
+  audio_config_t session_cfg;
+  if (!out->bluetooth_output_->LoadAudioConfig(&session_cfg)) {
+    return;
+  }
+  audio_config_t stream_cfg = AUDIO_CONFIG_INITIALIZER;
+  stream_cfg.sample_rate = out->sample_rate_;
+  stream_cfg.channel_mask = out->channel_mask_;
+  stream_cfg.format = out->format_;
+
+  if (out->converter_ != nullptr &&
+      SameConfig(session_cfg, out->converter_->dst_config())) {
+    out->converter_->Reset();
+    out->converter_stale_ = false;
+    return;
+  }
+  if (SameConfig(session_cfg, stream_cfg)) {
+    out->converter_ = nullptr;
+  } else if (session_cfg.sample_rate == stream_cfg.sample_rate &&
+             session_cfg.channel_mask == AUDIO_CHANNEL_OUT_MONO &&
+             stream_cfg.channel_mask == AUDIO_CHANNEL_OUT_STEREO &&
+             session_cfg.format == AUDIO_FORMAT_PCM_16_BIT &&
+             stream_cfg.format == AUDIO_FORMAT_PCM_16_BIT) {
+    out->bluetooth_output_->ForcePcmStereoToMono(true);
+    out->converter_ = nullptr;
+  } else {
+    auto converter = ::android::bluetooth::audio::StreamConverter::Create(
+        stream_cfg, session_cfg);
+    if (converter == nullptr) {
+      LOG(ERROR) << __func__ << ": state=" << out->bluetooth_output_->GetState()
+                 << " cannot convert " << stream_cfg << " into " << session_cfg;
+      return;
+    }
+    out->converter_ = std::move(converter);
+  }
+  LOG(INFO) << __func__ << ": state=" << out->bluetooth_output_->GetState()
+            << " stream " << stream_cfg << " follows session " << session_cfg;
+  out->converter_stale_ = false;
+}
+
 void out_calculate_feeding_delay_ms(const BluetoothStreamOut* out,
                                     uint32_t* latency_ms,
                                     uint64_t* frames = nullptr,
@@ -72,11 +134,11 @@ void out_calculate_feeding_delay_ms(const BluetoothStreamOut* out,
   if (out->bluetooth_output_->GetPresentationPosition(
           &delay_report_ns, &absorbed_bytes, &absorbed_timestamp)) {
     delay_report_ms = delay_report_ns / 1000000;
-    // assume kMinimumDelayMs (50ms) < delay_report_ns < kMaximumDelayMs
-    // (1000ms), or it is invalid / ignored and use old delay calculated
-    // by ourselves.
-    if (delay_report_ms > kMinimumDelayMs &&
-        delay_report_ms < kMaximumDelayMs) {
+    // The position is measured at the FMQ and the delay comes from the
+    // remote, so take anything below kMaximumDelayMs (1000ms). A zero delay
+    // means the stack has none (yet) and old delay calculated by ourselves
+    // is used.
+    if (delay_report_ns > 0 && delay_report_ms < kMaximumDelayMs) {
       timestamp_fetched = true;
     } else if (delay_report_ms >= kMaximumDelayMs) {
       LOG(INFO) << __func__ << ": state=" << out->bluetooth_output_->GetState()
@@ -107,7 +169,10 @@ void out_calculate_feeding_delay_ms(const BluetoothStreamOut* out,
   }
   if (frames != nullptr) {
     const uint64_t latency_frames = delay_report_ms * out->sample_rate_ / 1000;
-    *frames = absorbed_bytes / audio_stream_out_frame_size(&out->stream_out_);
+    *frames =
+        out->converter_ != nullptr
+            ? out->converter_->DstBytesToSrcFrames(absorbed_bytes)
+            : absorbed_bytes / audio_stream_out_frame_size(&out->stream_out_);
     if (out->frames_presented_ < *frames) {
       // Are we (the audio HAL) reset?! The stack counter is obsoleted.
       *frames = out->frames_presented_;
@@ -200,6 +265,7 @@ std::ostream& operator<<(std::ostream& os, const BluetoothStreamState& state) {
 
 static uint32_t out_get_sample_rate(const struct audio_stream* stream) {
   const auto* out = reinterpret_cast<const BluetoothStreamOut*>(stream);
+  if (out->converter_ != nullptr) return out->sample_rate_;
   audio_config_t audio_cfg;
   if (out->bluetooth_output_->LoadAudioConfig(&audio_cfg)) {
     LOG(VERBOSE) << __func__ << ": state=" << out->bluetooth_output_->GetState()
@@ -231,6 +297,7 @@ static size_t out_get_buffer_size(const struct audio_stream* stream) {
 static audio_channel_mask_t out_get_channels(
     const struct audio_stream* stream) {
   const auto* out = reinterpret_cast<const BluetoothStreamOut*>(stream);
+  if (out->converter_ != nullptr) return out->channel_mask_;
   audio_config_t audio_cfg;
   if (out->bluetooth_output_->LoadAudioConfig(&audio_cfg)) {
     LOG(VERBOSE) << __func__ << ": state=" << out->bluetooth_output_->GetState()
@@ -246,6 +313,7 @@ static audio_channel_mask_t out_get_channels(
 
 static audio_format_t out_get_format(const struct audio_stream* stream) {
   const auto* out = reinterpret_cast<const BluetoothStreamOut*>(stream);
+  if (out->converter_ != nullptr) return out->format_;
   audio_config_t audio_cfg;
   if (out->bluetooth_output_->LoadAudioConfig(&audio_cfg)) {
     LOG(VERBOSE) << __func__ << ": state=" << out->bluetooth_output_->GetState()
@@ -320,7 +388,10 @@ static int out_set_parameters(struct audio_stream* stream,
   if (params.find(AUDIO_PARAMETER_STREAM_SUP_SAMPLING_RATES) != params.end() ||
       params.find(AUDIO_PARAMETER_STREAM_SUP_CHANNELS) != params.end() ||
       params.find(AUDIO_PARAMETER_STREAM_SUP_FORMATS) != params.end()) {
-    if (out->bluetooth_output_->LoadAudioConfig(&audio_cfg)) {
+    if (out->converter_ != nullptr) {
+      // The stream keeps its format, the next write picks up the session's
+      out->converter_stale_ = true;
+    } else if (out->bluetooth_output_->LoadAudioConfig(&audio_cfg)) {
       out->sample_rate_ = audio_cfg.sample_rate;
       out->channel_mask_ = audio_cfg.channel_mask;
       out->format_ = audio_cfg.format;
@@ -433,7 +504,9 @@ static char* out_get_parameters(const struct audio_stream* stream,
   if (params.empty()) return strdup("");
 
   audio_config_t audio_cfg;
-  if (out->bluetooth_output_->LoadAudioConfig(&audio_cfg)) {
+  if (out->converter_ != nullptr) {
+    audio_cfg = out->converter_->src_config();
+  } else if (out->bluetooth_output_->LoadAudioConfig(&audio_cfg)) {
     LOG(VERBOSE) << __func__ << ": state=" << out->bluetooth_output_->GetState()
                  << " audio_cfg=" << audio_cfg;
   } else {
@@ -496,6 +569,9 @@ static char* out_get_parameters(const struct audio_stream* stream,
     if (audio_cfg.format == AUDIO_FORMAT_PCM_32_BIT) {
       param = "AUDIO_FORMAT_PCM_32_BIT";
     }
+    if (audio_cfg.format == AUDIO_FORMAT_PCM_FLOAT) {
+      param = "AUDIO_FORMAT_PCM_FLOAT";
+    }
     return_params[AUDIO_PARAMETER_STREAM_SUP_FORMATS] = param;
   }
 
@@ -535,6 +611,8 @@ static ssize_t out_write(struct audio_stream_out* stream, const void* buffer,
   if (out->bluetooth_output_->GetState() != BluetoothStreamState::STARTED) {
     LOG(INFO) << __func__ << ": state=" << out->bluetooth_output_->GetState()
               << " first time bytes=" << bytes;
+    // The session may have been reconfigured while the stream was suspended
+    out->converter_stale_ = true;
     lock.unlock();
     if (stream->resume(stream)) {
       LOG(ERROR) << __func__ << ": state=" << out->bluetooth_output_->GetState()
@@ -549,9 +627,52 @@ static ssize_t out_write(struct audio_stream_out* stream, const void* buffer,
     }
     lock.lock();
   }
-  lock.unlock();
-  totalWritten = out->bluetooth_output_->WriteData(buffer, bytes);
-  lock.lock();
+  if (out->config_generation_ !=
+      out->bluetooth_output_->GetConfigGeneration()) {
+    // The stack switched the session's configuration under the stream
+    out->converter_stale_ = true;
+  }
+  if (out->converter_stale_) {
+    out_update_converter(out);
+    if (out->converter_stale_) {
+      // Rather than noise in a format the session does not expect: back to
+      // standby, so that the next write starts the session and follows its
+      // config again
+      LOG(ERROR) << __func__ << ": state=" << out->bluetooth_output_->GetState()
+                 << " cannot follow the session config, going standby";
+      lock.unlock();
+      stream->common.standby(&stream->common);
+      return -EIO;
+    }
+  }
+  if (out->converter_ != nullptr) {
+    // Only this thread converts and writes, so the PCM and the tail stay
+    // valid without the lock. The buffer is converted once the tail is gone
+    // and then consumed in full, the FMQ taking the rest of it next time
+    std::vector<uint8_t>& tail = out->converted_tail_;
+    if (!tail.empty()) {
+      lock.unlock();
+      size_t written =
+          out->bluetooth_output_->WriteData(tail.data(), tail.size());
+      lock.lock();
+      tail.erase(tail.begin(), tail.begin() + written);
+    }
+    if (tail.empty()) {
+      const std::vector<uint8_t>& pcm = out->converter_->Convert(buffer, bytes);
+      lock.unlock();
+      size_t written =
+          pcm.empty()
+              ? 0
+              : out->bluetooth_output_->WriteData(pcm.data(), pcm.size());
+      lock.lock();
+      tail.assign(pcm.begin() + written, pcm.end());
+      totalWritten = bytes;
+    }
+  } else {
+    lock.unlock();
+    totalWritten = out->bluetooth_output_->WriteData(buffer, bytes);
+    lock.lock();
+  }
 
   struct timespec ts = {.tv_sec = 0, .tv_nsec = 0};
   clock_gettime(CLOCK_MONOTONIC, &ts);
@@ -785,9 +906,23 @@ int adev_open_output_stream(struct audio_hw_device* dev,
     LOG(ERROR) << __func__ << ": state=" << out->bluetooth_output_->GetState()
                << " failed to get audio config";
   }
-  // WAR to support Mono / 16 bits per sample as the Bluetooth stack required
-  if (config->channel_mask == AUDIO_CHANNEL_OUT_MONO &&
-      config->format == AUDIO_FORMAT_PCM_16_BIT) {
+  // Hearing aid and SCO outputs keep the fixed profiles their mix ports
+  // declare in the audio policy configuration
+  if ((out->bluetooth_output_->IsA2dp() ||
+       out->bluetooth_output_->IsLeAudio()) &&
+      property_get_bool("persist.bluetooth.sysbta.stable_mix_port", false)) {
+    out->converter_ = ::android::bluetooth::audio::StreamConverter::Create(
+        StableMixPortConfig(), *config);
+  }
+  if (out->converter_ != nullptr) {
+    LOG(INFO) << __func__ << ": state=" << out->bluetooth_output_->GetState()
+              << " converts from the stable mix port into " << *config;
+    config->sample_rate = kBluetoothStableMixPortSampleRate;
+    config->channel_mask = kBluetoothStableMixPortChannelMask;
+    config->format = kBluetoothStableMixPortFormat;
+  } else if (config->channel_mask == AUDIO_CHANNEL_OUT_MONO &&
+             config->format == AUDIO_FORMAT_PCM_16_BIT) {
+    // WAR to support Mono / 16 bits per sample as the Bluetooth stack required
     LOG(INFO) << __func__
               << ": force channels=" << StringPrintf("%#x", out->channel_mask_)
               << " to be AUDIO_CHANNEL_OUT_STEREO";
@@ -825,6 +960,7 @@ int adev_open_output_stream(struct audio_hw_device* dev,
 
   out->frames_rendered_ = 0;
   out->frames_presented_ = 0;
+  out->config_generation_ = out->bluetooth_output_->GetConfigGeneration();
 
   BluetoothStreamOut* out_ptr = out.release();
   {
@@ -1125,7 +1261,25 @@ static ssize_t in_read(struct audio_stream_in* stream, void* buffer,
 
   struct timespec ts = {.tv_sec = 0, .tv_nsec = 0};
   clock_gettime(CLOCK_MONOTONIC, &ts);
-  in->last_read_time_us_ = (ts.tv_sec * 1000000000LL + ts.tv_nsec) / 1000;
+  const int64_t now = (ts.tv_sec * 1000000000LL + ts.tv_nsec) / 1000;
+  if (!totalRead) {
+    // Nothing from the stack (yet), so keep the capture thread to the pace
+    // of the data interval instead of spinning on the FMQ
+    int64_t sleep_time = static_cast<int64_t>(in->preferred_data_interval_us) -
+                         (now - in->last_read_time_us_);
+    if (sleep_time > 0) {
+      LOG(VERBOSE) << __func__ << ": sleep " << (sleep_time / 1000)
+                   << " ms when reading FMQ datapath";
+      lock.unlock();
+      usleep(sleep_time);
+      lock.lock();
+    } else {
+      sleep_time = 0;
+    }
+    in->last_read_time_us_ = now + sleep_time;
+    return totalRead;
+  }
+  in->last_read_time_us_ = now;
 
   const size_t frames = totalRead / audio_stream_in_frame_size(stream);
   in->frames_presented_ += frames;
@@ -20,9 +20,11 @@
 #include <system/audio.h>
 
 #include <list>
+#include <vector>
 
 #include "device_port_proxy.h"
 #include "device_port_proxy_hidl.h"
+#include "stream_converter.h"
 
 constexpr unsigned int kBluetoothDefaultSampleRate = 44100;
 constexpr audio_format_t kBluetoothDefaultAudioFormatBitsPerSample =
@@ -36,6 +38,14 @@ constexpr unsigned int kBluetoothSpatializerOutputBufferMs = 10;
 
 constexpr audio_channel_mask_t kBluetoothDefaultOutputChannelModeMask =
     AUDIO_CHANNEL_OUT_STEREO;
+
+// With persist.bluetooth.sysbta.stable_mix_port set, A2DP and LE Audio outputs
+// keep this format whatever the session negotiated and convert into it on
+// their own
+constexpr unsigned int kBluetoothStableMixPortSampleRate = 48000;
+constexpr audio_format_t kBluetoothStableMixPortFormat = AUDIO_FORMAT_PCM_FLOAT;
+constexpr audio_channel_mask_t kBluetoothStableMixPortChannelMask =
+    AUDIO_CHANNEL_OUT_STEREO;
 constexpr audio_channel_mask_t kBluetoothDefaultInputChannelModeMask =
     AUDIO_CHANNEL_IN_MONO;
 
@@ -70,6 +80,16 @@ struct BluetoothStreamOut {
   uint64_t frames_rendered_;
   // total frames written after opened, never reset
   uint64_t frames_presented_;
+  // Converts the stream format, e.g. the stable mix port, into the session
+  // format, null if the stream runs in the session format itself
+  std::unique_ptr<::android::bluetooth::audio::StreamConverter> converter_;
+  // Converted PCM the FMQ did not take yet, written ahead of the next buffer
+  std::vector<uint8_t> converted_tail_;
+  // The session format may have changed, so the converter is rebuilt at the
+  // next buffer boundary
+  bool converter_stale_ = false;
+  // GetConfigGeneration() of the port the converter was last built for
+  uint32_t config_generation_ = 0;
   mutable std::mutex mutex_;
 };
 
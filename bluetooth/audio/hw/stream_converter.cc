@@ -0,0 +1,314 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "BTAudioHalConverter"
+
+#include "stream_converter.h"
+
+#include <android-base/logging.h>
+#include <audio_utils/primitives.h>
+
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
+namespace android {
+namespace bluetooth {
+namespace audio {
+
+namespace {
+
+// Filter taps on either side of the interpolated point
+constexpr size_t kHalfTaps = 16;
+constexpr size_t kTaps = 2 * kHalfTaps;
+constexpr uint32_t kMaxPhases = 512;
+// ~80 dB of stopband attenuation
+constexpr double kKaiserBeta = 8.0;
+// Passband edge, relative to the lower of both Nyquist frequencies
+constexpr double kRolloff = 0.91;
+
+// Four lanes map onto NEON on ARM and SSE on x86
+typedef float float4 __attribute__((vector_size(16)));
+static_assert(kTaps % 4 == 0, "kTaps must fill whole vectors");
+
+float DotProduct(const float* a, const float* b) {
+  float4 acc = {0, 0, 0, 0};
+  for (size_t i = 0; i < kTaps; i += 4) {
+    float4 x, y;
+    memcpy(&x, a + i, sizeof(x));
+    memcpy(&y, b + i, sizeof(y));
+    acc += x * y;
+  }
+  return acc[0] + acc[1] + acc[2] + acc[3];
+}
+
+// Zeroth order modified Bessel function of the first kind
+double BesselI0(double x) {
+  double sum = 1, term = 1;
+  for (int k = 1; k < 32; k++) {
+    term *= (x / (2 * k)) * (x / (2 * k));
+    sum += term;
+  }
+  return sum;
+}
+
+size_t ChannelCount(audio_channel_mask_t mask) {
+  switch (mask) {
+    case AUDIO_CHANNEL_OUT_MONO:
+      return 1;
+    case AUDIO_CHANNEL_OUT_STEREO:
+      return 2;
+    default:
+      return 0;
+  }
+}
+
+bool IsSupportedFormat(audio_format_t format) {
+  switch (format) {
+    case AUDIO_FORMAT_PCM_16_BIT:
+    case AUDIO_FORMAT_PCM_24_BIT_PACKED:
+    case AUDIO_FORMAT_PCM_8_24_BIT:
+    case AUDIO_FORMAT_PCM_32_BIT:
+    case AUDIO_FORMAT_PCM_FLOAT:
+      return true;
+    default:
+      return false;
+  }
+}
+
+}  // namespace
+
+/***
+ * Windowed-sinc interpolation at up_ phases between two input frames,
+ * stepping down_ phases per output frame. The history is kept planar so each
+ * output sample is one contiguous dot product.
+ ***/
+class PolyphaseResampler {
+ public:
+  PolyphaseResampler(uint32_t in_rate, uint32_t out_rate, size_t channels)
+      : channels_(channels), history_(channels) {
+    uint32_t gcd = std::gcd(in_rate, out_rate);
+    up_ = out_rate / gcd;
+    down_ = in_rate / gcd;
+
+    const double cutoff =
+        kRolloff * std::min(1.0, static_cast<double>(out_rate) / in_rate);
+    const double i0_beta = BesselI0(kKaiserBeta);
+    coefs_.resize(up_ * kTaps);
+    for (uint32_t phase = 0; phase < up_; phase++) {
+      float* coefs = &coefs_[phase * kTaps];
+      double sum = 0;
+      for (size_t k = 0; k < kTaps; k++) {
+        // Distance of tap k to the interpolated point, in input frames
+        double d = kHalfTaps - 1 + static_cast<double>(phase) / up_ - k;
+        double x = d / kHalfTaps;
+        double window =
+            std::abs(x) < 1 ? BesselI0(kKaiserBeta * std::sqrt(1 - x * x)) /
+                                  i0_beta
+                            : 0;
+        double sinc =
+            d == 0 ? 1 : std::sin(M_PI * cutoff * d) / (M_PI * cutoff * d);
+        coefs[k] = cutoff * sinc * window;
+        sum += coefs[k];
+      }
+      // Unity gain at DC for every phase
+      for (size_t k = 0; k < kTaps; k++) coefs[k] /= sum;
+    }
+    Reset();
+  }
+
+  static bool IsSupported(uint32_t in_rate, uint32_t out_rate) {
+    return in_rate != 0 && out_rate != 0 &&
+           out_rate / std::gcd(in_rate, out_rate) <= kMaxPhases;
+  }
+
+  void Reset() {
+    // Centers the first output frame on the first input frame
+    for (auto& history : history_) history.assign(kHalfTaps - 1, 0.0f);
+    phase_ = 0;
+  }
+
+  // Appends the output for frames of interleaved input to out
+  void Process(const float* in, size_t frames, std::vector<float>* out) {
+    for (size_t channel = 0; channel < channels_; channel++) {
+      auto& history = history_[channel];
+      size_t offset = history.size();
+      history.resize(offset + frames);
+      for (size_t frame = 0; frame < frames; frame++)
+        history[offset + frame] = in[frame * channels_ + channel];
+    }
+
+    const size_t available = history_[0].size();
+    size_t index = 0;
+    uint32_t phase = phase_;
+    const size_t capacity = frames * up_ / down_ + 2;
+    size_t out_offset = out->size();
+    out->resize(out_offset + capacity * channels_);
+    float* dst = out->data() + out_offset;
+    size_t produced = 0;
+    while (index + kTaps <= available && produced < capacity) {
+      const float* coefs = &coefs_[phase * kTaps];
+      for (size_t channel = 0; channel < channels_; channel++)
+        *dst++ = DotProduct(&history_[channel][index], coefs);
+      produced++;
+      phase += down_;
+      index += phase / up_;
+      phase %= up_;
+    }
+    out->resize(out_offset + produced * channels_);
+
+    // Keep what the next output frames still reach back to
+    for (auto& history : history_)
+      history.erase(history.begin(), history.begin() + index);
+    phase_ = phase;
+  }
+
+ private:
+  size_t channels_;
+  uint32_t up_;
+  uint32_t down_;
+  // up_ phases of kTaps coefficients
+  std::vector<float> coefs_;
+  // Planar input frames from the first one the next output frame reaches
+  std::vector<std::vector<float>> history_;
+  uint32_t phase_;
+};
+
+std::unique_ptr<StreamConverter> StreamConverter::Create(
+    const audio_config_t& src, const audio_config_t& dst) {
+  if (!IsSupportedFormat(src.format) || !IsSupportedFormat(dst.format) ||
+      ChannelCount(src.channel_mask) == 0 ||
+      ChannelCount(dst.channel_mask) == 0 ||
+      !PolyphaseResampler::IsSupported(src.sample_rate, dst.sample_rate)) {
+    LOG(ERROR) << __func__ << ": unsupported conversion from rate="
+               << src.sample_rate << ", channels=" << src.channel_mask
+               << ", format=" << src.format << " to rate=" << dst.sample_rate
+               << ", channels=" << dst.channel_mask
+               << ", format=" << dst.format;
+    return nullptr;
+  }
+  return std::unique_ptr<StreamConverter>(new StreamConverter(src, dst));
+}
+
+StreamConverter::StreamConverter(const audio_config_t& src,
+                                 const audio_config_t& dst)
+    : src_(src),
+      dst_(dst),
+      src_channels_(ChannelCount(src.channel_mask)),
+      dst_channels_(ChannelCount(dst.channel_mask)),
+      src_frame_size_(src_channels_ * audio_bytes_per_sample(src.format)),
+      dst_frame_size_(dst_channels_ *
+                      audio_bytes_per_sample(dst.format)) {
+  if (src.sample_rate != dst.sample_rate) {
+    resampler_ = std::make_unique<PolyphaseResampler>(
+        src.sample_rate, dst.sample_rate, dst_channels_);
+  }
+  LOG(INFO) << __func__ << ": rate=" << src.sample_rate << " -> "
+            << dst.sample_rate << ", channels=" << src_channels_ << " -> "
+            << dst_channels_ << ", format=" << src.format << " -> "
+            << dst.format;
+}
+
+StreamConverter::~StreamConverter() = default;
+
+const std::vector<uint8_t>& StreamConverter::Convert(const void* src,
+                                                     size_t src_bytes) {
+  const size_t frames = src_bytes / src_frame_size_;
+  const size_t src_samples = frames * src_channels_;
+  auto in = static_cast<const float*>(src);
+  if (src_.format != AUDIO_FORMAT_PCM_FLOAT) {
+    floats_.resize(src_samples);
+    switch (src_.format) {
+      case AUDIO_FORMAT_PCM_16_BIT:
+        memcpy_to_float_from_i16(floats_.data(),
+                                 static_cast<const int16_t*>(src),
+                                 src_samples);
+        break;
+      case AUDIO_FORMAT_PCM_24_BIT_PACKED:
+        memcpy_to_float_from_p24(floats_.data(),
+                                 static_cast<const uint8_t*>(src),
+                                 src_samples);
+        break;
+      case AUDIO_FORMAT_PCM_8_24_BIT:
+        memcpy_to_float_from_q8_23(floats_.data(),
+                                   static_cast<const int32_t*>(src),
+                                   src_samples);
+        break;
+      default:
+        memcpy_to_float_from_i32(floats_.data(),
+                                 static_cast<const int32_t*>(src),
+                                 src_samples);
+        break;
+    }
+    in = floats_.data();
+  }
+
+  // Mix down (or up) first, so the resampler runs on fewer channels
+  const float* mixed = in;
+  if (src_channels_ != dst_channels_) {
+    mixed_.resize(frames * dst_channels_);
+    if (dst_channels_ == 1) {
+      downmix_to_mono_float_from_stereo_float(mixed_.data(), in, frames);
+    } else {
+      upmix_to_stereo_float_from_mono_float(mixed_.data(), in, frames);
+    }
+    mixed = mixed_.data();
+  }
+
+  size_t dst_frames = frames;
+  if (resampler_ != nullptr) {
+    resampled_.clear();
+    resampler_->Process(mixed, frames, &resampled_);
+    mixed = resampled_.data();
+    dst_frames = resampled_.size() / dst_channels_;
+  }
+
+  const size_t samples = dst_frames * dst_channels_;
+  converted_.resize(dst_frames * dst_frame_size_);
+  switch (dst_.format) {
+    case AUDIO_FORMAT_PCM_16_BIT:
+      memcpy_to_i16_from_float(
+          reinterpret_cast<int16_t*>(converted_.data()), mixed, samples);
+      break;
+    case AUDIO_FORMAT_PCM_24_BIT_PACKED:
+      memcpy_to_p24_from_float(converted_.data(), mixed, samples);
+      break;
+    case AUDIO_FORMAT_PCM_8_24_BIT:
+      memcpy_to_q8_23_from_float_with_clamp(
+          reinterpret_cast<int32_t*>(converted_.data()), mixed, samples);
+      break;
+    case AUDIO_FORMAT_PCM_32_BIT:
+      memcpy_to_i32_from_float(
+          reinterpret_cast<int32_t*>(converted_.data()), mixed, samples);
+      break;
+    default:
+      memcpy(converted_.data(), mixed, samples * sizeof(float));
+      break;
+  }
+  return converted_;
+}
+
+void StreamConverter::Reset() {
+  if (resampler_ != nullptr) resampler_->Reset();
+}
+
+uint64_t StreamConverter::DstBytesToSrcFrames(uint64_t dst_bytes) const {
+  return dst_bytes / dst_frame_size_ * src_.sample_rate / dst_.sample_rate;
+}
+
+}  // namespace audio
+}  // namespace bluetooth
+}  // namespace android
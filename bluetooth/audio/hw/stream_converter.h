@@ -0,0 +1,78 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <system/audio.h>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace android {
+namespace bluetooth {
+namespace audio {
+
+class PolyphaseResampler;
+
+/***
+ * Converts interleaved PCM, as the stream was opened with, into the PCM
+ * format of the Bluetooth session. Both sides are mono / stereo, 16 bits,
+ * packed 24 bits, Q8.23, 32 bits or float, at any rates whose ratio reduces
+ * to at most 512 filter phases (147 for 44.1 kHz from 48 kHz). The work is
+ * done in float.
+ ***/
+class StreamConverter {
+ public:
+  // Returns nullptr if either side is not linear PCM in mono / stereo
+  static std::unique_ptr<StreamConverter> Create(const audio_config_t& src,
+                                                 const audio_config_t& dst);
+  ~StreamConverter();
+
+  // Converts src_bytes of src PCM. The result is valid until the next call.
+  // Rate conversion holds back the filter history, so the output of a call
+  // may be a frame longer or shorter than the ratio suggests
+  const std::vector<uint8_t>& Convert(const void* src, size_t src_bytes);
+  // Drops the filter history, e.g. after the stream was suspended
+  void Reset();
+
+  const audio_config_t& src_config() const { return src_; }
+  const audio_config_t& dst_config() const { return dst_; }
+  size_t src_frame_size() const { return src_frame_size_; }
+  size_t dst_frame_size() const { return dst_frame_size_; }
+  // Maps a position in dst bytes, e.g. reported by the stack, onto src frames
+  uint64_t DstBytesToSrcFrames(uint64_t dst_bytes) const;
+
+ private:
+  StreamConverter(const audio_config_t& src, const audio_config_t& dst);
+
+  audio_config_t src_;
+  audio_config_t dst_;
+  size_t src_channels_;
+  size_t dst_channels_;
+  size_t src_frame_size_;
+  size_t dst_frame_size_;
+  // null if both sides run at the same rate
+  std::unique_ptr<PolyphaseResampler> resampler_;
+  std::vector<float> floats_;
+  std::vector<float> mixed_;
+  std::vector<float> resampled_;
+  std::vector<uint8_t> converted_;
+};
+
+}  // namespace audio
+}  // namespace bluetooth
+}  // namespace android
@@ -0,0 +1,184 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "stream_converter.h"
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+using ::android::bluetooth::audio::StreamConverter;
+
+audio_config_t MakeConfig(uint32_t sample_rate, audio_channel_mask_t channels,
+                          audio_format_t format) {
+  audio_config_t config = AUDIO_CONFIG_INITIALIZER;
+  config.sample_rate = sample_rate;
+  config.channel_mask = channels;
+  config.format = format;
+  return config;
+}
+
+const audio_config_t kMixPort =
+    MakeConfig(48000, AUDIO_CHANNEL_OUT_STEREO, AUDIO_FORMAT_PCM_FLOAT);
+
+// Interleaved stereo float sine, the same on both channels
+std::vector<float> Sine(double frequency, uint32_t sample_rate, size_t frames,
+                        size_t first_frame = 0) {
+  std::vector<float> pcm(frames * 2);
+  for (size_t i = 0; i < frames; i++) {
+    pcm[2 * i] = pcm[2 * i + 1] = static_cast<float>(
+        0.5 * std::sin(2 * M_PI * frequency * (first_frame + i) /
+                       sample_rate));
+  }
+  return pcm;
+}
+
+std::vector<int16_t> ToI16(const std::vector<uint8_t>& bytes) {
+  std::vector<int16_t> samples(bytes.size() / sizeof(int16_t));
+  memcpy(samples.data(), bytes.data(), bytes.size());
+  return samples;
+}
+
+TEST(StreamConverterTest, RejectsUnsupportedConfigs) {
+  EXPECT_EQ(StreamConverter::Create(
+                MakeConfig(48000, AUDIO_CHANNEL_OUT_STEREO, AUDIO_FORMAT_AAC),
+                MakeConfig(44100, AUDIO_CHANNEL_OUT_STEREO,
+                           AUDIO_FORMAT_PCM_16_BIT)),
+            nullptr);
+  EXPECT_EQ(StreamConverter::Create(
+                kMixPort, MakeConfig(48000, AUDIO_CHANNEL_OUT_5POINT1,
+                                     AUDIO_FORMAT_PCM_16_BIT)),
+            nullptr);
+}
+
+TEST(StreamConverterTest, QuantizesWithoutResampling) {
+  auto converter = StreamConverter::Create(
+      kMixPort, MakeConfig(48000, AUDIO_CHANNEL_OUT_STEREO,
+                           AUDIO_FORMAT_PCM_24_BIT_PACKED));
+  ASSERT_NE(converter, nullptr);
+  const float pcm[] = {0.5f, -0.5f, 0.0f, -1.0f};
+  const auto& out = converter->Convert(pcm, sizeof(pcm));
+  ASSERT_EQ(out.size(), 4u * 3);
+  auto p24 = [&out](size_t sample) {
+    int32_t value = out[3 * sample] | out[3 * sample + 1] << 8 |
+                    static_cast<int8_t>(out[3 * sample + 2]) << 16;
+    return value;
+  };
+  EXPECT_EQ(p24(0), 0x400000);
+  EXPECT_EQ(p24(1), -0x400000);
+  EXPECT_EQ(p24(2), 0);
+  EXPECT_EQ(p24(3), -0x800000);
+}
+
+TEST(StreamConverterTest, ConvertsIntegerSource) {
+  // A 16 bits stream that follows its session from stereo to mono 24 bits
+  auto converter = StreamConverter::Create(
+      MakeConfig(48000, AUDIO_CHANNEL_OUT_STEREO, AUDIO_FORMAT_PCM_16_BIT),
+      MakeConfig(48000, AUDIO_CHANNEL_OUT_MONO, AUDIO_FORMAT_PCM_8_24_BIT));
+  ASSERT_NE(converter, nullptr);
+  EXPECT_EQ(converter->src_frame_size(), 2 * sizeof(int16_t));
+  const int16_t pcm[] = {0x4000, 0x4000, -0x2000, 0};
+  const auto& out = converter->Convert(pcm, sizeof(pcm));
+  ASSERT_EQ(out.size(), 2 * sizeof(int32_t));
+  int32_t q8_23[2];
+  memcpy(q8_23, out.data(), sizeof(q8_23));
+  EXPECT_EQ(q8_23[0], 0x400000);
+  EXPECT_EQ(q8_23[1], -0x100000);
+}
+
+TEST(StreamConverterTest, DownmixesToMono) {
+  auto converter = StreamConverter::Create(
+      kMixPort,
+      MakeConfig(48000, AUDIO_CHANNEL_OUT_MONO, AUDIO_FORMAT_PCM_16_BIT));
+  ASSERT_NE(converter, nullptr);
+  EXPECT_EQ(converter->dst_frame_size(), sizeof(int16_t));
+  const float pcm[] = {0.5f, 0.0f, -0.25f, -0.25f};
+  auto out = ToI16(converter->Convert(pcm, sizeof(pcm)));
+  ASSERT_EQ(out.size(), 2u);
+  EXPECT_NEAR(out[0], 0.25 * 32768, 1);
+  EXPECT_NEAR(out[1], -0.25 * 32768, 1);
+}
+
+TEST(StreamConverterTest, ResamplesTo44k1) {
+  auto converter = StreamConverter::Create(
+      kMixPort,
+      MakeConfig(44100, AUDIO_CHANNEL_OUT_STEREO, AUDIO_FORMAT_PCM_16_BIT));
+  ASSERT_NE(converter, nullptr);
+
+  // One second in 10 ms buffers, as AudioFlinger would write it
+  constexpr double kFrequency = 1000;
+  std::vector<int16_t> out;
+  for (size_t first = 0; first < 48000; first += 480) {
+    auto pcm = Sine(kFrequency, 48000, 480, first);
+    auto chunk =
+        ToI16(converter->Convert(pcm.data(), pcm.size() * sizeof(float)));
+    out.insert(out.end(), chunk.begin(), chunk.end());
+  }
+  // All but the filter delay has come out
+  const size_t frames = out.size() / 2;
+  EXPECT_LE(frames, 44100u);
+  EXPECT_GE(frames, 44100u - 32);
+
+  // Compare against the ideal sine at 44.1 kHz past the filter's warm up,
+  // the first output frame is centered on the first input frame
+  double error = 0, energy = 0;
+  for (size_t i = 100; i < frames; i++) {
+    double expected =
+        0.5 * 32767 * std::sin(2 * M_PI * kFrequency * i / 44100);
+    error += (out[2 * i] - expected) * (out[2 * i] - expected);
+    energy += expected * expected;
+    EXPECT_EQ(out[2 * i], out[2 * i + 1]);
+  }
+  // Better than 60 dB of signal to noise
+  EXPECT_LT(10 * std::log10(error / energy), -60);
+}
+
+TEST(StreamConverterTest, ResamplingRejectsAboveNyquist) {
+  auto converter = StreamConverter::Create(
+      kMixPort,
+      MakeConfig(16000, AUDIO_CHANNEL_OUT_MONO, AUDIO_FORMAT_PCM_16_BIT));
+  ASSERT_NE(converter, nullptr);
+  // 12 kHz has no place at 16 kHz and must not fold back into the passband
+  auto pcm = Sine(12000, 48000, 4800);
+  auto out =
+      ToI16(converter->Convert(pcm.data(), pcm.size() * sizeof(float)));
+  ASSERT_GT(out.size(), 1000u);
+  double peak = 0;
+  for (size_t i = 100; i < out.size(); i++)
+    peak = std::max(peak, std::abs(static_cast<double>(out[i])));
+  // Under -60 dB of the 0.5 input
+  EXPECT_LT(peak, 0.5 * 32767 / 1000);
+}
+
+TEST(StreamConverterTest, ResetDropsHistory) {
+  auto converter = StreamConverter::Create(
+      kMixPort,
+      MakeConfig(24000, AUDIO_CHANNEL_OUT_STEREO, AUDIO_FORMAT_PCM_32_BIT));
+  ASSERT_NE(converter, nullptr);
+  auto pcm = Sine(1000, 48000, 480);
+  size_t first =
+      converter->Convert(pcm.data(), pcm.size() * sizeof(float)).size();
+  converter->Reset();
+  size_t again =
+      converter->Convert(pcm.data(), pcm.size() * sizeof(float)).size();
+  EXPECT_EQ(first, again);
+  EXPECT_EQ(converter->DstBytesToSrcFrames(240 * 8), 480u);
+}
+
+}  // namespace
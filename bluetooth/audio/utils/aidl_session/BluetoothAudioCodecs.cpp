@@ -32,6 +32,9 @@
 #include <aidl/android/hardware/bluetooth/audio/SbcChannelMode.h>
 #include <android-base/logging.h>
 
+#include <chrono>
+#include <mutex>
+
 #include "BluetoothLeAudioAseConfigurationSettingProvider.h"
 #include "BluetoothLeAudioCodecsProvider.h"
 
@@ -100,6 +103,33 @@ const std::vector<CodecCapabilities> kDefaultOffloadA2dpCodecCapabilities = {
 std::vector<LeAudioCodecCapabilitiesSetting> kDefaultOffloadLeAudioCapabilities;
 std::unordered_map<SessionType, std::vector<CodecInfo>>
     kDefaultOffloadLeAudioCodecInfoMap;
+std::vector<LeAudioAseConfigurationSetting> kDefaultLeAudioAseConfigurations;
+
+// Both flags double as readiness latches: a binder call racing with
+// PreloadCodecData() blocks in std::call_once until the preload finishes
+// instead of parsing the same files a second time.
+static std::once_flag le_audio_offload_setting_loaded;
+static std::once_flag le_audio_ase_configurations_loaded;
+
+static void LoadLeAudioOffloadSetting() {
+  std::call_once(le_audio_offload_setting_loaded, [] {
+    auto le_audio_offload_setting =
+        BluetoothLeAudioCodecsProvider::ParseFromLeAudioOffloadSettingFile();
+    kDefaultOffloadLeAudioCapabilities =
+        BluetoothLeAudioCodecsProvider::GetLeAudioCodecCapabilities(
+            le_audio_offload_setting);
+    kDefaultOffloadLeAudioCodecInfoMap =
+        BluetoothLeAudioCodecsProvider::GetLeAudioCodecInfo(
+            le_audio_offload_setting);
+  });
+}
+
+static void LoadLeAudioAseConfigurations() {
+  std::call_once(le_audio_ase_configurations_loaded, [] {
+    kDefaultLeAudioAseConfigurations = AudioSetConfigurationProviderJson::
+        GetLeAudioAseConfigurationSettings();
+  });
+}
 
 template <class T>
 bool BluetoothAudioCodecs::ContainedInVector(
@@ -404,13 +434,7 @@ BluetoothAudioCodecs::GetLeAudioOffloadCodecCapabilities(
     return std::vector<LeAudioCodecCapabilitiesSetting>(0);
   }
 
-  if (kDefaultOffloadLeAudioCapabilities.empty()) {
-    auto le_audio_offload_setting =
-        BluetoothLeAudioCodecsProvider::ParseFromLeAudioOffloadSettingFile();
-    kDefaultOffloadLeAudioCapabilities =
-        BluetoothLeAudioCodecsProvider::GetLeAudioCodecCapabilities(
-            le_audio_offload_setting);
-  }
+  LoadLeAudioOffloadSetting();
   return kDefaultOffloadLeAudioCapabilities;
 }
 
@@ -425,13 +449,7 @@ std::vector<CodecInfo> BluetoothAudioCodecs::GetLeAudioOffloadCodecInfo(
     return std::vector<CodecInfo>();
   }
 
-  if (kDefaultOffloadLeAudioCodecInfoMap.empty()) {
-    auto le_audio_offload_setting =
-        BluetoothLeAudioCodecsProvider::ParseFromLeAudioOffloadSettingFile();
-    auto kDefaultOffloadLeAudioCodecInfoMap =
-        BluetoothLeAudioCodecsProvider::GetLeAudioCodecInfo(
-            le_audio_offload_setting);
-  }
+  LoadLeAudioOffloadSetting();
   auto codec_info_map_iter =
       kDefaultOffloadLeAudioCodecInfoMap.find(session_type);
   if (codec_info_map_iter == kDefaultOffloadLeAudioCodecInfoMap.end())
@@ -441,8 +459,35 @@ std::vector<CodecInfo> BluetoothAudioCodecs::GetLeAudioOffloadCodecInfo(
 
 std::vector<LeAudioAseConfigurationSetting>
 BluetoothAudioCodecs::GetLeAudioAseConfigurationSettings() {
-  return AudioSetConfigurationProviderJson::
-      GetLeAudioAseConfigurationSettings();
+  LoadLeAudioAseConfigurations();
+  return kDefaultLeAudioAseConfigurations;
+}
+
+void BluetoothAudioCodecs::PreloadCodecData() {
+  using std::chrono::duration_cast;
+  using std::chrono::milliseconds;
+  using std::chrono::steady_clock;
+
+  auto start = steady_clock::now();
+  GetA2dpOffloadCodecCapabilities(
+      SessionType::A2DP_HARDWARE_OFFLOAD_ENCODING_DATAPATH);
+  auto a2dp_done = steady_clock::now();
+  LoadLeAudioOffloadSetting();
+  auto capabilities_done = steady_clock::now();
+  LoadLeAudioAseConfigurations();
+  auto ase_done = steady_clock::now();
+
+  LOG(INFO) << __func__ << ": a2dp="
+            << duration_cast<milliseconds>(a2dp_done - start).count()
+            << "ms le_audio_capabilities="
+            << duration_cast<milliseconds>(capabilities_done - a2dp_done)
+                   .count()
+            << "ms ase_configurations="
+            << duration_cast<milliseconds>(ase_done - capabilities_done)
+                   .count()
+            << "ms (" << kDefaultOffloadLeAudioCapabilities.size()
+            << " capabilities, " << kDefaultLeAudioAseConfigurations.size()
+            << " ASE settings)";
 }
 
 }  // namespace audio
@@ -57,6 +57,11 @@ class BluetoothAudioCodecs {
   static std::vector<LeAudioAseConfigurationSetting>
   GetLeAudioAseConfigurationSettings();
 
+  // Parses every capability and configuration file up front so the first
+  // call from the Bluetooth stack doesn't pay for it. Safe to run on a
+  // background thread; concurrent getters wait for it to finish.
+  static void PreloadCodecData();
+
  private:
   template <typename T>
   struct identity {
@@ -16,12 +16,20 @@
 
 #include <sys/types.h>
 #define LOG_TAG "BTAudioSessionAidl"
+#define ATRACE_TAG ATRACE_TAG_AUDIO
 
+#include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/stringprintf.h>
 #include <android/binder_manager.h>
+#include <cutils/trace.h>
 #include <hardware/audio.h>
 
+#include <time.h>
+
+#include <algorithm>
+#include <cstring>
+
 #include "BluetoothAudioSession.h"
 
 namespace aidl {
@@ -35,6 +43,39 @@ static constexpr int kFmqReceiveTimeoutMs =
     1000;                               // 1000 ms timeout for receiving
 static constexpr int kWritePollMs = 1;  // polled non-blocking interval
 static constexpr int kReadPollMs = 1;   // polled non-blocking interval
+// The remote delay barely moves, unlike the position of the data path
+static constexpr int64_t kRemoteDelayRefreshMs = 1000;
+
+static timespec MonotonicNow() {
+  timespec now = {};
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now;
+}
+
+static int64_t ToNanos(const timespec& ts) {
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// ATRACE_BEGIN / ATRACE_END around a scope, as ATRACE_NAME of libutils
+class ScopedTrace {
+ public:
+  explicit ScopedTrace(const char* name) { ATRACE_BEGIN(name); }
+  ~ScopedTrace() { ATRACE_END(); }
+};
+
+// Sleeps while polling the FMQ, adding the time actually slept to blocked_ns
+static void PollSleep(int poll_ms, std::atomic<int64_t>& blocked_ns) {
+  int64_t begin = ToNanos(MonotonicNow());
+  usleep(poll_ms * 1000);
+  blocked_ns.fetch_add(ToNanos(MonotonicNow()) - begin,
+                       std::memory_order_relaxed);
+}
+
+static bool IsDecodingDataPath(const SessionType& session_type) {
+  return session_type == SessionType::A2DP_SOFTWARE_DECODING_DATAPATH ||
+         session_type == SessionType::HFP_SOFTWARE_DECODING_DATAPATH ||
+         session_type == SessionType::LE_AUDIO_SOFTWARE_DECODING_DATAPATH;
+}
 
 BluetoothAudioSession::BluetoothAudioSession(const SessionType& session_type)
     : session_type_(session_type), stack_iface_(nullptr), data_mq_(nullptr) {}
@@ -61,6 +102,7 @@ void BluetoothAudioSession::OnSessionStarted(
     LOG(ERROR) << __func__ << " - SessionType=" << toString(session_type_)
                << " MqDescriptor Invalid";
     audio_config_ = nullptr;
+    audio_config_generation_++;
   } else {
     stack_iface_ = stack_iface;
     latency_modes_ = latency_modes;
@@ -75,6 +117,7 @@ void BluetoothAudioSession::OnSessionEnded() {
   bool toggled = IsSessionReady();
   LOG(INFO) << __func__ << " - SessionType=" << toString(session_type_);
   audio_config_ = nullptr;
+  audio_config_generation_++;
   stack_iface_ = nullptr;
   UpdateDataPath(nullptr);
   if (toggled) {
@@ -82,6 +125,47 @@ void BluetoothAudioSession::OnSessionEnded() {
   }
 }
 
+bool BluetoothAudioSession::OnLocationQueuesStarted(
+    const std::vector<DataMQDesc>& mq_descs) {
+  std::lock_guard<std::recursive_mutex> guard(mutex_);
+  if (session_type_ != SessionType::LE_AUDIO_SOFTWARE_ENCODING_DATAPATH ||
+      !IsSessionReady()) {
+    LOG(ERROR) << __func__ << " - SessionType=" << toString(session_type_)
+               << " has NO session";
+    return false;
+  }
+  const auto& pcm_config = audio_config_->get<AudioConfiguration::pcmConfig>();
+  size_t channels = pcm_config.channelMode == ChannelMode::STEREO   ? 2
+                    : pcm_config.channelMode == ChannelMode::MONO ? 1
+                                                                  : 0;
+  // 24 bit audio stream is sent as unpacked
+  size_t sample_size =
+      pcm_config.bitsPerSample == 24 ? 4 : pcm_config.bitsPerSample / 8;
+  // A single location is what the interleaved FMQ carries already
+  if (channels < 2 || mq_descs.size() != channels || sample_size == 0) {
+    LOG(ERROR) << __func__ << " - SessionType=" << toString(session_type_)
+               << " got " << mq_descs.size() << " FMQ(s) for "
+               << pcm_config.toString();
+    return false;
+  }
+
+  std::vector<std::unique_ptr<DataMQ>> mqs;
+  for (const auto& mq_desc : mq_descs) {
+    auto mq = std::make_unique<DataMQ>(mq_desc);
+    if (!mq->isValid() || mq->getQuantumCount() % sample_size != 0) {
+      LOG(ERROR) << __func__ << " - SessionType=" << toString(session_type_)
+                 << " MqDescriptor Invalid";
+      return false;
+    }
+    mqs.push_back(std::move(mq));
+  }
+  location_mqs_ = std::move(mqs);
+  location_sample_size_ = sample_size;
+  LOG(INFO) << __func__ << " - SessionType=" << toString(session_type_)
+            << " writing " << channels << " audio location(s) apart";
+  return true;
+}
+
 /***
  *
  * Util methods
@@ -109,24 +193,53 @@ const AudioConfiguration BluetoothAudioSession::GetAudioConfig() {
   return *audio_config_;
 }
 
+const AudioConfiguration BluetoothAudioSession::GetAudioConfig(
+    uint32_t* generation) {
+  std::lock_guard<std::recursive_mutex> guard(mutex_);
+  *generation = audio_config_generation_;
+  return GetAudioConfig();
+}
+
+uint32_t BluetoothAudioSession::GetAudioConfigGeneration() {
+  std::lock_guard<std::recursive_mutex> guard(mutex_);
+  return audio_config_generation_;
+}
+
 void BluetoothAudioSession::ReportAudioConfigChanged(
     const AudioConfiguration& audio_config) {
-  if (session_type_ !=
-          SessionType::LE_AUDIO_HARDWARE_OFFLOAD_ENCODING_DATAPATH &&
-      session_type_ !=
-          SessionType::LE_AUDIO_HARDWARE_OFFLOAD_DECODING_DATAPATH) {
-    return;
-  }
-
   std::lock_guard<std::recursive_mutex> guard(mutex_);
-  if (audio_config.getTag() != AudioConfiguration::leAudioConfig) {
-    LOG(ERROR) << __func__ << " invalid audio config type for SessionType ="
-               << toString(session_type_);
+  if (session_type_ ==
+          SessionType::LE_AUDIO_HARDWARE_OFFLOAD_ENCODING_DATAPATH ||
+      session_type_ ==
+          SessionType::LE_AUDIO_HARDWARE_OFFLOAD_DECODING_DATAPATH) {
+    if (audio_config.getTag() != AudioConfiguration::leAudioConfig) {
+      LOG(ERROR) << __func__ << " invalid audio config type for SessionType ="
+                 << toString(session_type_);
+      return;
+    }
+    audio_config_ = std::make_unique<AudioConfiguration>(audio_config);
+    audio_config_generation_++;
+  } else if (audio_config.getTag() == AudioConfiguration::pcmConfig) {
+    // Software sessions keep their data path, only the PCM written into it
+    // changes, and the bluetooth_audio outputs follow without reopening. The
+    // provider turns down other frame sizes, which need a new session and FMQ
+    if (!IsSessionReady() || !UpdateAudioConfig(audio_config)) {
+      LOG(ERROR) << __func__ << " - SessionType=" << toString(session_type_)
+                 << ", AudioConfiguration=" << audio_config.toString()
+                 << " Invalid";
+      return;
+    }
+    // The channels may not match the audio locations anymore, back to the
+    // interleaved FMQ until the stack sets them up again
+    if (!location_mqs_.empty()) {
+      LOG(INFO) << __func__ << " - SessionType=" << toString(session_type_)
+                << " drops its audio location FMQs";
+      location_mqs_.clear();
+    }
+  } else {
     return;
   }
 
-  audio_config_ = std::make_unique<AudioConfiguration>(audio_config);
-
   if (observers_.empty()) {
     LOG(WARNING) << __func__ << " - SessionType=" << toString(session_type_)
                  << " has NO port state observer";
@@ -208,14 +321,23 @@ void BluetoothAudioSession::UnregisterStatusCback(uint16_t cookie) {
  ***/
 
 bool BluetoothAudioSession::StartStream(bool is_low_latency) {
+  ScopedTrace trace("BTAudioSession::StartStream");
   std::lock_guard<std::recursive_mutex> guard(mutex_);
   if (!IsSessionReady()) {
     LOG(DEBUG) << __func__ << " - SessionType=" << toString(session_type_)
                << " has NO session";
     return false;
   }
+  // Until the stack's ReportControlStatus
+  stats_.start_request_ns.store(ToNanos(MonotonicNow()),
+                                std::memory_order_relaxed);
+  ATRACE_ASYNC_BEGIN("BTAudioSession start",
+                     static_cast<int32_t>(session_type_));
   auto hal_retval = stack_iface_->startStream(is_low_latency);
   if (!hal_retval.isOk()) {
+    stats_.start_request_ns.store(0, std::memory_order_relaxed);
+    ATRACE_ASYNC_END("BTAudioSession start",
+                     static_cast<int32_t>(session_type_));
     LOG(WARNING) << __func__ << " - IBluetoothAudioPort SessionType="
                  << toString(session_type_) << " failed";
     return false;
@@ -224,14 +346,22 @@ bool BluetoothAudioSession::StartStream(bool is_low_latency) {
 }
 
 bool BluetoothAudioSession::SuspendStream() {
+  ScopedTrace trace("BTAudioSession::SuspendStream");
   std::lock_guard<std::recursive_mutex> guard(mutex_);
   if (!IsSessionReady()) {
     LOG(DEBUG) << __func__ << " - SessionType=" << toString(session_type_)
                << " has NO session";
     return false;
   }
+  stats_.suspend_request_ns.store(ToNanos(MonotonicNow()),
+                                  std::memory_order_relaxed);
+  ATRACE_ASYNC_BEGIN("BTAudioSession suspend",
+                     static_cast<int32_t>(session_type_));
   auto hal_retval = stack_iface_->suspendStream();
   if (!hal_retval.isOk()) {
+    stats_.suspend_request_ns.store(0, std::memory_order_relaxed);
+    ATRACE_ASYNC_END("BTAudioSession suspend",
+                     static_cast<int32_t>(session_type_));
     LOG(WARNING) << __func__ << " - IBluetoothAudioPort SessionType="
                  << toString(session_type_) << " failed";
     return false;
@@ -258,6 +388,11 @@ void BluetoothAudioSession::StopStream() {
  ***/
 
 bool BluetoothAudioSession::UpdateDataPath(const DataMQDesc* mq_desc) {
+  position_block_.Reset();
+  remote_delay_expiry_ns_ = 0;
+  remote_delay_ns_ = -1;
+  data_mq_octets_ = 0;
+  location_mqs_.clear();
   if (mq_desc == nullptr) {
     // usecase of reset by nullptr
     data_mq_ = nullptr;
@@ -322,9 +457,35 @@ bool BluetoothAudioSession::UpdateAudioConfig(
     return false;
   }
   audio_config_ = std::make_unique<AudioConfiguration>(audio_config);
+  audio_config_generation_++;
   return true;
 }
 
+void BluetoothAudioSession::PublishPresentationPosition() {
+  // This is locked already by the PCM methods / GetPresentationPosition
+  if (data_mq_ == nullptr || remote_delay_ns_ < 0) {
+    return;
+  }
+  // What is still in the FMQ was not consumed by (encoding), but already
+  // produced by (decoding) the stack
+  uint64_t queued = 0;
+  if (location_mqs_.empty()) {
+    queued = data_mq_->availableToRead();
+  } else {
+    for (const auto& mq : location_mqs_) queued += mq->availableToRead();
+  }
+  uint64_t octets = IsDecodingDataPath(session_type_)
+                        ? data_mq_octets_ + queued
+                        : data_mq_octets_ - std::min(queued, data_mq_octets_);
+  timespec now = MonotonicNow();
+  PresentationPosition position;
+  position.remoteDeviceAudioDelayNanos = remote_delay_ns_;
+  position.transmittedOctets = octets;
+  position.transmittedOctetsTimestamp.tvSec = now.tv_sec;
+  position.transmittedOctetsTimestamp.tvNSec = now.tv_nsec;
+  position_block_.Publish(position);
+}
+
 void BluetoothAudioSession::ReportSessionStatus() {
   // This is locked already by OnSessionStarted / OnSessionEnded
   if (observers_.empty()) {
@@ -332,6 +493,8 @@ void BluetoothAudioSession::ReportSessionStatus() {
               << " has NO port state observer";
     return;
   }
+  ScopedTrace trace("BTAudioSession::ReportSessionStatus");
+  int64_t begin = ToNanos(MonotonicNow());
   for (auto& observer : observers_) {
     uint16_t cookie = observer.first;
     std::shared_ptr<PortStatusCallbacks> callback = observer.second;
@@ -340,6 +503,7 @@ void BluetoothAudioSession::ReportSessionStatus() {
               << ::android::base::StringPrintf("%04x", cookie);
     callback->session_changed_cb_(cookie);
   }
+  stats_.session_status_fan_out.Add(ToNanos(MonotonicNow()) - begin);
 }
 
 /***
@@ -353,6 +517,13 @@ size_t BluetoothAudioSession::OutWritePcmData(const void* buffer,
   if (buffer == nullptr || bytes <= 0) {
     return 0;
   }
+  std::unique_lock<std::recursive_mutex> location_lock(mutex_);
+  bool per_location = !location_mqs_.empty();
+  location_lock.unlock();
+  if (per_location) {
+    return OutWriteLocationPcmData(buffer, bytes);
+  }
+  ScopedTrace trace("BTAudioSession::OutWritePcmData");
   size_t total_written = 0;
   int timeout_ms = kFmqSendTimeoutMs;
   do {
@@ -374,23 +545,214 @@ size_t BluetoothAudioSession::OutWritePcmData(const void* buffer,
         return total_written;
       }
       total_written += num_bytes_to_write;
+      data_mq_octets_ += num_bytes_to_write;
+      stats_.bytes_written.fetch_add(num_bytes_to_write,
+                                     std::memory_order_relaxed);
+      PublishPresentationPosition();
     } else if (timeout_ms >= kWritePollMs) {
       lock.unlock();
-      usleep(kWritePollMs * 1000);
+      stats_.fmq_full_events.fetch_add(1, std::memory_order_relaxed);
+      PollSleep(kWritePollMs, stats_.blocked_ns);
       timeout_ms -= kWritePollMs;
     } else {
       LOG(DEBUG) << "Data " << total_written << "/" << bytes << " overflow "
                  << (kFmqSendTimeoutMs - timeout_ms) << " ms";
+      stats_.fmq_timeouts.fetch_add(1, std::memory_order_relaxed);
       return total_written;
     }
   } while (total_written < bytes);
   return total_written;
 }
 
+// The largest frame a converter may produce, e.g. 8 channels of 32 bits
+static constexpr size_t kMaxPcmFrameSize = 32;
+
+// Converts frames straight into the regions of a FMQ write transaction. The
+// ring may wrap in the middle of a frame, which is then converted aside and
+// split over both regions
+template <typename Convert>
+static void ConvertIntoTransaction(const DataMQ::MemTransaction& tx,
+                                   const uint8_t* in, size_t src_frame_size,
+                                   size_t dst_frame_size, size_t frames,
+                                   Convert convert) {
+  auto first = tx.getFirstRegion();
+  auto second = tx.getSecondRegion();
+  size_t first_frames = first.getLength() / dst_frame_size;
+  size_t split_bytes = first.getLength() % dst_frame_size;
+
+  convert(first.getAddress(), in, first_frames);
+  in += first_frames * src_frame_size;
+
+  size_t second_offset = 0;
+  if (split_bytes) {
+    uint8_t frame[kMaxPcmFrameSize];
+    convert(frame, in, 1);
+    memcpy(first.getAddress() + first_frames * dst_frame_size, frame,
+           split_bytes);
+    memcpy(second.getAddress(), frame + split_bytes,
+           dst_frame_size - split_bytes);
+    in += src_frame_size;
+    second_offset = dst_frame_size - split_bytes;
+  }
+
+  size_t second_frames = frames - first_frames - !!split_bytes;
+  if (second_frames)
+    convert(second.getAddress() + second_offset, in, second_frames);
+}
+
+size_t BluetoothAudioSession::OutWritePcmData(const void* buffer, size_t bytes,
+                                              size_t src_frame_size,
+                                              size_t dst_frame_size,
+                                              PcmConverter convert) {
+  if (buffer == nullptr || convert == nullptr || src_frame_size == 0 ||
+      dst_frame_size == 0 || dst_frame_size > kMaxPcmFrameSize) {
+    return 0;
+  }
+  ScopedTrace trace("BTAudioSession::OutWritePcmData");
+  auto src = static_cast<const uint8_t*>(buffer);
+  size_t frames = bytes / src_frame_size;
+  size_t total_frames = 0;
+  int timeout_ms = kFmqSendTimeoutMs;
+  while (total_frames < frames) {
+    std::unique_lock<std::recursive_mutex> lock(mutex_);
+    if (!IsSessionReady()) {
+      break;
+    }
+    size_t num_frames_to_write =
+        std::min(data_mq_->availableToWrite() / dst_frame_size,
+                 frames - total_frames);
+    if (num_frames_to_write) {
+      size_t num_bytes_to_write = num_frames_to_write * dst_frame_size;
+      DataMQ::MemTransaction tx;
+      if (!data_mq_->beginWrite(num_bytes_to_write, &tx)) {
+        LOG(ERROR) << "FMQ datapath writing " << total_frames << "/" << frames
+                   << " frames failed";
+        break;
+      }
+      ConvertIntoTransaction(tx, src + total_frames * src_frame_size,
+                             src_frame_size, dst_frame_size,
+                             num_frames_to_write, convert);
+      data_mq_->commitWrite(num_bytes_to_write);
+      total_frames += num_frames_to_write;
+      data_mq_octets_ += num_bytes_to_write;
+      stats_.bytes_written.fetch_add(num_bytes_to_write,
+                                     std::memory_order_relaxed);
+      PublishPresentationPosition();
+    } else if (timeout_ms >= kWritePollMs) {
+      lock.unlock();
+      stats_.fmq_full_events.fetch_add(1, std::memory_order_relaxed);
+      PollSleep(kWritePollMs, stats_.blocked_ns);
+      timeout_ms -= kWritePollMs;
+    } else {
+      LOG(DEBUG) << "Data " << total_frames << "/" << frames
+                 << " frames overflow " << (kFmqSendTimeoutMs - timeout_ms)
+                 << " ms";
+      stats_.fmq_timeouts.fetch_add(1, std::memory_order_relaxed);
+      break;
+    }
+  }
+  return total_frames * src_frame_size;
+}
+
+// Picks every stride-th sample, with a fixed size the compiler can turn into
+// plain loads and stores
+template <size_t kSampleSize>
+static void CopyChannel(uint8_t* dst, const uint8_t* src, size_t stride,
+                        size_t samples) {
+  for (size_t i = 0; i < samples; i++)
+    memcpy(dst + i * kSampleSize, src + i * stride, kSampleSize);
+}
+
+static void CopyChannel(uint8_t* dst, const uint8_t* src, size_t sample_size,
+                        size_t stride, size_t samples) {
+  switch (sample_size) {
+    case 2:
+      CopyChannel<2>(dst, src, stride, samples);
+      break;
+    case 4:
+      CopyChannel<4>(dst, src, stride, samples);
+      break;
+    default:
+      for (size_t i = 0; i < samples; i++)
+        memcpy(dst + i * sample_size, src + i * stride, sample_size);
+      break;
+  }
+}
+
+size_t BluetoothAudioSession::OutWriteLocationPcmData(const void* buffer,
+                                                      size_t bytes) {
+  ScopedTrace trace("BTAudioSession::OutWriteLocationPcmData");
+  auto src = static_cast<const uint8_t*>(buffer);
+  size_t total_written = 0;
+  int timeout_ms = kFmqSendTimeoutMs;
+  while (true) {
+    std::unique_lock<std::recursive_mutex> lock(mutex_);
+    if (!IsSessionReady() || location_mqs_.empty()) {
+      break;
+    }
+    size_t sample_size = location_sample_size_;
+    size_t frame_size = location_mqs_.size() * sample_size;
+    size_t frames = (bytes - total_written) / frame_size;
+    if (frames == 0) {
+      break;
+    }
+    // The locations are written in step, as far as the fullest ring allows
+    size_t num_frames_to_write = frames;
+    for (const auto& mq : location_mqs_) {
+      num_frames_to_write =
+          std::min(num_frames_to_write, mq->availableToWrite() / sample_size);
+    }
+    if (num_frames_to_write) {
+      size_t num_bytes_to_write = num_frames_to_write * sample_size;
+      std::vector<DataMQ::MemTransaction> txs(location_mqs_.size());
+      for (size_t i = 0; i < location_mqs_.size(); i++) {
+        if (!location_mqs_[i]->beginWrite(num_bytes_to_write, &txs[i])) {
+          LOG(ERROR) << "FMQ datapath writing location " << i << " "
+                     << total_written << "/" << bytes << " failed";
+          return total_written;
+        }
+      }
+      // Each ring takes its channel straight out of the interleaved frames
+      const uint8_t* in = src + total_written;
+      for (size_t i = 0; i < location_mqs_.size(); i++) {
+        ConvertIntoTransaction(
+            txs[i], in + i * sample_size, frame_size, sample_size,
+            num_frames_to_write,
+            [sample_size, frame_size](void* to, const void* from,
+                                      size_t count) {
+              CopyChannel(static_cast<uint8_t*>(to),
+                          static_cast<const uint8_t*>(from), sample_size,
+                          frame_size, count);
+            });
+      }
+      for (auto& mq : location_mqs_) mq->commitWrite(num_bytes_to_write);
+
+      size_t num_interleaved_bytes = num_frames_to_write * frame_size;
+      total_written += num_interleaved_bytes;
+      data_mq_octets_ += num_interleaved_bytes;
+      stats_.bytes_written.fetch_add(num_interleaved_bytes,
+                                     std::memory_order_relaxed);
+      PublishPresentationPosition();
+    } else if (timeout_ms >= kWritePollMs) {
+      lock.unlock();
+      stats_.fmq_full_events.fetch_add(1, std::memory_order_relaxed);
+      PollSleep(kWritePollMs, stats_.blocked_ns);
+      timeout_ms -= kWritePollMs;
+    } else {
+      LOG(DEBUG) << "Data " << total_written << "/" << bytes << " overflow "
+                 << (kFmqSendTimeoutMs - timeout_ms) << " ms";
+      stats_.fmq_timeouts.fetch_add(1, std::memory_order_relaxed);
+      break;
+    }
+  }
+  return total_written;
+}
+
 size_t BluetoothAudioSession::InReadPcmData(void* buffer, size_t bytes) {
   if (buffer == nullptr || bytes <= 0) {
     return 0;
   }
+  ScopedTrace trace("BTAudioSession::InReadPcmData");
   size_t total_read = 0;
   int timeout_ms = kFmqReceiveTimeoutMs;
   do {
@@ -410,14 +772,19 @@ size_t BluetoothAudioSession::InReadPcmData(void* buffer, size_t bytes) {
         return total_read;
       }
       total_read += num_bytes_to_read;
+      data_mq_octets_ += num_bytes_to_read;
+      stats_.bytes_read.fetch_add(num_bytes_to_read, std::memory_order_relaxed);
+      PublishPresentationPosition();
     } else if (timeout_ms >= kReadPollMs) {
       lock.unlock();
-      usleep(kReadPollMs * 1000);
+      stats_.fmq_empty_events.fetch_add(1, std::memory_order_relaxed);
+      PollSleep(kReadPollMs, stats_.blocked_ns);
       timeout_ms -= kReadPollMs;
       continue;
     } else {
       LOG(DEBUG) << "Data " << total_read << "/" << bytes << " overflow "
                  << (kFmqReceiveTimeoutMs - timeout_ms) << " ms";
+      stats_.fmq_timeouts.fetch_add(1, std::memory_order_relaxed);
       return total_read;
     }
   } while (total_read < bytes);
@@ -433,6 +800,18 @@ size_t BluetoothAudioSession::InReadPcmData(void* buffer, size_t bytes) {
 void BluetoothAudioSession::ReportControlStatus(bool start_resp,
                                                 BluetoothAudioStatus status) {
   std::lock_guard<std::recursive_mutex> guard(mutex_);
+  // The stack also reports unsolicited suspends, which have no latency
+  int64_t request_ns =
+      (start_resp ? stats_.start_request_ns : stats_.suspend_request_ns)
+          .exchange(0, std::memory_order_relaxed);
+  if (request_ns != 0) {
+    LatencyStat& latency =
+        start_resp ? stats_.start_latency : stats_.suspend_latency;
+    latency.Add(ToNanos(MonotonicNow()) - request_ns);
+    ATRACE_ASYNC_END(start_resp ? "BTAudioSession start"
+                                : "BTAudioSession suspend",
+                     static_cast<int32_t>(session_type_));
+  }
   if (observers_.empty()) {
     LOG(WARNING) << __func__ << " - SessionType=" << toString(session_type_)
                  << " has NO port state observer";
@@ -484,20 +863,34 @@ void BluetoothAudioSession::ReportLowLatencyModeAllowedChanged(bool allowed) {
 
 bool BluetoothAudioSession::GetPresentationPosition(
     PresentationPosition& presentation_position) {
+  int64_t now_ns = ToNanos(MonotonicNow());
+  if (now_ns < remote_delay_expiry_ns_.load(std::memory_order_relaxed) &&
+      position_block_.Read(presentation_position)) {
+    return true;
+  }
+
   std::lock_guard<std::recursive_mutex> guard(mutex_);
   if (!IsSessionReady()) {
     LOG(DEBUG) << __func__ << " - SessionType=" << toString(session_type_)
                << " has NO session";
     return false;
   }
-  bool retval = false;
-
   if (!stack_iface_->getPresentationPosition(&presentation_position).isOk()) {
     LOG(WARNING) << __func__ << " - IBluetoothAudioPort SessionType="
                  << toString(session_type_) << " failed";
     return false;
   }
-  return retval;
+  if (data_mq_ == nullptr) {
+    // Offloaded, so only the stack knows where the data path is
+    return true;
+  }
+  // Only take the remote delay, the position is measured at the FMQ
+  remote_delay_ns_ =
+      std::max<int64_t>(presentation_position.remoteDeviceAudioDelayNanos, 0);
+  remote_delay_expiry_ns_.store(now_ns + kRemoteDelayRefreshMs * 1000000,
+                                std::memory_order_relaxed);
+  PublishPresentationPosition();
+  return position_block_.Read(presentation_position);
 }
 
 void BluetoothAudioSession::UpdateSourceMetadata(
@@ -655,6 +1048,37 @@ bool BluetoothAudioSession::IsAidlAvailable() {
   return is_aidl_available;
 }
 
+void BluetoothAudioSession::Dump(int fd) {
+  std::string dump = "SessionType=" + toString(session_type_) + "\n";
+  // A stack that hangs in a binder call must not hang dumpsys as well
+  std::unique_lock<std::recursive_mutex> lock(mutex_, std::try_to_lock);
+  if (lock.owns_lock()) {
+    dump += ::android::base::StringPrintf(
+        "  ready=%s observers=%zu low_latency_allowed=%s\n",
+        IsSessionReady() ? "true" : "false", observers_.size(),
+        low_latency_allowed_ ? "true" : "false");
+    if (audio_config_ != nullptr) {
+      dump += "  audio_config=" + audio_config_->toString() + "\n";
+    }
+    if (data_mq_ != nullptr) {
+      dump += ::android::base::StringPrintf(
+          "  fmq_size=%zu fmq_available_to_read=%zu\n",
+          data_mq_->getQuantumCount(), data_mq_->availableToRead());
+    }
+    for (size_t i = 0; i < location_mqs_.size(); i++) {
+      dump += ::android::base::StringPrintf(
+          "  location_fmq[%zu] size=%zu available_to_read=%zu\n", i,
+          location_mqs_[i]->getQuantumCount(),
+          location_mqs_[i]->availableToRead());
+    }
+    lock.unlock();
+  } else {
+    dump += "  session is busy, state skipped\n";
+  }
+  dump += stats_.ToString();
+  ::android::base::WriteStringToFd(dump, fd);
+}
+
 /***
  *
  * BluetoothAudioSessionInstance
@@ -681,6 +1105,15 @@ BluetoothAudioSessionInstance::GetSessionInstance(
   return session_ptr;
 }
 
+void BluetoothAudioSessionInstance::DumpAll(int fd) {
+  std::vector<std::shared_ptr<BluetoothAudioSession>> sessions;
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    for (const auto& entry : sessions_map_) sessions.push_back(entry.second);
+  }
+  for (const auto& session : sessions) session->Dump(fd);
+}
+
 }  // namespace audio
 }  // namespace bluetooth
 }  // namespace hardware
@@ -24,10 +24,14 @@
 #include <aidl/android/hardware/bluetooth/audio/SessionType.h>
 #include <fmq/AidlMessageQueue.h>
 
+#include <atomic>
 #include <mutex>
 #include <unordered_map>
 #include <vector>
 
+#include "BluetoothAudioSessionStats.h"
+#include "PresentationPositionBlock.h"
+
 // To avoid inclusion of hardware/audio.h
 struct sink_metadata;
 struct source_metadata;
@@ -134,6 +138,16 @@ class BluetoothAudioSession {
    ***/
   void OnSessionEnded();
 
+  /***
+   * The report function is used to report that the Bluetooth stack moved an
+   * LE Audio software session onto one FMQ per audio location: channel i of
+   * the PCM goes to mq_descs[i] rather than interleaved into the FMQ of
+   * OnSessionStarted. They are dropped when the session ends or its audio
+   * configuration changes
+   * @return: false if the FMQs don't match the channels of the session
+   ***/
+  bool OnLocationQueuesStarted(const std::vector<DataMQDesc>& mq_descs);
+
   /***
    * The report function is used to report that the Bluetooth stack has notified
    * the result of startStream or suspendStream, and will invoke
@@ -160,6 +174,12 @@ class BluetoothAudioSession {
    * AudioConfiguration
    ***/
   const AudioConfiguration GetAudioConfig();
+  // Along with the generation of the configuration, see
+  // GetAudioConfigGeneration
+  const AudioConfiguration GetAudioConfig(uint32_t* generation);
+  // Changes whenever the configuration GetAudioConfig returns does, so that
+  // callers can cache what they derive from it
+  uint32_t GetAudioConfigGeneration();
 
   /***
    * The report function is used to report that the Bluetooth stack has notified
@@ -183,6 +203,9 @@ class BluetoothAudioSession {
   bool StartStream(bool low_latency);
   bool SuspendStream();
   void StopStream();
+  // Software sessions answer from a position block published by the data
+  // path, lock-free and without IPC; the remote delay in it is refreshed from
+  // the stack every kRemoteDelayRefreshMs
   bool GetPresentationPosition(PresentationPosition& presentation_position);
   void UpdateSourceMetadata(const struct source_metadata& source_metadata);
   void UpdateSinkMetadata(const struct sink_metadata& sink_metadata);
@@ -195,9 +218,20 @@ class BluetoothAudioSession {
 
   // The control function writes stream to FMQ
   size_t OutWritePcmData(const void* buffer, size_t bytes);
+  // Converts frames of src_frame_size bytes into frames of dst_frame_size
+  // bytes, e.g. to downmix or pick the channels of an audio location
+  using PcmConverter = void (*)(void* dst, const void* src, size_t frames);
+  // The control function converts stream straight into FMQ, returning the
+  // number of source bytes consumed
+  size_t OutWritePcmData(const void* buffer, size_t bytes,
+                         size_t src_frame_size, size_t dst_frame_size,
+                         PcmConverter convert);
   // The control function read stream from FMQ
   size_t InReadPcmData(void* buffer, size_t bytes);
 
+  // Writes the session's state and statistics, e.g. for dumpsys
+  void Dump(int fd);
+
   // Return if IBluetoothAudioProviderFactory implementation existed
   static bool IsAidlAvailable();
 
@@ -210,8 +244,13 @@ class BluetoothAudioSession {
   std::shared_ptr<IBluetoothAudioPort> stack_iface_;
   // audio data path (FMQ) for software encoding
   std::unique_ptr<DataMQ> data_mq_;
+  // one FMQ per audio location, replacing data_mq_ when set, and the size
+  // of the samples in them
+  std::vector<std::unique_ptr<DataMQ>> location_mqs_;
+  size_t location_sample_size_ = 0;
   // audio data configuration for both software and offloading
   std::unique_ptr<AudioConfiguration> audio_config_;
+  uint32_t audio_config_generation_ = 0;
   std::vector<LatencyMode> latency_modes_;
   bool low_latency_allowed_ = true;
 
@@ -219,7 +258,23 @@ class BluetoothAudioSession {
   std::unordered_map<uint16_t, std::shared_ptr<struct PortStatusCallbacks>>
       observers_;
 
+  // position of the software data path, see GetPresentationPosition
+  PresentationPositionBlock position_block_;
+  // octets written into (encoding) or read from (decoding) the FMQ by the
+  // bluetooth_audio module since the data path was set up
+  uint64_t data_mq_octets_ = 0;
+  // last remote delay reported by the stack, negative if none yet
+  int64_t remote_delay_ns_ = -1;
+  // CLOCK_MONOTONIC nanoseconds after which remote_delay_ns_ is refreshed
+  std::atomic<int64_t> remote_delay_expiry_ns_ = 0;
+
+  BluetoothAudioSessionStats stats_;
+
   bool UpdateDataPath(const DataMQDesc* mq_desc);
+  // OutWritePcmData deinterleaving into location_mqs_
+  size_t OutWriteLocationPcmData(const void* buffer, size_t bytes);
+  // publishes data_mq_octets_ corrected by what is still in the FMQ
+  void PublishPresentationPosition();
   bool UpdateAudioConfig(const AudioConfiguration& audio_config);
   // invoking the registered session_changed_cb_
   void ReportSessionStatus();
@@ -237,6 +292,8 @@ class BluetoothAudioSessionInstance {
   // The API is to fetch the specified session of A2DP / Hearing Aid
   static std::shared_ptr<BluetoothAudioSession> GetSessionInstance(
       const SessionType& session_type);
+  // Dumps every session that was instantiated so far
+  static void DumpAll(int fd);
 
  private:
   static std::mutex mutex_;
@@ -210,6 +210,22 @@ class BluetoothAudioSessionControl {
     return 0;
   }
 
+  /***
+   * The control API converts stream straight into FMQ
+   ***/
+  static size_t OutWritePcmData(const SessionType& session_type,
+                                const void* buffer, size_t bytes,
+                                size_t src_frame_size, size_t dst_frame_size,
+                                BluetoothAudioSession::PcmConverter convert) {
+    std::shared_ptr<BluetoothAudioSession> session_ptr =
+        BluetoothAudioSessionInstance::GetSessionInstance(session_type);
+    if (session_ptr != nullptr) {
+      return session_ptr->OutWritePcmData(buffer, bytes, src_frame_size,
+                                          dst_frame_size, convert);
+    }
+    return 0;
+  }
+
   /***
    * The control API reads stream from FMQ
    ***/
@@ -55,6 +55,20 @@ class BluetoothAudioSessionReport {
     }
   }
 
+  /***
+   * The API reports the Bluetooth stack has moved the session onto one FMQ
+   * per audio location
+   ***/
+  static bool OnLocationQueuesStarted(const SessionType& session_type,
+                                      const std::vector<DataMQDesc>& mq_descs) {
+    std::shared_ptr<BluetoothAudioSession> session_ptr =
+        BluetoothAudioSessionInstance::GetSessionInstance(session_type);
+    if (session_ptr != nullptr) {
+      return session_ptr->OnLocationQueuesStarted(mq_descs);
+    }
+    return false;
+  }
+
   /***
    * The API reports the Bluetooth stack has replied the result of startStream
    * or suspendStream, and will inform registered bluetooth_audio outputs
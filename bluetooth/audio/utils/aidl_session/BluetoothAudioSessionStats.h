@@ -0,0 +1,113 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <android-base/stringprintf.h>
+
+#include <atomic>
+#include <cinttypes>
+#include <cstdint>
+#include <string>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace bluetooth {
+namespace audio {
+
+/***
+ * Count, total and worst case of a duration in nanoseconds
+ ***/
+class LatencyStat {
+ public:
+  void Add(int64_t ns) {
+    if (ns < 0) return;
+    count_.fetch_add(1, std::memory_order_relaxed);
+    total_ns_.fetch_add(ns, std::memory_order_relaxed);
+    int64_t max = max_ns_.load(std::memory_order_relaxed);
+    while (ns > max && !max_ns_.compare_exchange_weak(
+                           max, ns, std::memory_order_relaxed)) {
+    }
+    last_ns_.store(ns, std::memory_order_relaxed);
+  }
+
+  std::string ToString() const {
+    uint64_t count = count_.load(std::memory_order_relaxed);
+    int64_t total_ns = total_ns_.load(std::memory_order_relaxed);
+    return ::android::base::StringPrintf(
+        "count=%" PRIu64 " avg=%.3fms max=%.3fms last=%.3fms", count,
+        count ? total_ns / 1e6 / count : 0.0,
+        max_ns_.load(std::memory_order_relaxed) / 1e6,
+        last_ns_.load(std::memory_order_relaxed) / 1e6);
+  }
+
+ private:
+  std::atomic<uint64_t> count_ = 0;
+  std::atomic<int64_t> total_ns_ = 0;
+  std::atomic<int64_t> max_ns_ = 0;
+  std::atomic<int64_t> last_ns_ = 0;
+};
+
+/***
+ * Statistics of a BluetoothAudioSession since the service started. Every
+ * field is updated with relaxed atomics, so the data path pays no more than
+ * an uncontended add, and a dump may read them at any time.
+ ***/
+struct BluetoothAudioSessionStats {
+  // Octets the bluetooth_audio module wrote into / read from the FMQ
+  std::atomic<uint64_t> bytes_written = 0;
+  std::atomic<uint64_t> bytes_read = 0;
+  // Polls that found the FMQ full (encoding) or empty (decoding)
+  std::atomic<uint64_t> fmq_full_events = 0;
+  std::atomic<uint64_t> fmq_empty_events = 0;
+  // Transfers given up after kFmqSendTimeoutMs / kFmqReceiveTimeoutMs
+  std::atomic<uint64_t> fmq_timeouts = 0;
+  // Time the bluetooth_audio module slept waiting on the FMQ
+  std::atomic<int64_t> blocked_ns = 0;
+  // From StartStream / SuspendStream until the stack's ReportControlStatus
+  LatencyStat start_latency;
+  LatencyStat suspend_latency;
+  // session_changed_cb_ fan-out to every port in ReportSessionStatus
+  LatencyStat session_status_fan_out;
+  // CLOCK_MONOTONIC nanoseconds of the pending request, 0 if none
+  std::atomic<int64_t> start_request_ns = 0;
+  std::atomic<int64_t> suspend_request_ns = 0;
+
+  std::string ToString() const {
+    return ::android::base::StringPrintf(
+               "  bytes_written=%" PRIu64 " bytes_read=%" PRIu64 "\n",
+               bytes_written.load(std::memory_order_relaxed),
+               bytes_read.load(std::memory_order_relaxed)) +
+           ::android::base::StringPrintf(
+               "  fmq_full=%" PRIu64 " fmq_empty=%" PRIu64
+               " fmq_timeouts=%" PRIu64 " blocked=%.3fms\n",
+               fmq_full_events.load(std::memory_order_relaxed),
+               fmq_empty_events.load(std::memory_order_relaxed),
+               fmq_timeouts.load(std::memory_order_relaxed),
+               blocked_ns.load(std::memory_order_relaxed) / 1e6) +
+           "  start_latency: " + start_latency.ToString() + "\n" +
+           "  suspend_latency: " + suspend_latency.ToString() + "\n" +
+           "  session_status_fan_out: " + session_status_fan_out.ToString() +
+           "\n";
+  }
+};
+
+}  // namespace audio
+}  // namespace bluetooth
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
@@ -240,21 +240,26 @@ std::map<uint32_t, uint32_t> audio_channel_allocation_map = {
      CodecSpecificConfigurationLtv::AudioChannelAllocation::RIGHT_SURROUND},
 };
 
-static const std::vector<
-    std::pair<const char* /*schema*/, const char* /*content*/>>
-    kLeAudioSetConfigs = {{"/vendor/etc/aidl/le_audio/"
-                           "aidl_audio_set_configurations.bfbs",
-                           "/vendor/etc/aidl/le_audio/"
-                           "aidl_audio_set_configurations.json"}};
-static const std::vector<
-    std::pair<const char* /*schema*/, const char* /*content*/>>
-    kLeAudioSetScenarios = {{"/vendor/etc/aidl/le_audio/"
-                             "aidl_audio_set_scenarios.bfbs",
-                             "/vendor/etc/aidl/le_audio/"
-                             "aidl_audio_set_scenarios.json"}};
+static std::vector<std::pair<const char* /*schema*/, const char* /*content*/>>
+    leAudioSetConfigs = {{"/vendor/etc/aidl/le_audio/"
+                          "aidl_audio_set_configurations.bfbs",
+                          "/vendor/etc/aidl/le_audio/"
+                          "aidl_audio_set_configurations.json"}};
+static std::vector<std::pair<const char* /*schema*/, const char* /*content*/>>
+    leAudioSetScenarios = {{"/vendor/etc/aidl/le_audio/"
+                            "aidl_audio_set_scenarios.bfbs",
+                            "/vendor/etc/aidl/le_audio/"
+                            "aidl_audio_set_scenarios.json"}};
 
 /* Implementation */
 
+void AudioSetConfigurationProviderJson::SetContentFilesForTesting(
+    std::pair<const char*, const char*> config_files,
+    std::pair<const char*, const char*> scenario_files) {
+  leAudioSetConfigs = {config_files};
+  leAudioSetScenarios = {scenario_files};
+}
+
 std::vector<LeAudioAseConfigurationSetting>
 AudioSetConfigurationProviderJson::GetLeAudioAseConfigurationSettings() {
   AudioSetConfigurationProviderJson::LoadAudioSetConfigurationProviderJson();
@@ -266,7 +271,7 @@ void AudioSetConfigurationProviderJson::
   if (configurations_.empty() || ase_configuration_settings_.empty()) {
     ase_configuration_settings_.clear();
     configurations_.clear();
-    auto loaded = LoadContent(kLeAudioSetConfigs, kLeAudioSetScenarios,
+    auto loaded = LoadContent(leAudioSetConfigs, leAudioSetScenarios,
                               CodecLocation::HOST);
     if (!loaded)
       LOG(ERROR) << ": Unable to load le audio set configuration files.";
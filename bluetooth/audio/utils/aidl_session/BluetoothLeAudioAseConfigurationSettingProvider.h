@@ -52,6 +52,12 @@ class AudioSetConfigurationProviderJson {
  public:
   static std::vector<LeAudioAseConfigurationSetting>
   GetLeAudioAseConfigurationSettings();
+  // Loads other schema / content files, e.g. the in-tree ones on host. The
+  // paths have to stay valid until the settings are loaded
+  static void SetContentFilesForTesting(
+      std::pair<const char* /*schema*/, const char* /*content*/> config_files,
+      std::pair<const char* /*schema*/, const char* /*content*/>
+          scenario_files);
 
  private:
   static void LoadAudioSetConfigurationProviderJson();
@@ -29,7 +29,7 @@ namespace hardware {
 namespace bluetooth {
 namespace audio {
 
-static const char* kLeAudioCodecCapabilitiesFile =
+static const char* leAudioCodecCapabilitiesFile =
     "/vendor/etc/le_audio_codec_capabilities.xml";
 
 static const AudioLocation kStereoAudio = static_cast<AudioLocation>(
@@ -41,16 +41,21 @@ static std::vector<LeAudioCodecCapabilitiesSetting> leAudioCodecCapabilities;
 
 static bool isInvalidFileContent = false;
 
+void BluetoothLeAudioCodecsProvider::SetLeAudioOffloadSettingFileForTesting(
+    const char* file) {
+  leAudioCodecCapabilitiesFile = file;
+}
+
 std::optional<setting::LeAudioOffloadSetting>
 BluetoothLeAudioCodecsProvider::ParseFromLeAudioOffloadSettingFile() {
   if (!leAudioCodecCapabilities.empty() || isInvalidFileContent) {
     return std::nullopt;
   }
   auto le_audio_offload_setting =
-      setting::readLeAudioOffloadSetting(kLeAudioCodecCapabilitiesFile);
+      setting::readLeAudioOffloadSetting(leAudioCodecCapabilitiesFile);
   if (!le_audio_offload_setting.has_value()) {
     LOG(ERROR) << __func__ << ": Failed to read "
-               << kLeAudioCodecCapabilitiesFile;
+               << leAudioCodecCapabilitiesFile;
   }
   return le_audio_offload_setting;
 }
@@ -298,28 +303,28 @@ void BluetoothLeAudioCodecsProvider::LoadConfigurationToMap(
   supported_scenarios_ = GetScenarios(le_audio_offload_setting);
   if (supported_scenarios_.empty()) {
     LOG(ERROR) << __func__ << ": No scenarios in "
-               << kLeAudioCodecCapabilitiesFile;
+               << leAudioCodecCapabilitiesFile;
     return;
   }
 
   UpdateConfigurationsToMap(le_audio_offload_setting);
   if (configuration_map_.empty()) {
     LOG(ERROR) << __func__ << ": No configurations in "
-               << kLeAudioCodecCapabilitiesFile;
+               << leAudioCodecCapabilitiesFile;
     return;
   }
 
   UpdateCodecConfigurationsToMap(le_audio_offload_setting);
   if (codec_configuration_map_.empty()) {
     LOG(ERROR) << __func__ << ": No codec configurations in "
-               << kLeAudioCodecCapabilitiesFile;
+               << leAudioCodecCapabilitiesFile;
     return;
   }
 
   UpdateStrategyConfigurationsToMap(le_audio_offload_setting);
   if (strategy_configuration_map_.empty()) {
     LOG(ERROR) << __func__ << ": No strategy configurations in "
-               << kLeAudioCodecCapabilitiesFile;
+               << leAudioCodecCapabilitiesFile;
     return;
   }
 }
@@ -36,6 +36,9 @@ class BluetoothLeAudioCodecsProvider {
  public:
   static std::optional<setting::LeAudioOffloadSetting>
   ParseFromLeAudioOffloadSettingFile();
+  // Parses another file, e.g. the in-tree one on host. The path has to stay
+  // valid until the setting is loaded
+  static void SetLeAudioOffloadSettingFileForTesting(const char* file);
   static std::vector<LeAudioCodecCapabilitiesSetting>
   GetLeAudioCodecCapabilities(
       const std::optional<setting::LeAudioOffloadSetting>&
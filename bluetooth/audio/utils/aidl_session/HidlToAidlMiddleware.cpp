@@ -21,7 +21,9 @@
 #include <aidl/android/hardware/bluetooth/audio/SessionType.h>
 #include <android-base/logging.h>
 
+#include <array>
 #include <functional>
+#include <optional>
 #include <unordered_map>
 
 #include "../aidl_session/BluetoothAudioSession.h"
@@ -87,115 +89,34 @@ std::unordered_map<
     std::unordered_map<uint16_t, std::shared_ptr<PortStatusCallbacks_2_0>>>
     legacy_callback_table;
 
-const static std::unordered_map<SessionType_2_1, SessionType>
-    session_type_2_1_to_aidl_map{
-        {SessionType_2_1::A2DP_SOFTWARE_ENCODING_DATAPATH,
-         SessionType::A2DP_SOFTWARE_ENCODING_DATAPATH},
-        {SessionType_2_1::A2DP_HARDWARE_OFFLOAD_DATAPATH,
-         SessionType::A2DP_HARDWARE_OFFLOAD_ENCODING_DATAPATH},
-        {SessionType_2_1::HEARING_AID_SOFTWARE_ENCODING_DATAPATH,
-         SessionType::HEARING_AID_SOFTWARE_ENCODING_DATAPATH},
-        {SessionType_2_1::LE_AUDIO_SOFTWARE_ENCODING_DATAPATH,
-         SessionType::LE_AUDIO_SOFTWARE_ENCODING_DATAPATH},
-        {SessionType_2_1::LE_AUDIO_SOFTWARE_DECODED_DATAPATH,
-         SessionType::LE_AUDIO_SOFTWARE_DECODING_DATAPATH},
-        {SessionType_2_1::LE_AUDIO_HARDWARE_OFFLOAD_ENCODING_DATAPATH,
-         SessionType::LE_AUDIO_HARDWARE_OFFLOAD_ENCODING_DATAPATH},
-        {SessionType_2_1::LE_AUDIO_HARDWARE_OFFLOAD_DECODING_DATAPATH,
-         SessionType::LE_AUDIO_HARDWARE_OFFLOAD_DECODING_DATAPATH},
-    };
-
-const static std::unordered_map<int32_t, SampleRate_2_1>
-    sample_rate_to_hidl_2_1_map{
-        {44100, SampleRate_2_1::RATE_44100},
-        {48000, SampleRate_2_1::RATE_48000},
-        {88200, SampleRate_2_1::RATE_88200},
-        {96000, SampleRate_2_1::RATE_96000},
-        {176400, SampleRate_2_1::RATE_176400},
-        {192000, SampleRate_2_1::RATE_192000},
-        {16000, SampleRate_2_1::RATE_16000},
-        {24000, SampleRate_2_1::RATE_24000},
-        {8000, SampleRate_2_1::RATE_8000},
-        {32000, SampleRate_2_1::RATE_32000},
-    };
-
-const static std::unordered_map<CodecType, CodecType_2_0>
-    codec_type_to_hidl_2_0_map{
-        {CodecType::UNKNOWN, CodecType_2_0::UNKNOWN},
-        {CodecType::SBC, CodecType_2_0::SBC},
-        {CodecType::AAC, CodecType_2_0::AAC},
-        {CodecType::APTX, CodecType_2_0::APTX},
-        {CodecType::APTX_HD, CodecType_2_0::APTX_HD},
-        {CodecType::LDAC, CodecType_2_0::LDAC},
-        {CodecType::LC3, CodecType_2_0::UNKNOWN},
-    };
-
-const static std::unordered_map<SbcChannelMode, SbcChannelMode_2_0>
-    sbc_channel_mode_to_hidl_2_0_map{
-        {SbcChannelMode::UNKNOWN, SbcChannelMode_2_0::UNKNOWN},
-        {SbcChannelMode::JOINT_STEREO, SbcChannelMode_2_0::JOINT_STEREO},
-        {SbcChannelMode::STEREO, SbcChannelMode_2_0::STEREO},
-        {SbcChannelMode::DUAL, SbcChannelMode_2_0::DUAL},
-        {SbcChannelMode::MONO, SbcChannelMode_2_0::MONO},
-    };
-
-const static std::unordered_map<int8_t, SbcBlockLength_2_0>
-    sbc_block_length_to_hidl_map{
-        {4, SbcBlockLength_2_0::BLOCKS_4},
-        {8, SbcBlockLength_2_0::BLOCKS_8},
-        {12, SbcBlockLength_2_0::BLOCKS_12},
-        {16, SbcBlockLength_2_0::BLOCKS_16},
-    };
-
-const static std::unordered_map<int8_t, SbcNumSubbands_2_0>
-    sbc_subbands_to_hidl_map{
-        {4, SbcNumSubbands_2_0::SUBBAND_4},
-        {8, SbcNumSubbands_2_0::SUBBAND_8},
-    };
-
-const static std::unordered_map<SbcAllocMethod, SbcAllocMethod_2_0>
-    sbc_alloc_method_to_hidl_map{
-        {SbcAllocMethod::ALLOC_MD_S, SbcAllocMethod_2_0::ALLOC_MD_S},
-        {SbcAllocMethod::ALLOC_MD_L, SbcAllocMethod_2_0::ALLOC_MD_L},
-    };
-
-const static std::unordered_map<AacObjectType, AacObjectType_2_0>
-    aac_object_type_to_hidl_map{
-        {AacObjectType::MPEG2_LC, AacObjectType_2_0::MPEG2_LC},
-        {AacObjectType::MPEG4_LC, AacObjectType_2_0::MPEG4_LC},
-        {AacObjectType::MPEG4_LTP, AacObjectType_2_0::MPEG4_LTP},
-        {AacObjectType::MPEG4_SCALABLE, AacObjectType_2_0::MPEG4_SCALABLE},
-    };
-
-const static std::unordered_map<LdacChannelMode, LdacChannelMode_2_0>
-    ldac_channel_mode_to_hidl_map{
-        {LdacChannelMode::UNKNOWN, LdacChannelMode_2_0::UNKNOWN},
-        {LdacChannelMode::STEREO, LdacChannelMode_2_0::STEREO},
-        {LdacChannelMode::DUAL, LdacChannelMode_2_0::DUAL},
-        {LdacChannelMode::MONO, LdacChannelMode_2_0::MONO},
-    };
-
-const static std::unordered_map<LdacQualityIndex, LdacQualityIndex_2_0>
-    ldac_qindex_to_hidl_map{
-        {LdacQualityIndex::HIGH, LdacQualityIndex_2_0::QUALITY_HIGH},
-        {LdacQualityIndex::MID, LdacQualityIndex_2_0::QUALITY_MID},
-        {LdacQualityIndex::LOW, LdacQualityIndex_2_0::QUALITY_LOW},
-        {LdacQualityIndex::ABR, LdacQualityIndex_2_0::QUALITY_ABR},
-    };
-
-inline SessionType from_session_type_2_1(
+constexpr SessionType from_session_type_2_1(
     const SessionType_2_1& session_type_hidl) {
-  auto it = session_type_2_1_to_aidl_map.find(session_type_hidl);
-  if (it != session_type_2_1_to_aidl_map.end()) return it->second;
-  return SessionType::UNKNOWN;
+  switch (session_type_hidl) {
+    case SessionType_2_1::A2DP_SOFTWARE_ENCODING_DATAPATH:
+      return SessionType::A2DP_SOFTWARE_ENCODING_DATAPATH;
+    case SessionType_2_1::A2DP_HARDWARE_OFFLOAD_DATAPATH:
+      return SessionType::A2DP_HARDWARE_OFFLOAD_ENCODING_DATAPATH;
+    case SessionType_2_1::HEARING_AID_SOFTWARE_ENCODING_DATAPATH:
+      return SessionType::HEARING_AID_SOFTWARE_ENCODING_DATAPATH;
+    case SessionType_2_1::LE_AUDIO_SOFTWARE_ENCODING_DATAPATH:
+      return SessionType::LE_AUDIO_SOFTWARE_ENCODING_DATAPATH;
+    case SessionType_2_1::LE_AUDIO_SOFTWARE_DECODED_DATAPATH:
+      return SessionType::LE_AUDIO_SOFTWARE_DECODING_DATAPATH;
+    case SessionType_2_1::LE_AUDIO_HARDWARE_OFFLOAD_ENCODING_DATAPATH:
+      return SessionType::LE_AUDIO_HARDWARE_OFFLOAD_ENCODING_DATAPATH;
+    case SessionType_2_1::LE_AUDIO_HARDWARE_OFFLOAD_DECODING_DATAPATH:
+      return SessionType::LE_AUDIO_HARDWARE_OFFLOAD_DECODING_DATAPATH;
+    default:
+      return SessionType::UNKNOWN;
+  }
 }
 
-inline SessionType from_session_type_2_0(
+constexpr SessionType from_session_type_2_0(
     const SessionType_2_0& session_type_hidl) {
   return from_session_type_2_1(static_cast<SessionType_2_1>(session_type_hidl));
 }
 
-inline HidlStatus to_hidl_status(const BluetoothAudioStatus& status) {
+constexpr HidlStatus to_hidl_status(const BluetoothAudioStatus& status) {
   switch (status) {
     case BluetoothAudioStatus::SUCCESS:
       return HidlStatus::SUCCESS;
@@ -206,20 +127,41 @@ inline HidlStatus to_hidl_status(const BluetoothAudioStatus& status) {
   }
 }
 
-inline SampleRate_2_1 to_hidl_sample_rate_2_1(const int32_t sample_rate_hz) {
-  auto it = sample_rate_to_hidl_2_1_map.find(sample_rate_hz);
-  if (it != sample_rate_to_hidl_2_1_map.end()) return it->second;
-  return SampleRate_2_1::RATE_UNKNOWN;
+constexpr SampleRate_2_1 to_hidl_sample_rate_2_1(
+    const int32_t sample_rate_hz) {
+  switch (sample_rate_hz) {
+    case 44100:
+      return SampleRate_2_1::RATE_44100;
+    case 48000:
+      return SampleRate_2_1::RATE_48000;
+    case 88200:
+      return SampleRate_2_1::RATE_88200;
+    case 96000:
+      return SampleRate_2_1::RATE_96000;
+    case 176400:
+      return SampleRate_2_1::RATE_176400;
+    case 192000:
+      return SampleRate_2_1::RATE_192000;
+    case 16000:
+      return SampleRate_2_1::RATE_16000;
+    case 24000:
+      return SampleRate_2_1::RATE_24000;
+    case 8000:
+      return SampleRate_2_1::RATE_8000;
+    case 32000:
+      return SampleRate_2_1::RATE_32000;
+    default:
+      return SampleRate_2_1::RATE_UNKNOWN;
+  }
 }
 
-inline SampleRate_2_0 to_hidl_sample_rate_2_0(const int32_t sample_rate_hz) {
-  auto it = sample_rate_to_hidl_2_1_map.find(sample_rate_hz);
-  if (it != sample_rate_to_hidl_2_1_map.end())
-    return static_cast<SampleRate_2_0>(it->second);
-  return SampleRate_2_0::RATE_UNKNOWN;
+constexpr SampleRate_2_0 to_hidl_sample_rate_2_0(
+    const int32_t sample_rate_hz) {
+  return static_cast<SampleRate_2_0>(to_hidl_sample_rate_2_1(sample_rate_hz));
 }
 
-inline BitsPerSample_2_0 to_hidl_bits_per_sample(const int8_t bit_per_sample) {
+constexpr BitsPerSample_2_0 to_hidl_bits_per_sample(
+    const int8_t bit_per_sample) {
   switch (bit_per_sample) {
     case 16:
       return BitsPerSample_2_0::BITS_16;
@@ -232,7 +174,7 @@ inline BitsPerSample_2_0 to_hidl_bits_per_sample(const int8_t bit_per_sample) {
   }
 }
 
-inline ChannelMode_2_0 to_hidl_channel_mode(const ChannelMode channel_mode) {
+constexpr ChannelMode_2_0 to_hidl_channel_mode(const ChannelMode channel_mode) {
   switch (channel_mode) {
     case ChannelMode::MONO:
       return ChannelMode_2_0::MONO;
@@ -253,10 +195,123 @@ inline PcmConfig_2_0 to_hidl_pcm_config_2_0(
   return hidl_pcm_config;
 }
 
-inline CodecType_2_0 to_hidl_codec_type_2_0(const CodecType codec_type) {
-  auto it = codec_type_to_hidl_2_0_map.find(codec_type);
-  if (it != codec_type_to_hidl_2_0_map.end()) return it->second;
-  return CodecType_2_0::UNKNOWN;
+constexpr CodecType_2_0 to_hidl_codec_type_2_0(const CodecType codec_type) {
+  switch (codec_type) {
+    case CodecType::SBC:
+      return CodecType_2_0::SBC;
+    case CodecType::AAC:
+      return CodecType_2_0::AAC;
+    case CodecType::APTX:
+      return CodecType_2_0::APTX;
+    case CodecType::APTX_HD:
+      return CodecType_2_0::APTX_HD;
+    case CodecType::LDAC:
+      return CodecType_2_0::LDAC;
+    default:
+      return CodecType_2_0::UNKNOWN;
+  }
+}
+
+constexpr SbcChannelMode_2_0 to_hidl_sbc_channel_mode(
+    const SbcChannelMode channel_mode) {
+  switch (channel_mode) {
+    case SbcChannelMode::JOINT_STEREO:
+      return SbcChannelMode_2_0::JOINT_STEREO;
+    case SbcChannelMode::STEREO:
+      return SbcChannelMode_2_0::STEREO;
+    case SbcChannelMode::DUAL:
+      return SbcChannelMode_2_0::DUAL;
+    case SbcChannelMode::MONO:
+      return SbcChannelMode_2_0::MONO;
+    default:
+      return SbcChannelMode_2_0::UNKNOWN;
+  }
+}
+
+constexpr std::optional<SbcBlockLength_2_0> to_hidl_sbc_block_length(
+    const int8_t block_length) {
+  switch (block_length) {
+    case 4:
+      return SbcBlockLength_2_0::BLOCKS_4;
+    case 8:
+      return SbcBlockLength_2_0::BLOCKS_8;
+    case 12:
+      return SbcBlockLength_2_0::BLOCKS_12;
+    case 16:
+      return SbcBlockLength_2_0::BLOCKS_16;
+    default:
+      return std::nullopt;
+  }
+}
+
+constexpr std::optional<SbcNumSubbands_2_0> to_hidl_sbc_subbands(
+    const int8_t num_subbands) {
+  switch (num_subbands) {
+    case 4:
+      return SbcNumSubbands_2_0::SUBBAND_4;
+    case 8:
+      return SbcNumSubbands_2_0::SUBBAND_8;
+    default:
+      return std::nullopt;
+  }
+}
+
+constexpr std::optional<SbcAllocMethod_2_0> to_hidl_sbc_alloc_method(
+    const SbcAllocMethod alloc_method) {
+  switch (alloc_method) {
+    case SbcAllocMethod::ALLOC_MD_S:
+      return SbcAllocMethod_2_0::ALLOC_MD_S;
+    case SbcAllocMethod::ALLOC_MD_L:
+      return SbcAllocMethod_2_0::ALLOC_MD_L;
+    default:
+      return std::nullopt;
+  }
+}
+
+constexpr std::optional<AacObjectType_2_0> to_hidl_aac_object_type(
+    const AacObjectType object_type) {
+  switch (object_type) {
+    case AacObjectType::MPEG2_LC:
+      return AacObjectType_2_0::MPEG2_LC;
+    case AacObjectType::MPEG4_LC:
+      return AacObjectType_2_0::MPEG4_LC;
+    case AacObjectType::MPEG4_LTP:
+      return AacObjectType_2_0::MPEG4_LTP;
+    case AacObjectType::MPEG4_SCALABLE:
+      return AacObjectType_2_0::MPEG4_SCALABLE;
+    default:
+      return std::nullopt;
+  }
+}
+
+constexpr LdacChannelMode_2_0 to_hidl_ldac_channel_mode(
+    const LdacChannelMode channel_mode) {
+  switch (channel_mode) {
+    case LdacChannelMode::STEREO:
+      return LdacChannelMode_2_0::STEREO;
+    case LdacChannelMode::DUAL:
+      return LdacChannelMode_2_0::DUAL;
+    case LdacChannelMode::MONO:
+      return LdacChannelMode_2_0::MONO;
+    default:
+      return LdacChannelMode_2_0::UNKNOWN;
+  }
+}
+
+constexpr std::optional<LdacQualityIndex_2_0> to_hidl_ldac_quality_index(
+    const LdacQualityIndex quality_index) {
+  switch (quality_index) {
+    case LdacQualityIndex::HIGH:
+      return LdacQualityIndex_2_0::QUALITY_HIGH;
+    case LdacQualityIndex::MID:
+      return LdacQualityIndex_2_0::QUALITY_MID;
+    case LdacQualityIndex::LOW:
+      return LdacQualityIndex_2_0::QUALITY_LOW;
+    case LdacQualityIndex::ABR:
+      return LdacQualityIndex_2_0::QUALITY_ABR;
+    default:
+      return std::nullopt;
+  }
 }
 
 inline SbcConfig_2_0 to_hidl_sbc_config(const SbcConfiguration sbc_config) {
@@ -266,26 +321,14 @@ inline SbcConfig_2_0 to_hidl_sbc_config(const SbcConfiguration sbc_config) {
   hidl_sbc_config.sampleRate = to_hidl_sample_rate_2_0(sbc_config.sampleRateHz);
   hidl_sbc_config.bitsPerSample =
       to_hidl_bits_per_sample(sbc_config.bitsPerSample);
-  if (sbc_channel_mode_to_hidl_2_0_map.find(sbc_config.channelMode) !=
-      sbc_channel_mode_to_hidl_2_0_map.end()) {
-    hidl_sbc_config.channelMode =
-        sbc_channel_mode_to_hidl_2_0_map.at(sbc_config.channelMode);
-  }
-  if (sbc_block_length_to_hidl_map.find(sbc_config.blockLength) !=
-      sbc_block_length_to_hidl_map.end()) {
-    hidl_sbc_config.blockLength =
-        sbc_block_length_to_hidl_map.at(sbc_config.blockLength);
-  }
-  if (sbc_subbands_to_hidl_map.find(sbc_config.numSubbands) !=
-      sbc_subbands_to_hidl_map.end()) {
-    hidl_sbc_config.numSubbands =
-        sbc_subbands_to_hidl_map.at(sbc_config.numSubbands);
-  }
-  if (sbc_alloc_method_to_hidl_map.find(sbc_config.allocMethod) !=
-      sbc_alloc_method_to_hidl_map.end()) {
-    hidl_sbc_config.allocMethod =
-        sbc_alloc_method_to_hidl_map.at(sbc_config.allocMethod);
-  }
+  hidl_sbc_config.channelMode =
+      to_hidl_sbc_channel_mode(sbc_config.channelMode);
+  if (auto block_length = to_hidl_sbc_block_length(sbc_config.blockLength))
+    hidl_sbc_config.blockLength = *block_length;
+  if (auto subbands = to_hidl_sbc_subbands(sbc_config.numSubbands))
+    hidl_sbc_config.numSubbands = *subbands;
+  if (auto alloc_method = to_hidl_sbc_alloc_method(sbc_config.allocMethod))
+    hidl_sbc_config.allocMethod = *alloc_method;
   return hidl_sbc_config;
 }
 
@@ -295,11 +338,8 @@ inline AacConfig_2_0 to_hidl_aac_config(const AacConfiguration aac_config) {
   hidl_aac_config.bitsPerSample =
       to_hidl_bits_per_sample(aac_config.bitsPerSample);
   hidl_aac_config.channelMode = to_hidl_channel_mode(aac_config.channelMode);
-  if (aac_object_type_to_hidl_map.find(aac_config.objectType) !=
-      aac_object_type_to_hidl_map.end()) {
-    hidl_aac_config.objectType =
-        aac_object_type_to_hidl_map.at(aac_config.objectType);
-  }
+  if (auto object_type = to_hidl_aac_object_type(aac_config.objectType))
+    hidl_aac_config.objectType = *object_type;
   hidl_aac_config.variableBitRateEnabled = aac_config.variableBitRateEnabled
                                                ? AacVarBitRate_2_0::ENABLED
                                                : AacVarBitRate_2_0::DISABLED;
@@ -312,16 +352,10 @@ inline LdacConfig_2_0 to_hidl_ldac_config(const LdacConfiguration ldac_config) {
       to_hidl_sample_rate_2_0(ldac_config.sampleRateHz);
   hidl_ldac_config.bitsPerSample =
       to_hidl_bits_per_sample(ldac_config.bitsPerSample);
-  if (ldac_channel_mode_to_hidl_map.find(ldac_config.channelMode) !=
-      ldac_channel_mode_to_hidl_map.end()) {
-    hidl_ldac_config.channelMode =
-        ldac_channel_mode_to_hidl_map.at(ldac_config.channelMode);
-  }
-  if (ldac_qindex_to_hidl_map.find(ldac_config.qualityIndex) !=
-      ldac_qindex_to_hidl_map.end()) {
-    hidl_ldac_config.qualityIndex =
-        ldac_qindex_to_hidl_map.at(ldac_config.qualityIndex);
-  }
+  hidl_ldac_config.channelMode =
+      to_hidl_ldac_channel_mode(ldac_config.channelMode);
+  if (auto quality_index = to_hidl_ldac_quality_index(ldac_config.qualityIndex))
+    hidl_ldac_config.qualityIndex = *quality_index;
   return hidl_ldac_config;
 }
 
@@ -401,9 +435,9 @@ inline Lc3Config_2_1 to_hidl_lc3_config_2_1(
   hidl_lc3_config.pcmBitDepth = to_hidl_bits_per_sample(lc3_config.pcmBitDepth);
   hidl_lc3_config.samplingFrequency =
       to_hidl_sample_rate_2_1(lc3_config.samplingFrequencyHz);
-  if (lc3_config.samplingFrequencyHz == 10000)
+  if (lc3_config.frameDurationUs == 10000)
     hidl_lc3_config.frameDuration = Lc3FrameDuration_2_1::DURATION_10000US;
-  else if (lc3_config.samplingFrequencyHz == 7500)
+  else if (lc3_config.frameDurationUs == 7500)
     hidl_lc3_config.frameDuration = Lc3FrameDuration_2_1::DURATION_7500US;
   hidl_lc3_config.octetsPerFrame =
       static_cast<uint32_t>(lc3_config.octetsPerFrame);
@@ -416,7 +450,7 @@ inline Lc3CodecConfig_2_1 to_hidl_leaudio_config_2_1(
   Lc3CodecConfig_2_1 hidl_lc3_codec_config = {
       .audioChannelAllocation = 0,
   };
-  if (unicast_config.leAudioCodecConfig.getTag() ==
+  if (unicast_config.leAudioCodecConfig.getTag() !=
       LeAudioCodecConfiguration::lc3Config) {
     LOG(FATAL) << __func__ << ": unexpected codec type(vendor?)";
   }
@@ -483,6 +517,61 @@ inline AudioConfig_2_1 to_hidl_audio_config_2_1(
   return hidl_audio_config;
 }
 
+/* Per session type state shared by the HIDL clients: the session used by
+ * the data path, and the audio configuration last converted for each HIDL
+ * version, along with the generation of the session's configuration it was
+ * converted from */
+struct LegacySessionCache {
+  std::once_flag init_flag;
+  std::shared_ptr<BluetoothAudioSession> session;
+  std::mutex lock;
+  std::optional<std::pair<uint32_t, AudioConfig_2_0>> audio_config_2_0;
+  std::optional<std::pair<uint32_t, AudioConfig_2_1>> audio_config_2_1;
+};
+
+static constexpr size_t kLegacySessionCacheSize = 32;
+
+static LegacySessionCache* GetLegacySessionCache(
+    const SessionType& session_type) {
+  static std::array<LegacySessionCache, kLegacySessionCacheSize> caches;
+  auto index = static_cast<size_t>(session_type);
+  if (session_type == SessionType::UNKNOWN || index >= caches.size())
+    return nullptr;
+
+  auto& cache = caches[index];
+  std::call_once(cache.init_flag, [&cache, &session_type]() {
+    cache.session =
+        BluetoothAudioSessionInstance::GetSessionInstance(session_type);
+  });
+  return &cache;
+}
+
+template <typename AudioConfig>
+static AudioConfig GetCachedAudioConfig(
+    const SessionType& session_type,
+    std::optional<std::pair<uint32_t, AudioConfig>> LegacySessionCache::*slot,
+    AudioConfig (*convert)(const AudioConfiguration&)) {
+  auto cache = GetLegacySessionCache(session_type);
+  if (cache == nullptr)
+    return convert(BluetoothAudioSessionControl::GetAudioConfig(session_type));
+
+  uint32_t generation = cache->session->GetAudioConfigGeneration();
+  {
+    std::lock_guard<std::mutex> guard(cache->lock);
+    auto& cached = cache->*slot;
+    if (cached && cached->first == generation) return cached->second;
+  }
+
+  // The configuration comes with its own generation, a change since the
+  // check above only costs another refresh
+  AudioConfig audio_config =
+      convert(cache->session->GetAudioConfig(&generation));
+
+  std::lock_guard<std::mutex> guard(cache->lock);
+  cache->*slot = std::make_pair(generation, audio_config);
+  return audio_config;
+}
+
 /***
  *
  * 2.0
@@ -554,8 +643,9 @@ void HidlToAidlMiddleware_2_0::UnregisterControlResultCback(
 
 const AudioConfig_2_0 HidlToAidlMiddleware_2_0::GetAudioConfig(
     const SessionType_2_0& session_type) {
-  return to_hidl_audio_config_2_0(BluetoothAudioSessionControl::GetAudioConfig(
-      from_session_type_2_0(session_type)));
+  return GetCachedAudioConfig(from_session_type_2_0(session_type),
+                              &LegacySessionCache::audio_config_2_0,
+                              to_hidl_audio_config_2_0);
 }
 
 bool HidlToAidlMiddleware_2_0::StartStream(
@@ -603,14 +693,14 @@ void HidlToAidlMiddleware_2_0::UpdateTracksMetadata(
 
 size_t HidlToAidlMiddleware_2_0::OutWritePcmData(
     const SessionType_2_0& session_type, const void* buffer, size_t bytes) {
-  return BluetoothAudioSessionControl::OutWritePcmData(
-      from_session_type_2_0(session_type), buffer, bytes);
+  auto cache = GetLegacySessionCache(from_session_type_2_0(session_type));
+  return cache ? cache->session->OutWritePcmData(buffer, bytes) : 0;
 }
 
 size_t HidlToAidlMiddleware_2_0::InReadPcmData(
     const SessionType_2_0& session_type, void* buffer, size_t bytes) {
-  return BluetoothAudioSessionControl::InReadPcmData(
-      from_session_type_2_0(session_type), buffer, bytes);
+  auto cache = GetLegacySessionCache(from_session_type_2_0(session_type));
+  return cache ? cache->session->InReadPcmData(buffer, bytes) : 0;
 }
 
 bool HidlToAidlMiddleware_2_0::IsAidlAvailable() {
@@ -625,8 +715,9 @@ bool HidlToAidlMiddleware_2_0::IsAidlAvailable() {
 
 const AudioConfig_2_1 HidlToAidlMiddleware_2_1::GetAudioConfig(
     const SessionType_2_1& session_type) {
-  return to_hidl_audio_config_2_1(BluetoothAudioSessionControl::GetAudioConfig(
-      from_session_type_2_1(session_type)));
+  return GetCachedAudioConfig(from_session_type_2_1(session_type),
+                              &LegacySessionCache::audio_config_2_1,
+                              to_hidl_audio_config_2_1);
 }
 
 }  // namespace audio
@@ -0,0 +1,94 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <aidl/android/hardware/bluetooth/audio/PresentationPosition.h>
+
+#include <atomic>
+#include <cstdint>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace bluetooth {
+namespace audio {
+
+/***
+ * A seqlock protected PresentationPosition. It is published by a single
+ * writer (callers serialize Publish / Reset) and read lock-free by any number
+ * of readers. It only holds lock-free atomics, so it may as well be placed in
+ * memory shared with another process.
+ ***/
+class PresentationPositionBlock {
+ public:
+  void Publish(const PresentationPosition& position) {
+    Write(true, position);
+  }
+
+  // Invalidates the block until the next Publish
+  void Reset() { Write(false, PresentationPosition{}); }
+
+  // Returns false if nothing was published since the last Reset
+  bool Read(PresentationPosition& position) const {
+    uint32_t begin, end;
+    bool valid;
+    do {
+      begin = sequence_.load(std::memory_order_acquire);
+      valid = valid_.load(std::memory_order_relaxed);
+      position.remoteDeviceAudioDelayNanos =
+          remote_delay_ns_.load(std::memory_order_relaxed);
+      position.transmittedOctets = octets_.load(std::memory_order_relaxed);
+      position.transmittedOctetsTimestamp.tvSec =
+          timestamp_sec_.load(std::memory_order_relaxed);
+      position.transmittedOctetsTimestamp.tvNSec =
+          timestamp_nsec_.load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      end = sequence_.load(std::memory_order_relaxed);
+    } while ((begin & 1) || begin != end);
+    return valid;
+  }
+
+ private:
+  void Write(bool valid, const PresentationPosition& position) {
+    uint32_t sequence = sequence_.load(std::memory_order_relaxed);
+    sequence_.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    valid_.store(valid, std::memory_order_relaxed);
+    remote_delay_ns_.store(position.remoteDeviceAudioDelayNanos,
+                           std::memory_order_relaxed);
+    octets_.store(position.transmittedOctets, std::memory_order_relaxed);
+    timestamp_sec_.store(position.transmittedOctetsTimestamp.tvSec,
+                         std::memory_order_relaxed);
+    timestamp_nsec_.store(position.transmittedOctetsTimestamp.tvNSec,
+                          std::memory_order_relaxed);
+    sequence_.store(sequence + 2, std::memory_order_release);
+  }
+
+  // Odd while a write is in progress
+  std::atomic<uint32_t> sequence_ = 0;
+  std::atomic<bool> valid_ = false;
+  std::atomic<int64_t> remote_delay_ns_ = 0;
+  std::atomic<int64_t> octets_ = 0;
+  std::atomic<int64_t> timestamp_sec_ = 0;
+  std::atomic<int64_t> timestamp_nsec_ = 0;
+};
+
+}  // namespace audio
+}  // namespace bluetooth
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
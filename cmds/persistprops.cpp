@@ -1,55 +1,254 @@
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <getopt.h>
+#include <libgen.h>
+#include <string.h>
 #include <unistd.h>
 
 #include "device/phh/treble/cmds/persistent_properties.pb.h"
-#include <algorithm>
 #include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
-int main(int argc, char **argv) {
-	int fd = open("persistent_properties", O_RDWR);
-	off_t size = lseek(fd, 0, SEEK_END);
-	lseek(fd, 0, SEEK_SET);
-	char *data = (char*) malloc(size);
-	int ret = read(fd, data, size);
+// Edits init's persistent_properties in one parse and one write, however
+// many properties change:
+//   persistprops [-f file] [-q] [-g prop]... [-s prop=value]... [-d prop]... [-i]
+// -i reads more operations from stdin, one per line: "set prop=value" or
+// "del prop". Without any operation, all properties get printed, as
+// "persistprops prop value" also does before setting one.
 
-	PersistentProperties props;
-	bool parsed = props.ParseFromArray(data, size);
-	std::cout << "Currently has " << props.properties_size() << " props." << std::endl;
-	for(auto prop: props.properties()) {
-		std::cout << prop.name() << ":" << prop.value() << std::endl;
+class Properties {
+public:
+	bool load(const std::string& path) {
+		int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if(fd == -1) {
+			// Nothing persisted yet, the first set creates it
+			if(errno == ENOENT) return true;
+			std::cerr << "Can't open " << path << ": " << strerror(errno) << std::endl;
+			return false;
+		}
+		std::string data;
+		char buf[65536];
+		ssize_t ret;
+		while((ret = read(fd, buf, sizeof(buf))) > 0)
+			data.append(buf, ret);
+		close(fd);
+		if(ret == -1 || !props.ParseFromString(data)) {
+			std::cerr << "Can't parse " << path << std::endl;
+			return false;
+		}
+		for(int i = 0; i < props.properties_size(); i++)
+			index[props.properties(i).name()] = i;
+		removed.assign(props.properties_size(), false);
+		return true;
+	}
+
+	const std::string *get(const std::string& name) const {
+		auto it = index.find(name);
+		if(it == index.end()) return nullptr;
+		return &props.properties(it->second).value();
+	}
+
+	void set(const std::string& name, const std::string& value) {
+		auto it = index.find(name);
+		if(it != index.end()) {
+			auto *record = props.mutable_properties(it->second);
+			if(record->value() == value) return;
+			record->set_value(value);
+		} else {
+			auto *record = props.add_properties();
+			record->set_name(name);
+			record->set_value(value);
+			index[name] = props.properties_size() - 1;
+			removed.push_back(false);
+		}
+		dirty = true;
 	}
 
-	if(argc == 1) {
+	bool remove(const std::string& name) {
+		auto it = index.find(name);
+		if(it == index.end()) return false;
+		removed[it->second] = true;
+		index.erase(it);
+		dirty = true;
+		return true;
+	}
+
+	void dump() const {
+		std::cout << "Currently has " << props.properties_size() << " props." << std::endl;
+		for(auto prop: props.properties()) {
+			std::cout << prop.name() << ":" << prop.value() << std::endl;
+		}
+	}
+
+	// Written next to the file and renamed over it, as init does, so a
+	// crash leaves either the old or the new properties
+	bool save(const std::string& path) {
+		if(!dirty) return true;
+		compact();
+		std::string data;
+		if(!props.SerializeToString(&data)) {
+			std::cerr << "Can't serialize properties" << std::endl;
+			return false;
+		}
+
+		std::string tmp = path + ".tmp";
+		struct stat sb;
+		bool existed = stat(path.c_str(), &sb) == 0;
+		int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+		if(fd == -1) {
+			std::cerr << "Can't open " << tmp << ": " << strerror(errno) << std::endl;
+			return false;
+		}
+		bool ok = true;
+		for(size_t off = 0; ok && off < data.size();) {
+			ssize_t ret = write(fd, data.data() + off, data.size() - off);
+			if(ret == -1 && errno == EINTR) continue;
+			if(ret <= 0) ok = false;
+			else off += ret;
+		}
+		if(ok && existed) {
+			ok = fchmod(fd, sb.st_mode & 07777) == 0 && fchown(fd, sb.st_uid, sb.st_gid) == 0;
+		}
+		ok = ok && fsync(fd) == 0;
 		close(fd);
-		return 0;
+		if(!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+			std::cerr << "Can't write " << path << ": " << strerror(errno) << std::endl;
+			unlink(tmp.c_str());
+			return false;
+		}
+
+		// Persist the rename itself
+		std::string dir = path;
+		int dirFd = open(dirname(&dir[0]), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		if(dirFd != -1) {
+			fsync(dirFd);
+			close(dirFd);
+		}
+		return true;
+	}
+
+private:
+	// Drops the removed records, keeping the others in order
+	void compact() {
+		auto *p = props.mutable_properties();
+		int kept = 0;
+		for(int i = 0; i < p->size(); i++) {
+			if(removed[i]) continue;
+			if(i != kept) p->SwapElements(i, kept);
+			kept++;
+		}
+		p->DeleteSubrange(kept, p->size() - kept);
+		removed.assign(kept, false);
 	}
-	if(argc != 3) {
-		std::cout << "Usage: " << argv[0] << " [prop value]" << std::endl;
+
+	PersistentProperties props;
+	std::unordered_map<std::string, int> index;
+	std::vector<bool> removed;
+	bool dirty = false;
+};
+
+bool parseSet(const std::string& op, std::string *name, std::string *value) {
+	size_t eq = op.find('=');
+	if(eq == std::string::npos || eq == 0) return false;
+	*name = op.substr(0, eq);
+	*value = op.substr(eq + 1);
+	return true;
+}
+
+void usage(const char *self) {
+	std::cout << "Usage: " << self << " [-f file] [-q] [-g prop]... [-s prop=value]... [-d prop]... [-i]" << std::endl;
+	std::cout << "       " << self << " [prop value]" << std::endl;
+}
+
+int main(int argc, char **argv) {
+	std::string path = "persistent_properties";
+	bool quiet = false;
+	bool fromStdin = false;
+	// Applied in order, after the file got loaded
+	std::vector<std::pair<char, std::string>> ops;
+	int c;
+	while((c = getopt(argc, argv, "f:qg:s:d:i")) != -1) {
+		switch(c) {
+			case 'f':
+				path = optarg;
+				break;
+			case 'q':
+				quiet = true;
+				break;
+			case 'i':
+				fromStdin = true;
+				break;
+			case 'g':
+			case 's':
+			case 'd':
+				ops.emplace_back(c, optarg);
+				break;
+			default:
+				usage(argv[0]);
+				return -1;
+		}
+	}
+
+	bool legacySet = false;
+	if(argc - optind == 2) {
+		ops.emplace_back('s', std::string(argv[optind]) + "=" + argv[optind + 1]);
+		legacySet = true;
+	} else if(argc != optind) {
+		usage(argv[0]);
 		return -1;
 	}
 
-	std::string property(argv[1]);
-	std::string value(argv[2]);
-
-	auto p = props.mutable_properties();
-	auto it = std::find_if(p->begin(), p->end(), [=](const auto& v) { return v.name() == property; });
-	if(it == p->end()) {
-		std::cout << "Property not found, adding it" << std::endl;
-		auto *record = p->Add();;
-		record->set_name(property);
-		record->set_value(value);
-	} else {
-		std::cout << "Property found, replacing it" << std::endl;
-		it->set_value(value);
-	}
-
-	size_t write_size = props.ByteSize();
-	char *write_buffer = (char*) malloc(write_size);
-	props.SerializeToArray(write_buffer, write_size);
-	ftruncate(fd, 0);
-	lseek(fd, 0, SEEK_SET);
-	write(fd, write_buffer, write_size);
-	close(fd);
+	Properties props;
+	if(!props.load(path)) return -1;
+	if(!quiet && (legacySet || (ops.empty() && !fromStdin)))
+		props.dump();
+
+	if(fromStdin) {
+		std::string line;
+		while(std::getline(std::cin, line)) {
+			if(line.empty() || line[0] == '#') continue;
+			if(line.compare(0, 4, "set ") == 0) {
+				ops.emplace_back('s', line.substr(4));
+			} else if(line.compare(0, 4, "del ") == 0) {
+				ops.emplace_back('d', line.substr(4));
+			} else {
+				std::cerr << "Bad operation: " << line << std::endl;
+				return -1;
+			}
+		}
+	}
+
+	// Exit status of the queries: 1 if one of them isn't set
+	int ret = 0;
+	for(const auto& op: ops) {
+		std::string name, value;
+		switch(op.first) {
+			case 'g':
+				if(auto *v = props.get(op.second)) {
+					std::cout << *v << std::endl;
+				} else {
+					ret = 1;
+				}
+				break;
+			case 's':
+				if(!parseSet(op.second, &name, &value)) {
+					std::cerr << "Expected prop=value, got " << op.second << std::endl;
+					return -1;
+				}
+				if(legacySet && !quiet)
+					std::cout << (props.get(name) ? "Property found, replacing it" : "Property not found, adding it") << std::endl;
+				props.set(name, value);
+				break;
+			case 'd':
+				props.remove(op.second);
+				break;
+		}
+	}
+
+	if(!props.save(path)) return -1;
+	return ret;
 }
@@ -0,0 +1,176 @@
+#pragma once
+/* RAW chunk copy engine of simg2img_simple, in a header so that the host
+ * benchmark runs the very same code.
+ *
+ * A reader thread fills a ring of depth buffers from the input while the
+ * caller writes them out, so reading the pipe (usually xz) overlaps with
+ * writing the device. Buffers are page aligned: on a block device, writes
+ * whose offset and length are aligned go through an O_DIRECT alias of the
+ * output, bypassing the page cache. */
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define COPY_BUF_SZ	(1024*1024)
+#define COPY_ALIGN	4096
+#define COPY_MAX_DEPTH	64
+
+typedef uint32_t (*copy_crc_fn)(uint32_t crc, const uint8_t *p, size_t len);
+
+struct copy_engine {
+	int in_fd;
+	int out_fd;
+	int seekable;	/* out_fd takes pwrite() at pos, else write() */
+	int direct_fd;	/* O_DIRECT alias of out_fd, -1 if none */
+	unsigned depth;	/* buffers in flight, 1 to COPY_MAX_DEPTH */
+	char *bufs;	/* depth buffers of COPY_BUF_SZ */
+	copy_crc_fn crc;	/* null unless the data is checksummed */
+	uint32_t crc_reg;
+
+	/* Ring of one copy: the reader fills [tail, head), the writer drains it */
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	size_t lens[COPY_MAX_DEPTH];
+	uint64_t head;
+	uint64_t tail;
+	uint64_t remaining;	/* still to be read */
+	int read_failed;
+};
+
+static inline int copy_engine_init(struct copy_engine *e, int in_fd, int out_fd,
+		int seekable, unsigned depth) {
+	memset(e, 0, sizeof(*e));
+	e->in_fd = in_fd;
+	e->out_fd = out_fd;
+	e->seekable = seekable;
+	e->direct_fd = -1;
+	e->depth = depth < 1 ? 1 : depth > COPY_MAX_DEPTH ? COPY_MAX_DEPTH : depth;
+	void *bufs;
+	if(posix_memalign(&bufs, COPY_ALIGN, (size_t)e->depth * COPY_BUF_SZ) != 0)
+		return -1;
+	e->bufs = (char *)bufs;
+	pthread_mutex_init(&e->lock, NULL);
+	pthread_cond_init(&e->cond, NULL);
+	return 0;
+}
+
+/* Opens the O_DIRECT alias, only worth it for block devices */
+static inline void copy_engine_enable_direct(struct copy_engine *e) {
+	char path[32];
+	snprintf(path, sizeof(path), "/proc/self/fd/%d", e->out_fd);
+	e->direct_fd = open(path, O_WRONLY | O_DIRECT | O_CLOEXEC);
+}
+
+static inline ssize_t copy_read(int fd, char *buf, size_t len) {
+	size_t done = 0;
+	while(done < len) {
+		ssize_t res = read(fd, buf + done, len - done);
+		if(res == -1 && errno == EINTR) continue;
+		if(res <= 0) return -1;
+		done += res;
+	}
+	return done;
+}
+
+static inline void copy_write(struct copy_engine *e, const char *buf, size_t len,
+		uint64_t pos) {
+	while(len) {
+		ssize_t res;
+		if(e->direct_fd != -1 && pos % COPY_ALIGN == 0 && len % COPY_ALIGN == 0) {
+			res = pwrite(e->direct_fd, buf, len, pos);
+			if(res == -1 && errno == EINVAL) {
+				/* The device or its driver won't take direct I/O after all */
+				close(e->direct_fd);
+				e->direct_fd = -1;
+				continue;
+			}
+		} else if(e->seekable) {
+			res = pwrite(e->out_fd, buf, len, pos);
+		} else {
+			res = write(e->out_fd, buf, len);
+		}
+		if(res == -1 && errno == EINTR) continue;
+		if(res <= 0) exit(114);
+		buf += res;
+		len -= res;
+		pos += res;
+	}
+}
+
+static inline void *copy_reader(void *arg) {
+	struct copy_engine *e = (struct copy_engine *)arg;
+	pthread_mutex_lock(&e->lock);
+	while(e->remaining) {
+		while(e->head - e->tail == e->depth)
+			pthread_cond_wait(&e->cond, &e->lock);
+		size_t n = e->remaining < COPY_BUF_SZ ? e->remaining : COPY_BUF_SZ;
+		char *buf = e->bufs + (e->head % e->depth) * COPY_BUF_SZ;
+		pthread_mutex_unlock(&e->lock);
+
+		int failed = copy_read(e->in_fd, buf, n) < 0;
+		if(!failed && e->crc)
+			e->crc_reg = e->crc(e->crc_reg, (const uint8_t *)buf, n);
+
+		pthread_mutex_lock(&e->lock);
+		if(failed) {
+			e->read_failed = 1;
+			pthread_cond_broadcast(&e->cond);
+			break;
+		}
+		e->lens[e->head % e->depth] = n;
+		e->head++;
+		e->remaining -= n;
+		pthread_cond_broadcast(&e->cond);
+	}
+	pthread_mutex_unlock(&e->lock);
+	return NULL;
+}
+
+/* Copies count bytes from in_fd to out_fd, at pos if it is seekable. Exits
+ * with 112 on a short input and 114 on a failed write, as nsendfile() */
+static inline void copy_engine_run(struct copy_engine *e, uint64_t count,
+		uint64_t pos) {
+	/* Not worth a thread, or nothing to overlap with */
+	if(e->depth == 1 || count <= COPY_BUF_SZ) {
+		while(count) {
+			size_t n = count < COPY_BUF_SZ ? count : COPY_BUF_SZ;
+			if(copy_read(e->in_fd, e->bufs, n) < 0) exit(112);
+			if(e->crc) e->crc_reg = e->crc(e->crc_reg, (const uint8_t *)e->bufs, n);
+			copy_write(e, e->bufs, n, pos);
+			count -= n;
+			pos += n;
+		}
+		return;
+	}
+
+	e->head = e->tail = 0;
+	e->remaining = count;
+	e->read_failed = 0;
+	pthread_t reader;
+	if(pthread_create(&reader, NULL, copy_reader, e) != 0) exit(113);
+	pthread_mutex_lock(&e->lock);
+	while(count) {
+		while(e->head == e->tail && !e->read_failed)
+			pthread_cond_wait(&e->cond, &e->lock);
+		if(e->head == e->tail) break;
+		size_t slot = e->tail % e->depth;
+		size_t n = e->lens[slot];
+		pthread_mutex_unlock(&e->lock);
+
+		copy_write(e, e->bufs + slot * COPY_BUF_SZ, n, pos);
+		count -= n;
+		pos += n;
+
+		pthread_mutex_lock(&e->lock);
+		e->tail++;
+		pthread_cond_broadcast(&e->cond);
+	}
+	pthread_mutex_unlock(&e->lock);
+	pthread_join(reader, NULL);
+	if(count) exit(112);
+}
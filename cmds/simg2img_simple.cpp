@@ -1,12 +1,23 @@
 #define _GNU_SOURCE
 #include <fcntl.h>
 #include <unistd.h>
+#include <linux/falloc.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
 #include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <errno.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "simg2img_copy.h"
+#if defined(__aarch64__)
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#endif
+
 typedef struct sparse_header {
   uint32_t	magic;		/* 0xed26ff3a */
   uint16_t	major_version;	/* (0x1) - reject images with higher major versions */
@@ -41,71 +52,329 @@ typedef struct chunk_header {
  *  For a CRC32 chunk, it's 4 bytes of CRC32
  */
 
+/* What stdout is, which decides how ranges that need no data are written */
+enum {
+	OUT_STREAM,	/* pipe, tty, O_APPEND: every byte is written */
+	OUT_FILE,	/* regular file: seek or punch holes */
+	OUT_BLOCK,	/* block device: seek, zero out or discard */
+};
+static int out_kind = OUT_STREAM;
+/* Offset of stdout where the next byte of the image goes */
+static off_t out_pos = 0;
+/* -d: discard don't care ranges of a block device, e.g. thin provisioned */
+static int discard_dont_care = 0;
+/* Cleared once the kernel refused, so it is not asked for every chunk */
+static int can_punch_hole = 1;
+static int can_zero_range = 1;
+static int can_blkzeroout = 1;
+
+static const char zeros[1024*1024] = {};
+
+/* -c: verify the CRC32 chunks and image_checksum while streaming. The CRC
+ * register is kept pre-inverted as libsparse and zlib do, so the CRC of the
+ * image so far is ~crc_reg */
+static int verify_crc = 0;
+static uint32_t crc_reg = ~0U;
+static uint32_t crc_table[8][256];
+
+/* Slicing-by-8 over the 802.3 polynomial, reflected */
+uint32_t crc32_sw(uint32_t crc, const uint8_t *p, size_t len) {
+	for(; len && ((uintptr_t)p & 7); len--)
+		crc = crc_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+	for(; len >= 8; len -= 8, p += 8) {
+		uint64_t v;
+		memcpy(&v, p, 8);
+		v ^= crc;
+		crc = crc_table[7][v & 0xff] ^ crc_table[6][(v >> 8) & 0xff] ^
+			crc_table[5][(v >> 16) & 0xff] ^ crc_table[4][(v >> 24) & 0xff] ^
+			crc_table[3][(v >> 32) & 0xff] ^ crc_table[2][(v >> 40) & 0xff] ^
+			crc_table[1][(v >> 48) & 0xff] ^ crc_table[0][v >> 56];
+	}
+	for(; len; len--)
+		crc = crc_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+	return crc;
+}
+
+#if defined(__aarch64__)
+/* ARMv8 CRC extension, same polynomial, 8 bytes per instruction */
+__attribute__((target("crc")))
+uint32_t crc32_armv8(uint32_t crc, const uint8_t *p, size_t len) {
+	for(; len && ((uintptr_t)p & 7); len--)
+		crc = __builtin_arm_crc32b(crc, *p++);
+	for(; len >= 8; len -= 8, p += 8) {
+		uint64_t v;
+		memcpy(&v, p, 8);
+		crc = __builtin_arm_crc32d(crc, v);
+	}
+	for(; len; len--)
+		crc = __builtin_arm_crc32b(crc, *p++);
+	return crc;
+}
+#endif
+
+static uint32_t (*crc32_update)(uint32_t crc, const uint8_t *p, size_t len) = crc32_sw;
+
+void crc32_init() {
+	for(uint32_t i=0; i<256; i++) {
+		uint32_t c = i;
+		for(int k=0; k<8; k++)
+			c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+		crc_table[0][i] = c;
+	}
+	for(uint32_t i=0; i<256; i++)
+		for(int t=1; t<8; t++)
+			crc_table[t][i] = (crc_table[t-1][i] >> 8) ^ crc_table[0][crc_table[t-1][i] & 0xff];
+#if defined(__aarch64__)
+	if(getauxval(AT_HWCAP) & HWCAP_CRC32)
+		crc32_update = crc32_armv8;
+#endif
+}
+
+uint32_t gf2_times(const uint32_t *mat, uint32_t vec) {
+	uint32_t sum = 0;
+	for(; vec; vec >>= 1, mat++)
+		if(vec & 1) sum ^= *mat;
+	return sum;
+}
+
+void gf2_square(uint32_t *square, const uint32_t *mat) {
+	for(int n=0; n<32; n++)
+		square[n] = gf2_times(mat, mat[n]);
+}
+
+/* Runs the register over len zero bytes in O(log(len)), as zlib's
+ * crc32_combine does, so gigabytes of don't care cost nothing */
+uint32_t crc32_zeros(uint32_t crc, uint64_t len) {
+	uint32_t even[32], odd[32];
+	/* odd: one zero bit */
+	odd[0] = 0xedb88320;
+	for(int n=1; n<32; n++)
+		odd[n] = 1U << (n - 1);
+	gf2_square(even, odd);	/* two zero bits */
+	gf2_square(odd, even);	/* four zero bits */
+	while(len) {
+		gf2_square(even, odd);	/* first pass: one zero byte */
+		if(len & 1) crc = gf2_times(even, crc);
+		len >>= 1;
+		if(!len) break;
+		gf2_square(odd, even);
+		if(len & 1) crc = gf2_times(odd, crc);
+		len >>= 1;
+	}
+	return crc;
+}
+
+/* read() until len bytes, as stdin is usually a pipe */
+int read_full(int fd, void *buf, size_t len) {
+	char *p = (char *)buf;
+	while(len) {
+		ssize_t res = read(fd, p, len);
+		if(res == -1 && errno == EINTR) continue;
+		if(res <= 0) return -1;
+		p += res;
+		len -= res;
+	}
+	return 0;
+}
+
+void write_full(const void *buf, size_t len, int err) {
+	const char *p = (const char *)buf;
+	while(len) {
+		ssize_t res = write(1, p, len);
+		if(res == -1 && errno == EINTR) continue;
+		if(res <= 0) exit(err);
+		p += res;
+		len -= res;
+		out_pos += res;
+	}
+}
+
+void detect_output() {
+	struct stat st;
+	out_pos = lseek(1, 0, SEEK_CUR);
+	if(out_pos == -1 || fstat(1, &st) != 0 || (fcntl(1, F_GETFL) & O_APPEND)) {
+		out_pos = 0;
+		return;
+	}
+	if(S_ISREG(st.st_mode))
+		out_kind = OUT_FILE;
+	else if(S_ISBLK(st.st_mode))
+		out_kind = OUT_BLOCK;
+}
+
+void write_zeros(uint64_t len, int err) {
+	while(len) {
+		size_t n = len < sizeof(zeros) ? len : sizeof(zeros);
+		write_full(zeros, n, err);
+		len -= n;
+	}
+}
+
+void seek_output(uint64_t len, int err) {
+	if(lseek(1, len, SEEK_CUR) == -1) exit(err);
+	out_pos += len;
+}
+
+/* The image doesn't care about the next len bytes: leave them as they are */
+void skip_output(uint64_t len, int err) {
+	if(verify_crc) crc_reg = crc32_zeros(crc_reg, len);
+	if(out_kind == OUT_STREAM) {
+		write_zeros(len, err);
+		return;
+	}
+	if(out_kind == OUT_BLOCK && discard_dont_care) {
+		uint64_t range[2] = { (uint64_t)out_pos, len };
+		/* Best effort, the content doesn't matter either way */
+		ioctl(1, BLKDISCARD, range);
+	}
+	seek_output(len, err);
+}
+
+/* The next len bytes must read back as zeros: have the kernel do it */
+void zero_output(uint64_t len, int err) {
+	if(verify_crc) crc_reg = crc32_zeros(crc_reg, len);
+	if(out_kind != OUT_STREAM) {
+		if(can_punch_hole) {
+			/* Deallocates file blocks, unmaps blocks of a device */
+			if(fallocate(1, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, out_pos, len) == 0) {
+				seek_output(len, err);
+				return;
+			}
+			can_punch_hole = 0;
+		}
+		if(can_zero_range) {
+			if(fallocate(1, FALLOC_FL_ZERO_RANGE | FALLOC_FL_KEEP_SIZE, out_pos, len) == 0) {
+				seek_output(len, err);
+				return;
+			}
+			can_zero_range = 0;
+		}
+		if(out_kind == OUT_BLOCK && can_blkzeroout) {
+			uint64_t range[2] = { (uint64_t)out_pos, len };
+			if(ioctl(1, BLKZEROOUT, range) == 0) {
+				seek_output(len, err);
+				return;
+			}
+			can_blkzeroout = 0;
+		}
+	}
+	write_zeros(len, err);
+}
+
+/* The fill pattern, 32 bits repeated over a buffer of whole blocks */
+static uint32_t pattern[256*1024];
+static uint32_t pattern_fill = 0;
+
+void fill_output(uint32_t fill, uint64_t len, int err) {
+	if(fill == 0) {
+		zero_output(len, err);
+		return;
+	}
+	if(fill != pattern_fill) {
+		/* Plain enough for the compiler to vectorize */
+		for(size_t i=0; i<sizeof(pattern)/sizeof(pattern[0]); i++)
+			pattern[i] = fill;
+		pattern_fill = fill;
+	}
+	while(len) {
+		size_t n = len < sizeof(pattern) ? len : sizeof(pattern);
+		if(verify_crc) crc_reg = crc32_update(crc_reg, (const uint8_t *)pattern, n);
+		write_full(pattern, n, err);
+		len -= n;
+	}
+}
+
+static struct copy_engine engine;
+/* -q: RAW buffers in flight, 1 copies without a reader thread */
+static unsigned queue_depth = 4;
+
 static int disable_splice = 0;
-void nsendfile(int out_fd, int in_fd, size_t count) {
-    char buf[1024*1024];
-	while(count) {
-		ssize_t res = -1;
-        if(!disable_splice) {
-            res = splice(in_fd, NULL, out_fd, NULL, count, 0);
-        }
-
-        if(count > 16*1024 && res < 1024)
-            disable_splice = 1;
-        if(res==-1) {
-            ssize_t sizeToRead = sizeof(buf);
-            if(count < sizeToRead) sizeToRead = count;
-            res = read(in_fd, buf, sizeToRead);
-            if(write(out_fd, buf, res) != res) exit(114);
-        }
-		if(res == 0 || res == -1) exit(112);
+/* RAW data: splice() for as long as the kernel takes it, then the copy
+ * engine, which is also the only way when the data is checksummed */
+void copy_raw(uint64_t count) {
+	while(count && !disable_splice && !verify_crc) {
+		ssize_t res = splice(0, NULL, 1, NULL, count, 0);
+		if(count > 16*1024 && res < 1024)
+			disable_splice = 1;
+		if(res == 0) exit(112);
+		if(res == -1) break;
 		count -= res;
+		out_pos += res;
 	}
+	if(!count) return;
+
+	engine.crc = verify_crc ? crc32_update : NULL;
+	engine.crc_reg = crc_reg;
+	copy_engine_run(&engine, count, out_pos);
+	crc_reg = engine.crc_reg;
+	out_pos += count;
+	/* pwrite() leaves the offset of stdout behind */
+	if(engine.seekable && lseek(1, out_pos, SEEK_SET) == -1) exit(114);
 }
 
-int main() {
+int main(int argc, char **argv) {
+	int opt;
+	while((opt = getopt(argc, argv, "cdq:")) != -1) {
+		if(opt == 'c') verify_crc = 1;
+		else if(opt == 'd') discard_dont_care = 1;
+		else if(opt == 'q') queue_depth = atoi(optarg);
+		else exit(15);
+	}
+	detect_output();
+	crc32_init();
+	if(copy_engine_init(&engine, 0, 1, out_kind != OUT_STREAM, queue_depth) != 0) exit(113);
+	if(out_kind == OUT_BLOCK)
+		copy_engine_enable_direct(&engine);
+
 	sparse_header_t hdr;
-	if(read(0, &hdr, sizeof(hdr)) != sizeof(hdr)) exit(1);
+	if(read_full(0, &hdr, sizeof(hdr)) != 0) exit(1);
 	if(hdr.magic != SPARSE_HEADER_MAGIC) exit(2);
-	if(hdr.blk_sz != 4096) exit(6);
+	if(hdr.blk_sz == 0 || hdr.blk_sz % 4 != 0) exit(6);
 	if(hdr.major_version != 1) exit(11);
-	if(hdr.minor_version != 0) exit(12);
-	if(hdr.file_hdr_sz != 28) exit(13);
-	if(hdr.chunk_hdr_sz != 12) exit(14);
+	/* Higher minor versions may only grow the headers */
+	if(hdr.file_hdr_sz < sizeof(sparse_header_t)) exit(13);
+	if(hdr.chunk_hdr_sz < sizeof(chunk_header_t)) exit(14);
+	char extra_hdr[0x10000];
+	if(read_full(0, extra_hdr, hdr.file_hdr_sz - sizeof(sparse_header_t)) != 0) exit(1);
 
-	char block[4096];
+	uint64_t blocks = 0;
 	for(unsigned i=0; i<hdr.total_chunks; i++) {
 		chunk_header_t chunk;
-		if(read(0, &chunk, sizeof(chunk)) != sizeof(chunk)) exit(3);
+		if(read_full(0, &chunk, sizeof(chunk)) != 0) exit(3);
+		if(read_full(0, extra_hdr, hdr.chunk_hdr_sz - sizeof(chunk_header_t)) != 0) exit(3);
+		uint64_t len = (uint64_t)hdr.blk_sz * chunk.chunk_sz;
+		blocks += chunk.chunk_sz;
 		if(chunk.chunk_type == CHUNK_TYPE_RAW) {
-			if(chunk.total_sz != sizeof(chunk_header_t) + (chunk.chunk_sz * hdr.blk_sz)) exit(7);
+			if(chunk.total_sz != hdr.chunk_hdr_sz + len) exit(7);
 
-			nsendfile(1, 0, hdr.blk_sz * chunk.chunk_sz);
+			copy_raw(len);
 		} else if(chunk.chunk_type == CHUNK_TYPE_FILL) {
-			if(chunk.total_sz != 4 + sizeof(chunk_header_t)) exit(7);
+			if(chunk.total_sz != sizeof(uint32_t) + hdr.chunk_hdr_sz) exit(7);
 
 			uint32_t fill;
-			if(read(0, &fill, sizeof(fill)) != sizeof(fill)) exit(5);
-			//memset takes a char, not a int32, hence the check 
-			if(fill != 0) exit(6);
-			memset(block, fill, hdr.blk_sz);
-			for(unsigned i=0; i<chunk.chunk_sz; i++)
-				if(write(1, block, hdr.blk_sz) != hdr.blk_sz) exit(8);
+			if(read_full(0, &fill, sizeof(fill)) != 0) exit(5);
+			fill_output(fill, len, 8);
 		} else if(chunk.chunk_type == CHUNK_TYPE_DONT_CARE) {
-			if(chunk.total_sz != sizeof(chunk_header_t)) exit(9);
+			if(chunk.total_sz != hdr.chunk_hdr_sz) exit(9);
 
-			memset(block, 0, hdr.blk_sz);
-			for(unsigned i=0; i<chunk.chunk_sz; i++)
-				if(write(1, block, hdr.blk_sz) != hdr.blk_sz) exit(10);
+			skip_output(len, 10);
 		} else if(chunk.chunk_type == CHUNK_TYPE_CRC32) {
-			if(chunk.total_sz != 4 + sizeof(chunk_header_t)) exit(7);
+			if(chunk.total_sz != sizeof(uint32_t) + hdr.chunk_hdr_sz) exit(7);
 			uint32_t crc32;
-			if(read(0, &crc32, sizeof(crc32)) != sizeof(crc32)) exit(5);
-			/* ignore crc32 */
+			if(read_full(0, &crc32, sizeof(crc32)) != 0) exit(5);
+			/* The CRC32 of the image up to here */
+			if(verify_crc && crc32 != ~crc_reg) exit(17);
 		} else {
 			exit(4);
 		}
 	}
+	if(blocks != hdr.total_blks) exit(18);
+	/* 0 when the image was written without a checksum */
+	if(verify_crc && hdr.image_checksum != 0 && hdr.image_checksum != ~crc_reg) exit(17);
+	/* A file that ends in a hole still needs its full size */
+	struct stat st;
+	if(out_kind == OUT_FILE && fstat(1, &st) == 0 && st.st_size < out_pos)
+		if(ftruncate(1, out_pos) != 0) exit(16);
 	fsync(1);
 	return 0;
 }
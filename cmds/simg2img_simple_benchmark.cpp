@@ -0,0 +1,102 @@
+/* Host benchmark of the RAW chunk copy of simg2img_simple: a producer
+ * thread feeds a pipe, as xz does during an OTA, and the copy writes it
+ * into a regular file. */
+#include <benchmark/benchmark.h>
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <thread>
+#include <vector>
+
+#include "simg2img_copy.h"
+
+namespace {
+
+constexpr size_t kTotal = 256 * 1024 * 1024;
+constexpr size_t kProducerWrite = 64 * 1024;
+
+// Previous synchronous loop of nsendfile() once splice() was disabled, kept
+// as the baseline
+void LegacyCopy(int out_fd, int in_fd, size_t count) {
+	char buf[1024*1024];
+	while(count) {
+		ssize_t sizeToRead = sizeof(buf);
+		if(count < (size_t)sizeToRead) sizeToRead = count;
+		ssize_t res = read(in_fd, buf, sizeToRead);
+		if(res <= 0 || write(out_fd, buf, res) != res) abort();
+		count -= res;
+	}
+}
+
+// Simulated decompression: the producer burns work_per_mib of busy loop for
+// every MiB it writes, so there is something for the copy to overlap with
+std::thread Produce(int fd, int64_t work_per_mib) {
+	return std::thread([fd, work_per_mib] {
+		std::vector<char> buf(kProducerWrite, 0x5a);
+		volatile uint64_t sink = 0;
+		for(size_t done = 0; done < kTotal; done += kProducerWrite) {
+			if(done % (1024*1024) == 0)
+				for(int64_t i = 0; i < work_per_mib; i++) sink = sink + i;
+			for(size_t off = 0; off < kProducerWrite;) {
+				ssize_t res = write(fd, buf.data() + off, kProducerWrite - off);
+				if(res <= 0) abort();
+				off += res;
+			}
+		}
+		close(fd);
+	});
+}
+
+template <typename Copy>
+void RunCopy(benchmark::State& state, int64_t work_per_mib, Copy copy) {
+	char path[] = "/tmp/simg2img_benchXXXXXX";
+	int out_fd = mkstemp(path);
+	if(out_fd == -1) {
+		state.SkipWithError("mkstemp failed");
+		return;
+	}
+	unlink(path);
+	for(auto _ : state) {
+		state.PauseTiming();
+		if(ftruncate(out_fd, 0) != 0 || lseek(out_fd, 0, SEEK_SET) != 0) abort();
+		int fds[2];
+		if(pipe(fds) != 0) abort();
+		state.ResumeTiming();
+
+		std::thread producer = Produce(fds[1], work_per_mib);
+		copy(out_fd, fds[0]);
+		producer.join();
+		close(fds[0]);
+	}
+	close(out_fd);
+	state.SetBytesProcessed(state.iterations() * kTotal);
+}
+
+void BM_Legacy(benchmark::State& state) {
+	RunCopy(state, state.range(0), [](int out_fd, int in_fd) {
+		LegacyCopy(out_fd, in_fd, kTotal);
+	});
+}
+
+void BM_Engine(benchmark::State& state) {
+	struct copy_engine engine;
+	if(copy_engine_init(&engine, -1, -1, 1, state.range(1)) != 0) abort();
+	RunCopy(state, state.range(0), [&engine](int out_fd, int in_fd) {
+		engine.in_fd = in_fd;
+		engine.out_fd = out_fd;
+		copy_engine_run(&engine, kTotal, 0);
+	});
+	free(engine.bufs);
+}
+
+// Busy loop iterations per MiB: none, then roughly xz on a phone
+BENCHMARK(BM_Legacy)->Arg(0)->Arg(2000000)->UseRealTime();
+BENCHMARK(BM_Engine)
+	->ArgsProduct({{0, 2000000}, {1, 2, 4, 8}})
+	->UseRealTime();
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -1,13 +1,21 @@
 typedef unsigned short int sa_family_t;
 #define __KERNEL_STRICT_NAMES
 #include <sys/types.h>
+#include <linux/filter.h>
 #include <linux/netlink.h>
-#include <sys/socket.h> 
+#include <sys/socket.h>
+#include <errno.h>
+#include <stdint.h>
+#include <fnmatch.h>
+#include <getopt.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
 
+#include <string>
+#include <vector>
+
 //From a uevent patch for hal
 #define HOTPLUG_BUFFER_SIZE             1024
 #define HOTPLUG_NUM_ENVP                32
@@ -17,46 +25,304 @@ typedef unsigned short int sa_family_t;
 #error Your kernel headers are too old, and do not define NETLINK_KOBJECT_UEVENT. You need Linux 2.6.10 or higher for KOBJECT_UEVENT support.
 #endif
 
-int main(int argc, char **argv, char **envp) {
+// The kernel caps a uevent at 2KiB of environment, leave room for the header
+#define UEVENT_MSG_SIZE                 8192
+// Messages taken per recvmmsg
+#define BATCH_SIZE                      64
+// Hotplug storms easily overrun the default ~200KiB
+#define DEFAULT_RCVBUF                  (4 * 1024 * 1024)
+#define MAX_RCVBUF                      (64 * 1024 * 1024)
+
+static void usage(const char *self) {
+        fprintf(stderr, "Usage: %s [-j] [-k] [-b rcvbuf] [-m KEY=glob]... [substring]\n", self);
+        fprintf(stderr, "  -m KEY=glob  only print events whose KEY matches, e.g. SUBSYSTEM=input.\n");
+        fprintf(stderr, "               The globs of one key are or-ed, different keys and-ed\n");
+        fprintf(stderr, "  -k           let the kernel drop events not matching the ACTION and DEVPATH filters\n");
+        fprintf(stderr, "  -j           print one JSON object per event\n");
+        fprintf(stderr, "  -b rcvbuf    socket receive buffer, default %d\n", DEFAULT_RCVBUF);
+}
+
+struct Match {
+        std::string key;
+        std::vector<std::string> patterns;
+};
+
+struct Event {
+        const char *header;
+        std::vector<const char *> env;
+};
+
+static bool isGlob(const std::string& s) {
+        return s.find_first_of("*?[") != std::string::npos;
+}
+
+static const char *getEnv(const Event& ev, const std::string& key) {
+        for(const char *e: ev.env) {
+                if(strncmp(e, key.c_str(), key.size()) == 0 && e[key.size()] == '=')
+                        return e + key.size() + 1;
+        }
+        return NULL;
+}
+
+static bool matches(const Event& ev, const std::vector<Match>& filters, const char *substring) {
+        if(substring && !strstr(ev.header, substring)) return false;
+        for(const auto& m: filters) {
+                const char *value = getEnv(ev, m.key);
+                if(!value) return false;
+                bool any = false;
+                for(const auto& p: m.patterns) {
+                        if(fnmatch(p.c_str(), value, 0) == 0) {
+                                any = true;
+                                break;
+                        }
+                }
+                if(!any) return false;
+        }
+        return true;
+}
+
+static void addMatch(std::vector<Match>& filters, const char *arg) {
+        const char *eq = strchr(arg, '=');
+        if(!eq || eq == arg) {
+                fprintf(stderr, "Expected KEY=glob, got %s\n", arg);
+                exit(1);
+        }
+        std::string key(arg, eq - arg);
+        for(auto& m: filters) {
+                if(m.key == key) {
+                        m.patterns.push_back(eq + 1);
+                        return;
+                }
+        }
+        filters.push_back({key, {eq + 1}});
+}
+
+static const std::vector<std::string> *patternsOf(const std::vector<Match>& filters, const char *key) {
+        for(const auto& m: filters)
+                if(m.key == key) return &m.patterns;
+        return NULL;
+}
+
+// Kernel messages start with "ACTION@DEVPATH", the only fields at a fixed
+// offset classic BPF can check. Accepts the messages starting with one of
+// the ACTION@DEVPATH-literal-prefix combinations. Returns false if the
+// filters don't allow for it, they then all get checked in userspace only.
+static bool buildSocketFilter(const std::vector<Match>& filters, std::vector<struct sock_filter>& prog) {
+        const auto *actions = patternsOf(filters, "ACTION");
+        const auto *devpaths = patternsOf(filters, "DEVPATH");
+        if(!actions) return false;
+
+        std::vector<std::string> prefixes;
+        for(const auto& a: *actions) {
+                if(isGlob(a)) return false;
+                if(!devpaths) {
+                        prefixes.push_back(a + "@");
+                        continue;
+                }
+                for(const auto& d: *devpaths) {
+                        // Keeps the jumps within the 8 bits they have
+                        std::string prefix = a + "@" + d.substr(0, d.find_first_of("*?["));
+                        prefixes.push_back(prefix.substr(0, 64));
+                }
+        }
+
+        for(const auto& prefix: prefixes) {
+                // Load and compare 4, 2 then 1 bytes at a time, going to the
+                // next prefix on the first mismatch
+                std::vector<struct sock_filter> cmp;
+                size_t off = 0;
+                while(off < prefix.size()) {
+                        size_t left = prefix.size() - off;
+                        size_t n = left >= 4 ? 4 : left >= 2 ? 2 : 1;
+                        uint32_t k = 0;
+                        for(size_t i = 0; i < n; i++)
+                                k = (k << 8) | (unsigned char)prefix[off + i];
+                        uint16_t size = n == 4 ? BPF_W : n == 2 ? BPF_H : BPF_B;
+                        cmp.push_back(BPF_STMT(BPF_LD | size | BPF_ABS, (uint32_t)off));
+                        cmp.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, k, 0, 0));
+                        off += n;
+                }
+                // Past the last compare, the accept
+                uint8_t end = cmp.size() + 1;
+                for(size_t i = 1; i < cmp.size(); i += 2)
+                        cmp[i].jf = end - (i + 1);
+                prog.insert(prog.end(), cmp.begin(), cmp.end());
+                prog.push_back(BPF_STMT(BPF_RET | BPF_K, 0xffffffff));
+        }
+        prog.push_back(BPF_STMT(BPF_RET | BPF_K, 0));
+        return true;
+}
+
+static void printJsonString(const char *s) {
+        putchar('"');
+        for(; *s; s++) {
+                unsigned char c = *s;
+                if(c == '"' || c == '\\') {
+                        putchar('\\');
+                        putchar(c);
+                } else if(c < 0x20) {
+                        printf("\\u%04x", c);
+                } else {
+                        putchar(c);
+                }
+        }
+        putchar('"');
+}
+
+static void printEvent(const Event& ev, bool json) {
+        if(!json) {
+                printf("%s\n", ev.header);
+                for(const char *e: ev.env)
+                        printf("\t%s\n", e);
+                return;
+        }
+        putchar('{');
+        bool first = true;
+        for(const char *e: ev.env) {
+                const char *eq = strchr(e, '=');
+                if(!eq) continue;
+                if(!first) putchar(',');
+                first = false;
+                std::string key(e, eq - e);
+                printJsonString(key.c_str());
+                putchar(':');
+                printJsonString(eq + 1);
+        }
+        printf("}\n");
+}
+
+static void setRcvbuf(int fd, int size) {
+        // FORCE goes past rmem_max, but needs CAP_NET_ADMIN
+        if(setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) < 0)
+                setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+}
+
+int main(int argc, char **argv) {
+        std::vector<Match> filters;
+        bool json = false;
+        bool kernelFilter = false;
+        int rcvbuf = DEFAULT_RCVBUF;
+        int c;
+        while((c = getopt(argc, argv, "jkb:m:")) != -1) {
+                switch(c) {
+                        case 'j':
+                                json = true;
+                                break;
+                        case 'k':
+                                kernelFilter = true;
+                                break;
+                        case 'b':
+                                rcvbuf = atoi(optarg);
+                                break;
+                        case 'm':
+                                addMatch(filters, optarg);
+                                break;
+                        default:
+                                usage(argv[0]);
+                                exit(1);
+                }
+        }
+        const char *substring = optind < argc ? argv[optind] : NULL;
+
         //Start listening
         int fd;
         struct sockaddr_nl ksnl;
         memset(&ksnl, 0x00, sizeof(struct sockaddr_nl));
         ksnl.nl_family=AF_NETLINK;
         ksnl.nl_pid=getpid();
-        ksnl.nl_groups=0xffffffff;
-        fd=socket(PF_NETLINK, SOCK_DGRAM, NETLINK_KOBJECT_UEVENT);
+        // Kernel uevents only
+        ksnl.nl_groups=1;
+        fd=socket(PF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
         if (fd==-1) {
                 printf("Couldn't open kobject-uevent netlink socket");
                 perror("");
                 exit(1);
         }
+        setRcvbuf(fd, rcvbuf);
+
+        if(kernelFilter) {
+                std::vector<struct sock_filter> prog;
+                if(buildSocketFilter(filters, prog)) {
+                        struct sock_fprog fprog;
+                        fprog.len = prog.size();
+                        fprog.filter = prog.data();
+                        if(setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof(fprog)) < 0)
+                                perror("Couldn't attach socket filter");
+                } else {
+                        fprintf(stderr, "Socket filter needs literal ACTION filters, filtering in userspace only\n");
+                }
+        }
+
         if (bind(fd, (struct sockaddr *) &ksnl, sizeof(struct sockaddr_nl))<0) {
                 fprintf (stderr, "Error binding to netlink socket");
                 close(fd);
                 exit(1);
         }
 
+        // One write per batch rather than per line
+        static char outbuf[256 * 1024];
+        setvbuf(stdout, outbuf, _IOFBF, sizeof(outbuf));
+
+        static char buffers[BATCH_SIZE][UEVENT_MSG_SIZE];
+        struct iovec iovs[BATCH_SIZE];
+        struct sockaddr_nl senders[BATCH_SIZE];
+        struct mmsghdr msgs[BATCH_SIZE];
+        unsigned long overruns = 0;
         while(1) {
-                char buffer[HOTPLUG_BUFFER_SIZE + OBJECT_SIZE];
-                int buflen;
-                buflen=recv(fd, &buffer, sizeof(buffer), 0);
-                if (buflen<0) {
-                        exit(1);
+                memset(msgs, 0, sizeof(msgs));
+                for(int i = 0; i < BATCH_SIZE; i++) {
+                        iovs[i].iov_base = buffers[i];
+                        // Keeps room for a terminating NUL
+                        iovs[i].iov_len = UEVENT_MSG_SIZE - 1;
+                        msgs[i].msg_hdr.msg_iov = &iovs[i];
+                        msgs[i].msg_hdr.msg_iovlen = 1;
+                        msgs[i].msg_hdr.msg_name = &senders[i];
+                        msgs[i].msg_hdr.msg_namelen = sizeof(senders[i]);
                 }
-
-                if(argc>=2) {
-                    if(!strstr(buffer, argv[1])) continue;
+                int n = recvmmsg(fd, msgs, BATCH_SIZE, MSG_WAITFORONE, NULL);
+                if(n < 0) {
+                        if(errno == EINTR) continue;
+                        if(errno != ENOBUFS) {
+                                perror("recvmmsg");
+                                exit(1);
+                        }
+                        // The kernel dropped events, the socket stays usable.
+                        // Say so, so that a consumer can rescan, and grow
+                        // the buffer to make it less likely to happen again
+                        overruns++;
+                        if(json) {
+                                printf("{\"overrun\":%lu}\n", overruns);
+                        } else {
+                                fprintf(stderr, "Receive buffer overrun, events were lost\n");
+                        }
+                        if(rcvbuf < MAX_RCVBUF) {
+                                rcvbuf *= 2;
+                                setRcvbuf(fd, rcvbuf);
+                        }
+                        fflush(stdout);
+                        continue;
                 }
 
-                printf("%s\n", buffer);
-                char *pos = buffer + strlen(buffer);
-                char *end = buffer + buflen;
-                while(pos < end) {
-                    int l = strlen(pos);
-                    printf("\t%s\n", pos);
-                    pos += l+1;
+                for(int i = 0; i < n; i++) {
+                        // Only trust the kernel
+                        if(senders[i].nl_pid != 0) continue;
+                        char *buffer = buffers[i];
+                        size_t buflen = msgs[i].msg_len;
+                        if(msgs[i].msg_hdr.msg_flags & MSG_TRUNC) continue;
+                        buffer[buflen] = 0;
+
+                        Event ev;
+                        ev.header = buffer;
+                        char *pos = buffer + strlen(buffer) + 1;
+                        char *end = buffer + buflen;
+                        while(pos < end) {
+                                ev.env.push_back(pos);
+                                pos += strlen(pos) + 1;
+                        }
+                        if(!matches(ev, filters, substring)) continue;
+                        printEvent(ev, json);
                 }
+                fflush(stdout);
         }
 
 }
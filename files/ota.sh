@@ -19,6 +19,22 @@ fi
 
 url=$(curl --silent -L https://raw.githubusercontent.com/phhusson/treble_experimentations/master/ota/squeak/$flavor/url)
 size=$(curl --silent -L https://raw.githubusercontent.com/phhusson/treble_experimentations/master/ota/squeak/$flavor/size)
+# SHA-256 of the uncompressed image, not every flavor publishes one
+sha256=$(curl --silent --fail -L https://raw.githubusercontent.com/phhusson/treble_experimentations/master/ota/squeak/$flavor/sha256 || true)
+if ! echo "$sha256" | grep -qE '^[0-9a-fA-F]{64}$';then
+    sha256=""
+fi
+# Uncompressed image size, to allocate the new slot to measure
+imageSize=$(curl --silent --fail -L https://raw.githubusercontent.com/phhusson/treble_experimentations/master/ota/squeak/$flavor/image_size || true)
+if ! echo "$imageSize" | grep -qE '^[0-9]+$';then
+    imageSize=""
+fi
+
+# Block delta from the running build, only published for some releases
+deltaUrl=$(curl --silent --fail -L https://raw.githubusercontent.com/phhusson/treble_experimentations/master/ota/squeak/$flavor/delta/$(getprop ro.product.build.date.utc) || true)
+if ! echo "$deltaUrl" | grep -qE '^https?://';then
+    deltaUrl=""
+fi
 
 if [ "$(getprop ro.product.build.date.utc)" = "$nextVersion" ];then
     echo "Installing $nextVersion onto itself, aborting"
@@ -44,8 +60,37 @@ fi
 
 echo "Flashing from ${url}..."
 
-dmDevice=$(phh-ota new-slot)
-curl -L "$url" | busybox_phh xz -d -c > $dmDevice
+dmDevice=$(phh-ota new-slot ${imageSize:+-s $imageSize})
+# An interrupted install of the same image resumes where it was checkpointed
+offset=$(phh-ota resume-offset -i "$url")
+if [ "$offset" != 0 ];then
+    echo "Resuming at ${offset}..."
+    ret=0
+    curl -L -r "$offset"- "$url" | phh-ota install -o "$dmDevice" -i "$url" -r "$offset" ${sha256:+-s $sha256} || ret=$?
+    # 2 means the checkpoint was no use, anything else is worth retrying later
+    if [ "$ret" = 2 ];then
+        offset=0
+    elif [ "$ret" != 0 ];then
+        echo "Flashing failed, run ota.sh again to resume"
+        exit 1
+    fi
+fi
+deltaApplied=""
+if [ "$offset" = 0 ] && [ -n "$deltaUrl" ];then
+    # Only the changed blocks are downloaded, the rest comes from the running
+    # system. Any failure falls back to the full image
+    delta=/data/gsi/phh/delta
+    echo "Applying delta from ${deltaUrl}..."
+    if curl --fail -L -o "$delta" "$deltaUrl" && phh-ota apply-delta -o "$dmDevice" "$delta";then
+        deltaApplied=true
+    else
+        echo "Delta failed, flashing the full image"
+    fi
+    rm -f "$delta"
+fi
+if [ "$offset" = 0 ] && [ -z "$deltaApplied" ];then
+    curl -L "$url" | phh-ota install -o "$dmDevice" -i "$url" ${sha256:+-s $sha256}
+fi
 phh-ota switch-slot
 
 reboot
@@ -0,0 +1,13 @@
+#include <stdio.h>
+
+#include "ota_delta.h"
+
+// Host side: makes the delta payload `phh-ota apply-delta` turns the source
+// system image into the target one with
+int main(int argc, char **argv) {
+	if(argc != 4) {
+		fprintf(stderr, "Usage: %s source.img target.img payload\n", argv[0]);
+		return 1;
+	}
+	return makeDelta(argv[1], argv[2], argv[3]) ? 0 : 1;
+}
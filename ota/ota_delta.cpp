@@ -0,0 +1,473 @@
+#include "ota_delta.h"
+
+#include <algorithm>
+#include <atomic>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <openssl/sha.h>
+#include <zstd.h>
+
+namespace {
+
+constexpr size_t kAlign = 4096;
+// A PATCH frame spans its prefix and its output, 2 MiB at most; leave
+// headroom but don't let a frame make the decoder allocate more
+constexpr int kMaxWindowLog = 22;
+
+bool preadFully(int fd, void *buf, size_t len, uint64_t pos) {
+	uint8_t *p = (uint8_t*)buf;
+	while(len) {
+		ssize_t res = pread(fd, p, len, pos);
+		if(res == -1 && errno == EINTR) continue;
+		if(res <= 0) return false;
+		p += res;
+		len -= res;
+		pos += res;
+	}
+	return true;
+}
+
+bool pwriteFully(int fd, const void *buf, size_t len, uint64_t pos) {
+	const uint8_t *p = (const uint8_t*)buf;
+	while(len) {
+		ssize_t res = pwrite(fd, p, len, pos);
+		if(res == -1 && errno == EINTR) continue;
+		if(res <= 0) {
+			if(res == 0) errno = ENOSPC;
+			return false;
+		}
+		p += res;
+		len -= res;
+		pos += res;
+	}
+	return true;
+}
+
+uint64_t fdSize(int fd) {
+	struct stat sb;
+	if(fstat(fd, &sb) != 0) return 0;
+	if(S_ISREG(sb.st_mode)) return sb.st_size;
+	uint64_t size = 0;
+	if(S_ISBLK(sb.st_mode) && ioctl(fd, BLKGETSIZE64, &size) == 0) return size;
+	return 0;
+}
+
+const char *opName(uint32_t type) {
+	switch(type) {
+		case DELTA_COPY: return "COPY";
+		case DELTA_ZERO: return "ZERO";
+		case DELTA_NEW: return "NEW";
+		case DELTA_PATCH: return "PATCH";
+	}
+	return "?";
+}
+
+class Applier {
+public:
+	explicit Applier(const DeltaOptions& opts) : opts(opts) {}
+
+	~Applier() {
+		for(int fd : { payloadFd, sourceFd, targetFd, directFd })
+			if(fd != -1) close(fd);
+	}
+
+	bool load() {
+		payloadFd = ::open(opts.payload.c_str(), O_RDONLY | O_CLOEXEC);
+		if(payloadFd == -1) {
+			fprintf(stderr, "Opening %s failed: %s\n", opts.payload.c_str(), strerror(errno));
+			return false;
+		}
+		if(!preadFully(payloadFd, &header, sizeof(header), 0) ||
+				memcmp(header.magic, DELTA_MAGIC, sizeof(header.magic)) != 0 ||
+				header.version != DELTA_VERSION) {
+			fprintf(stderr, "%s isn't a delta payload\n", opts.payload.c_str());
+			return false;
+		}
+		if(header.blockSize == 0 || header.blockSize % 512 != 0 || header.blockSize > DELTA_MAX_OP_BYTES) {
+			fprintf(stderr, "Unsupported block size %u\n", header.blockSize);
+			return false;
+		}
+		// Byte offsets within the images fit in an off_t
+		const uint64_t maxBlocks = INT64_MAX / header.blockSize;
+		if(header.sourceBlocks > maxBlocks || header.targetBlocks > maxBlocks) {
+			fprintf(stderr, "Delta images are too big\n");
+			return false;
+		}
+		uint64_t payloadSize = fdSize(payloadFd);
+		dataStart = sizeof(header) + (uint64_t)header.opCount * sizeof(DeltaOp);
+		if(dataStart > payloadSize) {
+			fprintf(stderr, "Delta payload is truncated\n");
+			return false;
+		}
+		ops.resize(header.opCount);
+		if(!preadFully(payloadFd, ops.data(), ops.size() * sizeof(DeltaOp), sizeof(header))) return false;
+
+		// Every target block is written exactly once, and nothing reads
+		// outside the source or the payload
+		// Written this way round, the bounds checks can't wrap
+		std::vector<std::pair<uint64_t, uint64_t>> ranges;
+		const uint64_t maxOpBlocks = DELTA_MAX_OP_BYTES / header.blockSize;
+		for(auto& op : ops) {
+			bool readsSource = op.type == DELTA_COPY || op.type == DELTA_PATCH;
+			bool hasData = op.type == DELTA_NEW || op.type == DELTA_PATCH;
+			if(op.type > DELTA_PATCH || op.blockCount == 0 || op.blockCount > maxOpBlocks ||
+					op.blockCount > header.targetBlocks || op.dstBlock > header.targetBlocks - op.blockCount ||
+					(readsSource && (op.blockCount > header.sourceBlocks ||
+						op.srcBlock > header.sourceBlocks - op.blockCount)) ||
+					(hasData && (op.dataLength == 0 ||
+						op.dataLength > ZSTD_compressBound(op.blockCount * header.blockSize) ||
+						op.dataLength > payloadSize - dataStart ||
+						op.dataOffset > payloadSize - dataStart - op.dataLength))) {
+				fprintf(stderr, "Malformed %s op at block %llu\n", opName(op.type), (unsigned long long)op.dstBlock);
+				return false;
+			}
+			ranges.push_back({ op.dstBlock, op.blockCount });
+			maxOpLen = std::max<uint64_t>(maxOpLen, op.blockCount * header.blockSize);
+			maxData = std::max<uint64_t>(maxData, hasData ? op.dataLength : 0);
+		}
+		// Overlapping ops would race between workers, with the last write
+		// winning whatever the hashes say
+		std::sort(ranges.begin(), ranges.end());
+		uint64_t covered = 0;
+		for(auto& range : ranges) {
+			if(range.first != covered) {
+				fprintf(stderr, "Malformed delta, ops %s at block %llu\n",
+						range.first < covered ? "overlap" : "leave a gap", (unsigned long long)std::min(range.first, covered));
+				return false;
+			}
+			covered += range.second;
+		}
+		if(covered != header.targetBlocks) {
+			fprintf(stderr, "Malformed delta, ops stop at block %llu of %llu\n",
+					(unsigned long long)covered, (unsigned long long)header.targetBlocks);
+			return false;
+		}
+		return true;
+	}
+
+	bool openFiles() {
+		sourceFd = ::open(opts.source.c_str(), O_RDONLY | O_CLOEXEC);
+		if(sourceFd == -1) {
+			fprintf(stderr, "Opening %s failed: %s\n", opts.source.c_str(), strerror(errno));
+			return false;
+		}
+		if(fdSize(sourceFd) < header.sourceBlocks * header.blockSize) {
+			fprintf(stderr, "%s is smaller than the delta's source\n", opts.source.c_str());
+			return false;
+		}
+		targetFd = ::open(opts.target.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+		if(targetFd == -1) {
+			fprintf(stderr, "Opening %s failed: %s\n", opts.target.c_str(), strerror(errno));
+			return false;
+		}
+		uint64_t targetSize = header.targetBlocks * header.blockSize;
+		struct stat sb;
+		if(fstat(targetFd, &sb) == 0 && S_ISREG(sb.st_mode)) {
+			if(ftruncate(targetFd, targetSize) != 0) return false;
+		} else if(fdSize(targetFd) < targetSize) {
+			fprintf(stderr, "%s is smaller than the delta's target, %llu bytes\n", opts.target.c_str(), (unsigned long long)targetSize);
+			return false;
+		}
+		// Blocks are written once and never read back, keep them out of
+		// the page cache when the target allows
+		directFd = ::open(opts.target.c_str(), O_WRONLY | O_DIRECT | O_CLOEXEC);
+		useDirect = directFd != -1 && header.blockSize % kAlign == 0;
+		return true;
+	}
+
+	bool run() {
+		unsigned workers = opts.workers;
+		if(workers == 0) workers = std::thread::hardware_concurrency();
+		// Source and destination buffers, the op data and the zstd window
+		// of every worker have to fit in an eighth of the memory
+		uint64_t perWorker = 2 * maxOpLen + maxData + (1ull << kMaxWindowLog);
+		uint64_t budget = (uint64_t)sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGESIZE) / 8;
+		workers = std::min<uint64_t>(workers, budget / perWorker);
+		workers = std::max(1u, std::min<unsigned>(workers, ops.size()));
+		fprintf(stderr, "Applying %zu delta ops with %u workers\n", ops.size(), workers);
+		std::vector<std::thread> threads;
+		for(unsigned i = 0; i < workers; i++)
+			threads.emplace_back(&Applier::work, this);
+		for(auto& thread : threads) thread.join();
+		if(failed) return false;
+		if(fsync(targetFd) != 0) {
+			fprintf(stderr, "Syncing %s failed: %s\n", opts.target.c_str(), strerror(errno));
+			return false;
+		}
+		fprintf(stderr, "Wrote %llu blocks, read %llu from the payload\n",
+				(unsigned long long)header.targetBlocks, (unsigned long long)dataRead.load());
+		return true;
+	}
+
+private:
+	struct Worker {
+		~Worker() {
+			free(src);
+			free(dst);
+			ZSTD_freeDCtx(ctx);
+		}
+		uint8_t *src = nullptr;
+		uint8_t *dst = nullptr;
+		std::vector<uint8_t> data;
+		ZSTD_DCtx *ctx = nullptr;
+	};
+
+	void work() {
+		Worker w;
+		size_t len = maxOpLen;
+		void *src, *dst;
+		if(posix_memalign(&src, kAlign, len) != 0) {
+			failed = true;
+			return;
+		}
+		w.src = (uint8_t*)src;
+		if(posix_memalign(&dst, kAlign, len) != 0) {
+			failed = true;
+			return;
+		}
+		w.dst = (uint8_t*)dst;
+		w.data.resize(maxData);
+		w.ctx = ZSTD_createDCtx();
+		if(w.ctx == nullptr) {
+			failed = true;
+			return;
+		}
+		while(!failed) {
+			size_t i = next++;
+			if(i >= ops.size()) break;
+			if(!apply(ops[i], &w)) failed = true;
+		}
+	}
+
+	bool apply(const DeltaOp& op, Worker *w) {
+		size_t len = op.blockCount * header.blockSize;
+		uint8_t digest[SHA256_DIGEST_LENGTH];
+		if(op.type == DELTA_COPY || op.type == DELTA_PATCH) {
+			uint8_t *src = op.type == DELTA_COPY ? w->dst : w->src;
+			if(!preadFully(sourceFd, src, len, op.srcBlock * header.blockSize)) {
+				fprintf(stderr, "Reading source block %llu failed: %s\n", (unsigned long long)op.srcBlock, strerror(errno));
+				return false;
+			}
+			SHA256(src, len, digest);
+			if(memcmp(digest, op.srcSha256, sizeof(digest)) != 0) {
+				fprintf(stderr, "Source blocks %llu+%llu aren't the ones the delta was made against\n",
+						(unsigned long long)op.srcBlock, (unsigned long long)op.blockCount);
+				return false;
+			}
+		}
+		if(op.type == DELTA_ZERO) memset(w->dst, 0, len);
+		if(op.type == DELTA_NEW || op.type == DELTA_PATCH) {
+			if(!preadFully(payloadFd, w->data.data(), op.dataLength, dataStart + op.dataOffset)) {
+				fprintf(stderr, "Reading delta payload failed: %s\n", strerror(errno));
+				return false;
+			}
+			dataRead += op.dataLength;
+			ZSTD_DCtx_reset(w->ctx, ZSTD_reset_session_and_parameters);
+			ZSTD_DCtx_setParameter(w->ctx, ZSTD_d_windowLogMax, kMaxWindowLog);
+			if(op.type == DELTA_PATCH) ZSTD_DCtx_refPrefix(w->ctx, w->src, len);
+			ZSTD_inBuffer in = { w->data.data(), op.dataLength, 0 };
+			ZSTD_outBuffer out = { w->dst, len, 0 };
+			size_t ret = ZSTD_decompressStream(w->ctx, &out, &in);
+			if(ZSTD_isError(ret) || ret != 0 || out.pos != len || in.pos != in.size) {
+				fprintf(stderr, "Decoding %s op at block %llu failed: %s\n", opName(op.type), (unsigned long long)op.dstBlock,
+						ZSTD_isError(ret) ? ZSTD_getErrorName(ret) : "wrong size");
+				return false;
+			}
+		}
+		if(op.type != DELTA_COPY) SHA256(w->dst, len, digest);
+		if(memcmp(digest, op.dstSha256, sizeof(digest)) != 0) {
+			fprintf(stderr, "Target blocks %llu+%llu don't have the expected hash\n",
+					(unsigned long long)op.dstBlock, (unsigned long long)op.blockCount);
+			return false;
+		}
+
+		uint64_t pos = op.dstBlock * header.blockSize;
+		if(useDirect) {
+			if(pwriteFully(directFd, w->dst, len, pos)) return true;
+			if(errno != EINVAL) return false;
+			useDirect = false;
+		}
+		if(!pwriteFully(targetFd, w->dst, len, pos)) {
+			fprintf(stderr, "Writing target block %llu failed: %s\n", (unsigned long long)op.dstBlock, strerror(errno));
+			return false;
+		}
+		return true;
+	}
+
+	const DeltaOptions& opts;
+	DeltaHeader header = {};
+	std::vector<DeltaOp> ops;
+	uint64_t dataStart = 0;
+	uint64_t maxOpLen = 0;
+	uint64_t maxData = 0;
+	int payloadFd = -1;
+	int sourceFd = -1;
+	int targetFd = -1;
+	int directFd = -1;
+	std::atomic<bool> useDirect{false};
+	std::atomic<size_t> next{0};
+	std::atomic<bool> failed{false};
+	std::atomic<uint64_t> dataRead{0};
+};
+
+// Read only mapping of a whole image
+class Image {
+public:
+	~Image() {
+		if(data != nullptr && size) munmap((void*)data, size);
+	}
+
+	bool map(const std::string& path) {
+		int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if(fd == -1) {
+			fprintf(stderr, "Opening %s failed: %s\n", path.c_str(), strerror(errno));
+			return false;
+		}
+		size = fdSize(fd);
+		if(size) {
+			void *p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if(p != MAP_FAILED) data = (const uint8_t*)p;
+		}
+		close(fd);
+		return size == 0 || data != nullptr;
+	}
+
+	const uint8_t *data = nullptr;
+	uint64_t size = 0;
+};
+
+bool compress(ZSTD_CCtx *ctx, const uint8_t *prefix, const uint8_t *src, size_t len, std::vector<uint8_t> *out) {
+	ZSTD_CCtx_reset(ctx, ZSTD_reset_session_only);
+	if(prefix != nullptr) ZSTD_CCtx_refPrefix(ctx, prefix, len);
+	out->resize(ZSTD_compressBound(len));
+	size_t ret = ZSTD_compress2(ctx, out->data(), out->size(), src, len);
+	if(ZSTD_isError(ret)) return false;
+	out->resize(ret);
+	return true;
+}
+
+}  // namespace
+
+bool applyDelta(const DeltaOptions& opts) {
+	Applier applier(opts);
+	return applier.load() && applier.openFiles() && applier.run();
+}
+
+bool makeDelta(const std::string& sourcePath, const std::string& targetPath, const std::string& payloadPath) {
+	const uint32_t bs = 4096;
+	Image source, target;
+	if(!source.map(sourcePath) || !target.map(targetPath)) return false;
+	if(target.size % bs != 0) {
+		fprintf(stderr, "%s isn't made of %u bytes blocks\n", targetPath.c_str(), bs);
+		return false;
+	}
+	uint64_t srcBlocks = source.size / bs;
+	uint64_t dstBlocks = target.size / bs;
+	auto block = [bs](const Image& img, uint64_t i) {
+		return std::string_view((const char*)img.data + i * bs, bs);
+	};
+
+	// Blocks that moved are copied from wherever they are in the source
+	std::unordered_map<std::string_view, uint64_t> sourceBlocks;
+	for(uint64_t i = srcBlocks; i-- > 0;)
+		sourceBlocks[block(source, i)] = i;
+	const std::string zeros(bs, '\0');
+
+	// Where each target block comes from, -1 for zeros, -2 if it changed
+	std::vector<int64_t> from(dstBlocks);
+	for(uint64_t i = 0; i < dstBlocks; i++) {
+		auto b = block(target, i);
+		if(b == zeros) {
+			from[i] = -1;
+		} else if(i < srcBlocks && b == block(source, i)) {
+			from[i] = i;
+		} else {
+			auto it = sourceBlocks.find(b);
+			from[i] = it == sourceBlocks.end() ? -2 : it->second;
+		}
+	}
+
+	ZSTD_CCtx *ctx = ZSTD_createCCtx();
+	ZSTD_CCtx_setParameter(ctx, ZSTD_c_compressionLevel, 19);
+	std::vector<DeltaOp> ops;
+	std::vector<uint8_t> data, patch, fresh;
+	bool ok = true;
+	for(uint64_t i = 0; i < dstBlocks && ok;) {
+		uint64_t n = 1;
+		auto continues = [&](uint64_t j) {
+			if(from[i] >= 0) return from[j] == from[i] + (int64_t)(j - i);
+			return from[j] == from[i];
+		};
+		while(i + n < dstBlocks && n < DELTA_MAX_OP_BYTES / bs && continues(i + n)) n++;
+
+		DeltaOp op = {};
+		op.dstBlock = i;
+		op.blockCount = n;
+		const uint8_t *dst = target.data + i * bs;
+		size_t len = n * bs;
+		if(from[i] >= 0) {
+			op.type = DELTA_COPY;
+			op.srcBlock = from[i];
+		} else if(from[i] == -1) {
+			op.type = DELTA_ZERO;
+		} else {
+			ok = compress(ctx, nullptr, dst, len, &fresh);
+			op.type = DELTA_NEW;
+			// Changed in place most of the time, against the old blocks
+			// only the difference is left
+			if(ok && i + n <= srcBlocks) {
+				ok = compress(ctx, source.data + i * bs, dst, len, &patch);
+				if(ok && patch.size() < fresh.size()) {
+					op.type = DELTA_PATCH;
+					op.srcBlock = i;
+					fresh.swap(patch);
+				}
+			}
+			op.dataOffset = data.size();
+			op.dataLength = fresh.size();
+			data.insert(data.end(), fresh.begin(), fresh.end());
+		}
+		if(op.type == DELTA_COPY || op.type == DELTA_PATCH)
+			SHA256(source.data + op.srcBlock * bs, len, op.srcSha256);
+		SHA256(dst, len, op.dstSha256);
+		ops.push_back(op);
+		i += n;
+	}
+	ZSTD_freeCCtx(ctx);
+	if(!ok) {
+		fprintf(stderr, "Compressing delta data failed\n");
+		return false;
+	}
+
+	DeltaHeader header = {};
+	memcpy(header.magic, DELTA_MAGIC, sizeof(header.magic));
+	header.version = DELTA_VERSION;
+	header.blockSize = bs;
+	header.sourceBlocks = srcBlocks;
+	header.targetBlocks = dstBlocks;
+	header.opCount = ops.size();
+	int fd = open(payloadPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if(fd == -1) {
+		fprintf(stderr, "Opening %s failed: %s\n", payloadPath.c_str(), strerror(errno));
+		return false;
+	}
+	ok = pwriteFully(fd, &header, sizeof(header), 0) &&
+		pwriteFully(fd, ops.data(), ops.size() * sizeof(DeltaOp), sizeof(header)) &&
+		pwriteFully(fd, data.data(), data.size(), sizeof(header) + ops.size() * sizeof(DeltaOp));
+	ok = close(fd) == 0 && ok;
+	if(ok)
+		fprintf(stderr, "%zu ops, %zu bytes of data for a %llu bytes image\n", ops.size(), data.size(), (unsigned long long)target.size);
+	return ok;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+// Block delta payload: rebuilds a target image from the source image it was
+// made against, so an update only ships the blocks that changed.
+//
+// Little endian: a DeltaHeader, opCount DeltaOps, then the data of the NEW
+// and PATCH ops. Each op writes blockCount blocks at dstBlock, and the ops
+// cover the target exactly once:
+// - COPY copies the blocks at srcBlock of the source
+// - ZERO zeroes the blocks
+// - NEW decompresses its data, a zstd frame
+// - PATCH decompresses its data, a zstd frame compressed with the
+//   blockCount source blocks at srcBlock as prefix (as zstd --patch-from
+//   does), so it only carries what changed
+// srcSha256 covers the source blocks an op reads, dstSha256 what it writes.
+
+#define DELTA_MAGIC "PHHDELTA"
+#define DELTA_VERSION 1
+// Bytes an op may write. Bounds the memory of every worker, and leaves ops
+// to spread over them. It also caps the block size
+#define DELTA_MAX_OP_BYTES (1024 * 1024)
+
+struct DeltaHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t blockSize;
+	uint64_t sourceBlocks;
+	uint64_t targetBlocks;
+	uint32_t opCount;
+	uint32_t reserved;
+};
+static_assert(sizeof(DeltaHeader) == 40, "DeltaHeader is part of the payload format");
+
+enum DeltaOpType : uint32_t {
+	DELTA_COPY = 0,
+	DELTA_ZERO = 1,
+	DELTA_NEW = 2,
+	DELTA_PATCH = 3,
+};
+
+struct DeltaOp {
+	uint32_t type;
+	uint32_t reserved;
+	uint64_t dstBlock;
+	uint64_t blockCount;
+	uint64_t srcBlock;
+	// Within the data following the ops
+	uint64_t dataOffset;
+	uint64_t dataLength;
+	uint8_t srcSha256[32];
+	uint8_t dstSha256[32];
+};
+static_assert(sizeof(DeltaOp) == 112, "DeltaOp is part of the payload format");
+
+struct DeltaOptions {
+	std::string payload;
+	std::string source;
+	std::string target;
+	// 0 for one per CPU
+	unsigned workers = 0;
+};
+
+// Applies the payload to the source into the target. Returns false, after
+// saying why on stderr, if the payload is malformed, the source isn't the
+// one it was made against or a block doesn't come out as expected
+bool applyDelta(const DeltaOptions& opts);
+
+// Writes the payload turning the source image into the target image
+bool makeDelta(const std::string& source, const std::string& target, const std::string& payload);
@@ -0,0 +1,125 @@
+#include "ota_delta.h"
+
+#include <gtest/gtest.h>
+#include <android-base/file.h>
+
+#include <random>
+#include <string>
+
+namespace {
+
+constexpr size_t kBlock = 4096;
+
+std::string randomBlocks(std::mt19937 *rng, size_t blocks) {
+	std::string data(blocks * kBlock, '\0');
+	for(auto& c : data) c = (*rng)() % 64;
+	return data;
+}
+
+class DeltaTest : public ::testing::Test {
+protected:
+	DeltaTest() {
+		std::mt19937 rng(7);
+		source = randomBlocks(&rng, 2000);
+		// A monthly update: a few blocks edited in place, a run moved, a
+		// zeroed area, and new blocks at the end
+		target = source;
+		for(size_t b : { 3, 700, 701, 702, 1500 })
+			for(size_t i = 0; i < 100; i++) target[b * kBlock + i * 37] ^= 0x55;
+		target.replace(1000 * kBlock, 50 * kBlock, source.substr(100 * kBlock, 50 * kBlock));
+		target.replace(1200 * kBlock, 20 * kBlock, std::string(20 * kBlock, '\0'));
+		target += randomBlocks(&rng, 30);
+		write(sourceFile, source);
+		write(targetFile, target);
+		opts.payload = payload.path;
+		opts.source = sourceFile.path;
+		opts.target = out.path;
+		opts.workers = 4;
+	}
+
+	static void write(const TemporaryFile& file, const std::string& content) {
+		ASSERT_TRUE(android::base::WriteStringToFile(content, file.path));
+	}
+
+	std::string output() {
+		std::string content;
+		EXPECT_TRUE(android::base::ReadFileToString(out.path, &content));
+		return content;
+	}
+
+	std::string source, target;
+	TemporaryFile sourceFile, targetFile, payload, out;
+	DeltaOptions opts;
+};
+
+TEST_F(DeltaTest, RebuildsTarget) {
+	ASSERT_TRUE(makeDelta(sourceFile.path, targetFile.path, payload.path));
+	ASSERT_TRUE(applyDelta(opts));
+	EXPECT_EQ(output(), target);
+}
+
+TEST_F(DeltaTest, OnlyShipsWhatChanged) {
+	ASSERT_TRUE(makeDelta(sourceFile.path, targetFile.path, payload.path));
+	std::string delta;
+	ASSERT_TRUE(android::base::ReadFileToString(payload.path, &delta));
+	// The 30 new blocks of random data dominate
+	EXPECT_LT(delta.size(), 40 * kBlock);
+}
+
+TEST_F(DeltaTest, RejectsAnotherSource) {
+	ASSERT_TRUE(makeDelta(sourceFile.path, targetFile.path, payload.path));
+	source[1800 * kBlock] ^= 1;
+	write(sourceFile, source);
+	EXPECT_FALSE(applyDelta(opts));
+}
+
+TEST_F(DeltaTest, RejectsCorruptedData) {
+	ASSERT_TRUE(makeDelta(sourceFile.path, targetFile.path, payload.path));
+	std::string delta;
+	ASSERT_TRUE(android::base::ReadFileToString(payload.path, &delta));
+	delta[delta.size() - 100] ^= 1;
+	write(payload, delta);
+	EXPECT_FALSE(applyDelta(opts));
+}
+
+TEST_F(DeltaTest, RejectsIncompleteCoverage) {
+	ASSERT_TRUE(makeDelta(sourceFile.path, targetFile.path, payload.path));
+	std::string delta;
+	ASSERT_TRUE(android::base::ReadFileToString(payload.path, &delta));
+	DeltaOp op;
+	memcpy(&op, &delta[sizeof(DeltaHeader)], sizeof(op));
+	op.dstBlock++;
+	memcpy(&delta[sizeof(DeltaHeader)], &op, sizeof(op));
+	write(payload, delta);
+	EXPECT_FALSE(applyDelta(opts));
+}
+
+TEST_F(DeltaTest, RejectsOverlappingOps) {
+	ASSERT_TRUE(makeDelta(sourceFile.path, targetFile.path, payload.path));
+	std::string delta;
+	ASSERT_TRUE(android::base::ReadFileToString(payload.path, &delta));
+	// Writes the first blocks a second time, after all the others
+	DeltaHeader header;
+	memcpy(&header, delta.data(), sizeof(header));
+	std::string first = delta.substr(sizeof(DeltaHeader), sizeof(DeltaOp));
+	delta.insert(sizeof(DeltaHeader) + header.opCount * sizeof(DeltaOp), first);
+	header.opCount++;
+	memcpy(&delta[0], &header, sizeof(header));
+	write(payload, delta);
+	EXPECT_FALSE(applyDelta(opts));
+}
+
+TEST_F(DeltaTest, RejectsWrappingBlockNumbers) {
+	ASSERT_TRUE(makeDelta(sourceFile.path, targetFile.path, payload.path));
+	std::string delta;
+	ASSERT_TRUE(android::base::ReadFileToString(payload.path, &delta));
+	DeltaOp op;
+	memcpy(&op, &delta[sizeof(DeltaHeader)], sizeof(op));
+	op.srcBlock = -op.blockCount;
+	op.dstBlock = -op.blockCount;
+	memcpy(&delta[sizeof(DeltaHeader)], &op, sizeof(op));
+	write(payload, delta);
+	EXPECT_FALSE(applyDelta(opts));
+}
+
+}  // namespace
@@ -0,0 +1,1052 @@
+#include "ota_install.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <7zCrc.h>
+#include <Xz.h>
+#include <XzCrc64.h>
+#include <openssl/sha.h>
+#include <zstd.h>
+
+namespace {
+
+// Output buffers are written with O_DIRECT, so they are aligned for any
+// logical block size, and large enough for the device to see big requests
+constexpr size_t kAlign = 4096;
+constexpr size_t kBufSize = 4 * 1024 * 1024;
+constexpr size_t kDepth = 4;
+constexpr size_t kInBufSize = 1024 * 1024;
+
+// Where decoding can start over with a fresh decoder
+struct ResumePoint {
+	uint64_t in;
+	uint64_t out;
+	// Header of the xz stream the block at in belongs to
+	std::string xzHeader;
+};
+
+class Decoder {
+public:
+	virtual ~Decoder() {}
+	virtual const char *format() const = 0;
+
+	static constexpr int kCorrupted = -2;
+
+	// Consumes from in and produces into out, advancing both. inputEnd says
+	// no input will come after in. Returns kCorrupted when the input isn't
+	// what the format says, -1 when it is truncated or decoding fails for
+	// another reason, 1 once the stream is fully decoded, 0 otherwise
+	int step(const uint8_t **in, size_t *inLen, uint8_t **out, size_t *outLen, bool inputEnd) {
+		const uint8_t *in0 = *in;
+		const uint8_t *out0 = *out;
+		int ret = decode(in, inLen, out, outLen, inputEnd);
+		consumed += *in - in0;
+		produced += *out - out0;
+		return ret;
+	}
+
+	// Starts at a resume point instead of the start of the stream
+	virtual bool resume(const ResumePoint& point) {
+		consumed = point.in;
+		produced = point.out;
+		return true;
+	}
+
+	// Resume points found so far, in order
+	std::vector<ResumePoint> points;
+
+protected:
+	virtual int decode(const uint8_t **in, size_t *inLen, uint8_t **out, size_t *outLen, bool inputEnd) = 0;
+
+	// Input and output offsets of the step in progress
+	uint64_t consumed = 0;
+	uint64_t produced = 0;
+};
+
+class RawDecoder : public Decoder {
+public:
+	const char *format() const override {
+		return "raw";
+	}
+
+protected:
+	int decode(const uint8_t **in, size_t *inLen, uint8_t **out, size_t *outLen, bool inputEnd) override {
+		size_t n = *inLen < *outLen ? *inLen : *outLen;
+		memcpy(*out, *in, n);
+		*in += n;
+		*inLen -= n;
+		*out += n;
+		*outLen -= n;
+		// Anywhere will do, once per buffer is plenty
+		if(n && (produced + n) % kBufSize == 0)
+			points.push_back({ consumed + n, produced + n, "" });
+		return inputEnd && *inLen == 0 ? 1 : 0;
+	}
+};
+
+// Size of the integrity check that ends every block
+size_t xzCheckSize(CXzStreamFlags flags) {
+	unsigned type = XzFlags_GetCheckType(flags);
+	return type == 0 ? 0 : 4 << ((type - 1) / 3);
+}
+
+const ISzAlloc kXzAlloc = {
+	[](ISzAllocPtr, size_t size) -> void* { return malloc(size); },
+	[](ISzAllocPtr, void *address) { free(address); },
+};
+
+// Decodes with the LZMA SDK's unpacker, one block at a time: set up for
+// random access, an unpacker only needs the flags of the stream header to
+// decode a block. The decoder follows the container itself, stream
+// headers, blocks, indexes, footers and padding, and hands every block to
+// an unpacker of its own.
+//
+// xz -T writes the compressed and uncompressed sizes in every block header,
+// so those blocks are buffered whole and decoded by the worker threads, and
+// their output copied out in order. A block without sizes is decoded as it
+// streams in, in the calling thread, once the blocks before it are out.
+//
+// Resuming at a block only takes the stream header it belongs to. The
+// index of a resumed stream lists blocks that weren't decoded, so it isn't
+// checked against them.
+class XzDecoder : public Decoder {
+public:
+	~XzDecoder() {
+		{
+			std::lock_guard<std::mutex> l(lock);
+			stopping = true;
+		}
+		cond.notify_all();
+		for(auto& worker : workers) worker.join();
+		XzUnpacker_Free(&seq);
+	}
+
+	const char *format() const override {
+		return "xz";
+	}
+
+	bool resume(const ResumePoint& point) override {
+		Decoder::resume(point);
+		if(point.xzHeader.size() != XZ_STREAM_HEADER_SIZE ||
+				Xz_ParseHeader(&flags, (const Byte*)point.xzHeader.data()) != SZ_OK)
+			return false;
+		streamHeader = point.xzHeader;
+		scheduledOut = point.out;
+		resumedStream = true;
+		state = State::BlockStart;
+		return true;
+	}
+
+	bool init(unsigned threads) {
+		static std::once_flag tables;
+		std::call_once(tables, [] {
+			CrcGenerateTable();
+			Crc64GenerateTable();
+		});
+		XzUnpacker_Construct(&seq, &kXzAlloc);
+		// Blocks in flight are held packed and unpacked, keep them within a
+		// quarter of the memory rather than push a phone into the OOM killer
+		memBudget = (uint64_t)sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGESIZE) / 4;
+		maxJobs = 2 * threads;
+		for(unsigned i = 0; i < threads; i++)
+			workers.emplace_back(&XzDecoder::work, this);
+		return true;
+	}
+
+protected:
+	int decode(const uint8_t **in, size_t *inLen, uint8_t **out, size_t *outLen, bool inputEnd) override {
+		const uint8_t *start = *in;
+		while(*outLen) {
+			if(!jobs.empty() && headDone()) {
+				if(!jobs.front()->ok) {
+					fprintf(stderr, "xz block is corrupted\n");
+					return kCorrupted;
+				}
+				emit(out, outLen);
+				continue;
+			}
+			if(seqActive) {
+				int ret = seqStep(in, inLen, out, outLen, inputEnd);
+				if(ret < 0) return ret;
+				// Out of input
+				if(ret > 0) return 0;
+				continue;
+			}
+			bool full = jobs.size() >= maxJobs || inFlight >= memBudget;
+			if(state == State::SeqWait && jobs.empty()) {
+				startSeq();
+				continue;
+			}
+			if(state != State::SeqWait && !full && *inLen) {
+				if(!scan(in, inLen, consumed + (*in - start))) {
+					fprintf(stderr, "xz container is corrupted around %llu\n",
+							(unsigned long long)(consumed + (*in - start)));
+					return kCorrupted;
+				}
+				continue;
+			}
+			if(!jobs.empty()) {
+				waitHead();
+				continue;
+			}
+			if(*inLen) continue;
+			if(!inputEnd) return 0;
+			if(state == State::Padding) return 1;
+			fprintf(stderr, "xz stream is truncated\n");
+			return -1;
+		}
+		return 0;
+	}
+
+private:
+	enum class State { StreamHeader, BlockStart, BlockHeader, BlockData, SeqWait, Index, IndexPadding, IndexCrc, Footer, Padding };
+
+	struct Job {
+		CXzStreamFlags flags;
+		std::vector<uint8_t> packed;
+		std::vector<uint8_t> unpacked;
+		size_t emitted = 0;
+		// Under lock
+		bool done = false;
+		bool ok = false;
+	};
+
+	// Consumes input until it runs out, a block has to be decoded in this
+	// thread or enough blocks are in flight. Returns false on a malformed
+	// container
+	bool scan(const uint8_t **in, size_t *inLen, uint64_t offset) {
+		const uint8_t *data = *in;
+		size_t len = *inLen;
+		size_t i = 0;
+		while(i < len && state != State::SeqWait && jobs.size() < maxJobs && inFlight < memBudget) {
+			switch(state) {
+			case State::SeqWait:
+				break;
+			case State::StreamHeader:
+				acc += data[i++];
+				if(acc.size() == XZ_STREAM_HEADER_SIZE) {
+					if(Xz_ParseHeader(&flags, (const Byte*)acc.data()) != SZ_OK) return false;
+					streamHeader = acc;
+					blocks.clear();
+					state = State::BlockStart;
+				}
+				break;
+			case State::BlockStart:
+				if(data[i] == 0) {
+					// Index indicator
+					indexPos = 1;
+					vli = 0;
+					shift = 0;
+					vlisLeft = UINT64_MAX;
+					records.clear();
+					state = State::Index;
+				} else {
+					blockStart = offset + i;
+					acc.assign(1, data[i]);
+					state = State::BlockHeader;
+				}
+				i++;
+				break;
+			case State::BlockHeader:
+				acc += data[i++];
+				if(acc.size() == ((size_t)(uint8_t)acc[0] + 1) * 4 && !blockHeader()) return false;
+				break;
+			case State::BlockData: {
+				size_t n = std::min<uint64_t>(left, len - i);
+				current->packed.insert(current->packed.end(), data + i, data + i + n);
+				i += n;
+				left -= n;
+				if(left == 0) submit();
+				break;
+			}
+			case State::Index: {
+				uint8_t b = data[i++];
+				indexPos++;
+				if(shift > 56) return false;
+				vli |= (uint64_t)(b & 0x7f) << shift;
+				shift += 7;
+				if(b & 0x80) break;
+				// Number of records, then two sizes per record
+				if(vlisLeft == UINT64_MAX) {
+					vlisLeft = 2 * vli;
+				} else {
+					records.push_back(vli);
+					vlisLeft--;
+				}
+				vli = 0;
+				shift = 0;
+				if(vlisLeft == 0) state = State::IndexPadding;
+				break;
+			}
+			case State::IndexPadding:
+				if(indexPos % 4 == 0) {
+					if(!resumedStream && !indexMatches()) return false;
+					left = 4;
+					state = State::IndexCrc;
+					break;
+				}
+				if(data[i++] != 0) return false;
+				indexPos++;
+				break;
+			case State::IndexCrc: {
+				size_t n = std::min<uint64_t>(left, len - i);
+				i += n;
+				left -= n;
+				if(left == 0) {
+					acc.clear();
+					state = State::Footer;
+				}
+				break;
+			}
+			case State::Footer:
+				acc += data[i++];
+				if(acc.size() == XZ_STREAM_FOOTER_SIZE) {
+					// Same flags as the header, then the footer magic
+					if(acc.compare(8, 2, streamHeader, 6, 2) != 0 || acc.compare(10, 2, "YZ") != 0) return false;
+					resumedStream = false;
+					state = State::Padding;
+				}
+				break;
+			case State::Padding:
+				// Stream padding, or the next stream
+				if(data[i] == 0) {
+					i++;
+				} else {
+					acc.clear();
+					state = State::StreamHeader;
+				}
+				break;
+			}
+		}
+		*in += i;
+		*inLen -= i;
+		return true;
+	}
+
+	bool blockHeader() {
+		CXzBlock block;
+		if(XzBlock_Parse(&block, (const Byte*)acc.data()) != SZ_OK) return false;
+		points.push_back({ blockStart, scheduledOut, streamHeader });
+		// A block that would take more than half the budget on its own is
+		// streamed too
+		if(!XzBlock_HasPackSize(&block) || !XzBlock_HasUnpackSize(&block) ||
+				block.packSize > memBudget / 2 || block.unpackSize > memBudget / 2 ||
+				block.packSize + block.unpackSize > memBudget / 2) {
+			state = State::SeqWait;
+			return true;
+		}
+		uint64_t total = ((acc.size() + block.packSize + 3) & ~3ull) + xzCheckSize(flags);
+		current = std::make_shared<Job>();
+		current->flags = flags;
+		current->packed.reserve(total);
+		current->packed.assign(acc.begin(), acc.end());
+		current->unpacked.resize(block.unpackSize);
+		left = total - acc.size();
+		state = State::BlockData;
+		return true;
+	}
+
+	void submit() {
+		blocks.push_back({ current->packed.size(), current->unpacked.size() });
+		scheduledOut += current->unpacked.size();
+		inFlight += current->packed.size() + current->unpacked.size();
+		jobs.push_back(current);
+		{
+			std::lock_guard<std::mutex> l(lock);
+			todo.push_back(std::move(current));
+		}
+		cond.notify_all();
+		state = State::BlockStart;
+	}
+
+	// The index records blocks by unpadded size, what the blocks took is that
+	// rounded up to 4 bytes
+	bool indexMatches() const {
+		if(records.size() != 2 * blocks.size()) return false;
+		for(size_t b = 0; b < blocks.size(); b++) {
+			if(((records[2 * b] + 3) & ~3ull) != blocks[b].first || records[2 * b + 1] != blocks[b].second)
+				return false;
+		}
+		return true;
+	}
+
+	void work() {
+		CXzUnpacker unpacker;
+		XzUnpacker_Construct(&unpacker, &kXzAlloc);
+		while(true) {
+			std::shared_ptr<Job> job;
+			{
+				std::unique_lock<std::mutex> l(lock);
+				cond.wait(l, [this] { return stopping || !todo.empty(); });
+				if(stopping) break;
+				job = std::move(todo.front());
+				todo.pop_front();
+			}
+			bool ok = decodeBlock(&unpacker, job.get());
+			{
+				std::lock_guard<std::mutex> l(lock);
+				job->done = true;
+				job->ok = ok;
+			}
+			cond.notify_all();
+		}
+		XzUnpacker_Free(&unpacker);
+	}
+
+	static bool decodeBlock(CXzUnpacker *unpacker, Job *job) {
+		XzUnpacker_Init(unpacker);
+		unpacker->streamFlags = job->flags;
+		XzUnpacker_PrepareToRandomBlockDecoding(unpacker);
+		size_t inPos = 0, outPos = 0;
+		while(true) {
+			SizeT inLen = job->packed.size() - inPos;
+			SizeT outLen = job->unpacked.size() - outPos;
+			ECoderStatus status;
+			SRes res = XzUnpacker_Code(unpacker, job->unpacked.data() + outPos, &outLen,
+					job->packed.data() + inPos, &inLen, 1, CODER_FINISH_END, &status);
+			if(res != SZ_OK) return false;
+			inPos += inLen;
+			outPos += outLen;
+			if(status == CODER_STATUS_FINISHED_WITH_MARK)
+				return inPos == job->packed.size() && outPos == job->unpacked.size();
+			if(inLen == 0 && outLen == 0) return false;
+		}
+	}
+
+	bool headDone() {
+		std::lock_guard<std::mutex> l(lock);
+		return jobs.front()->done;
+	}
+
+	void waitHead() {
+		std::unique_lock<std::mutex> l(lock);
+		cond.wait(l, [this] { return jobs.front()->done; });
+	}
+
+	void emit(uint8_t **out, size_t *outLen) {
+		Job *job = jobs.front().get();
+		size_t n = std::min(*outLen, job->unpacked.size() - job->emitted);
+		memcpy(*out, job->unpacked.data() + job->emitted, n);
+		job->emitted += n;
+		*out += n;
+		*outLen -= n;
+		if(job->emitted == job->unpacked.size()) {
+			inFlight -= job->packed.size() + job->unpacked.size();
+			jobs.pop_front();
+		}
+	}
+
+	void startSeq() {
+		XzUnpacker_Init(&seq);
+		seq.streamFlags = flags;
+		XzUnpacker_PrepareToRandomBlockDecoding(&seq);
+		// The unpacker gets the header the scanner already took first
+		seqHeaderPos = 0;
+		seqIn = 0;
+		seqOut = 0;
+		seqActive = true;
+	}
+
+	// Returns -1 when truncated, kCorrupted on corrupted data, 1 when it needs
+	// more input, 0 otherwise
+	int seqStep(const uint8_t **in, size_t *inLen, uint8_t **out, size_t *outLen, bool inputEnd) {
+		bool fromHeader = seqHeaderPos < acc.size();
+		const uint8_t *src = fromHeader ? (const uint8_t*)acc.data() + seqHeaderPos : *in;
+		SizeT srcLen = fromHeader ? acc.size() - seqHeaderPos : *inLen;
+		SizeT dstLen = *outLen;
+		ECoderStatus status;
+		SRes res = XzUnpacker_Code(&seq, *out, &dstLen, src, &srcLen, inputEnd && !fromHeader, CODER_FINISH_ANY, &status);
+		if(fromHeader) {
+			seqHeaderPos += srcLen;
+		} else {
+			*in += srcLen;
+			*inLen -= srcLen;
+		}
+		*out += dstLen;
+		*outLen -= dstLen;
+		seqIn += srcLen;
+		seqOut += dstLen;
+		scheduledOut += dstLen;
+		if(res == SZ_ERROR_INPUT_EOF || (res == SZ_OK && status != CODER_STATUS_FINISHED_WITH_MARK &&
+					srcLen == 0 && dstLen == 0 && *inLen == 0 && inputEnd)) {
+			fprintf(stderr, "xz stream is truncated\n");
+			return -1;
+		}
+		if(res != SZ_OK) {
+			fprintf(stderr, "xz decoding failed: %d\n", res);
+			return kCorrupted;
+		}
+		if(status == CODER_STATUS_FINISHED_WITH_MARK) {
+			blocks.push_back({ seqIn, seqOut });
+			seqActive = false;
+			state = State::BlockStart;
+		} else if(srcLen == 0 && dstLen == 0) {
+			if(*inLen == 0) return 1;
+			fprintf(stderr, "xz decoding is stuck\n");
+			return kCorrupted;
+		}
+		return 0;
+	}
+
+	// Container, of the decoder thread only
+	State state = State::StreamHeader;
+	CXzStreamFlags flags = 0;
+	std::string streamHeader;
+	bool resumedStream = false;
+	// Header being accumulated
+	std::string acc;
+	uint64_t blockStart = 0;
+	// Output offset the next block starts at
+	uint64_t scheduledOut = 0;
+	// Bytes left of the block data or the index CRC
+	uint64_t left = 0;
+	// Sizes the blocks of the current stream took, and their uncompressed
+	// sizes, to check the index against
+	std::vector<std::pair<uint64_t, uint64_t>> blocks;
+	std::vector<uint64_t> records;
+	uint64_t indexPos = 0;
+	uint64_t vli = 0;
+	unsigned shift = 0;
+	uint64_t vlisLeft = 0;
+
+	// Blocks decoded by the workers, in stream order
+	std::shared_ptr<Job> current;
+	std::deque<std::shared_ptr<Job>> jobs;
+	uint64_t inFlight = 0;
+	uint64_t memBudget = 0;
+	size_t maxJobs = 0;
+
+	// Block decoded in this thread
+	CXzUnpacker seq;
+	bool seqActive = false;
+	size_t seqHeaderPos = 0;
+	uint64_t seqIn = 0;
+	uint64_t seqOut = 0;
+
+	std::mutex lock;
+	std::condition_variable cond;
+	std::deque<std::shared_ptr<Job>> todo;
+	std::vector<std::thread> workers;
+	bool stopping = false;
+};
+
+// libzstd only decodes in the calling thread; the decoder thread still
+// overlaps it with hashing and writing
+class ZstdDecoder : public Decoder {
+public:
+	~ZstdDecoder() {
+		ZSTD_freeDCtx(ctx);
+	}
+
+	bool init() {
+		ctx = ZSTD_createDCtx();
+		return ctx != nullptr;
+	}
+
+	const char *format() const override {
+		return "zstd";
+	}
+
+	bool resume(const ResumePoint& point) override {
+		// A frame has to follow, the end of the input right away means the
+		// download dropped rather than the stream ended
+		frameDone = false;
+		return Decoder::resume(point);
+	}
+
+protected:
+	int decode(const uint8_t **in, size_t *inLen, uint8_t **out, size_t *outLen, bool inputEnd) override {
+		ZSTD_inBuffer inBuf = { *in, *inLen, 0 };
+		ZSTD_outBuffer outBuf = { *out, *outLen, 0 };
+		size_t ret = ZSTD_decompressStream(ctx, &outBuf, &inBuf);
+		*in += inBuf.pos;
+		*inLen -= inBuf.pos;
+		*out += outBuf.pos;
+		*outLen -= outBuf.pos;
+		if(ZSTD_isError(ret)) {
+			fprintf(stderr, "zstd decoding failed: %s\n", ZSTD_getErrorName(ret));
+			return kCorrupted;
+		}
+		// 0 means the frame is complete and flushed, there may be another one.
+		// Called again with nothing to decode, libzstd asks for the next
+		// frame's header
+		if(inBuf.pos || outBuf.pos) {
+			frameDone = ret == 0;
+			if(frameDone) points.push_back({ consumed + inBuf.pos, produced + outBuf.pos, "" });
+		}
+		if(inputEnd && *inLen == 0) {
+			if(frameDone) return 1;
+			if(inBuf.pos == 0 && outBuf.pos == 0) {
+				fprintf(stderr, "zstd stream is truncated\n");
+				return -1;
+			}
+		}
+		return 0;
+	}
+
+private:
+	ZSTD_DCtx *ctx = nullptr;
+	bool frameDone = true;
+};
+
+std::string detectFormat(const uint8_t *magic, size_t len) {
+	static const uint8_t xzMagic[] = { 0xfd, '7', 'z', 'X', 'Z', 0x00 };
+	static const uint8_t zstdMagic[] = { 0x28, 0xb5, 0x2f, 0xfd };
+	if(len >= sizeof(xzMagic) && memcmp(magic, xzMagic, sizeof(xzMagic)) == 0) return "xz";
+	if(len >= sizeof(zstdMagic) && memcmp(magic, zstdMagic, sizeof(zstdMagic)) == 0) return "zstd";
+	return "raw";
+}
+
+std::unique_ptr<Decoder> makeDecoder(const std::string& format, unsigned threads) {
+	if(format == "xz") {
+		auto dec = std::make_unique<XzDecoder>();
+		if(!dec->init(threads)) return nullptr;
+		fprintf(stderr, "Decoding xz stream with up to %u threads\n", threads);
+		return dec;
+	}
+	if(format == "zstd") {
+		auto dec = std::make_unique<ZstdDecoder>();
+		if(!dec->init()) return nullptr;
+		fprintf(stderr, "Decoding zstd stream\n");
+		return dec;
+	}
+	fprintf(stderr, "Input isn't xz nor zstd, copying it as is\n");
+	return std::make_unique<RawDecoder>();
+}
+
+ssize_t readSome(int fd, uint8_t *buf, size_t len) {
+	while(true) {
+		ssize_t res = read(fd, buf, len);
+		if(res == -1 && errno == EINTR) continue;
+		return res;
+	}
+}
+
+// Ring of decoded buffers, filled by the decoder thread and drained by the
+// writer
+struct Ring {
+	std::mutex lock;
+	std::condition_variable cond;
+	uint8_t *bufs[kDepth] = {};
+	size_t lens[kDepth] = {};
+	uint64_t head = 0;
+	uint64_t tail = 0;
+	bool ended = false;
+	bool failed = false;
+	// The decoder rejected the input at the resume point: it doesn't start
+	// there, the checkpoint is no use with it
+	bool rejected = false;
+	// Resume points the writer hasn't reached yet
+	std::deque<ResumePoint> points;
+	std::string format;
+};
+
+// Where an interrupted install resumes, as saved in the checkpoint file
+struct Checkpoint {
+	std::string streamId;
+	std::string format;
+	ResumePoint point;
+	// Of the output up to point.out
+	std::string sha256;
+};
+
+std::string toHex(const uint8_t *data, size_t len) {
+	static const char hex[] = "0123456789abcdef";
+	std::string res;
+	for(size_t i = 0; i < len; i++) {
+		res += hex[data[i] >> 4];
+		res += hex[data[i] & 0xf];
+	}
+	return res;
+}
+
+std::string fromHex(const std::string& hex) {
+	std::string res;
+	for(size_t i = 0; i + 1 < hex.size(); i += 2)
+		res += (char)strtoul(hex.substr(i, 2).c_str(), nullptr, 16);
+	return res;
+}
+
+bool readCheckpoint(const std::string& path, Checkpoint *cp) {
+	FILE *f = fopen(path.c_str(), "re");
+	if(f == nullptr) return false;
+	char line[4096];
+	int fields = 0;
+	while(fgets(line, sizeof(line), f)) {
+		std::string l(line);
+		if(!l.empty() && l.back() == '\n') l.pop_back();
+		size_t sep = l.find(' ');
+		if(sep == std::string::npos) continue;
+		std::string key = l.substr(0, sep), value = l.substr(sep + 1);
+		if(key == "id") cp->streamId = value;
+		else if(key == "format") cp->format = value;
+		else if(key == "in") cp->point.in = strtoull(value.c_str(), nullptr, 10);
+		else if(key == "out") cp->point.out = strtoull(value.c_str(), nullptr, 10);
+		else if(key == "xz_header") cp->point.xzHeader = fromHex(value);
+		else if(key == "sha256") cp->sha256 = value;
+		else continue;
+		fields++;
+	}
+	fclose(f);
+	return fields >= 5;
+}
+
+// Replaces the checkpoint atomically, a crash leaves the previous one
+bool writeCheckpoint(const std::string& path, const Checkpoint& cp) {
+	std::string tmp = path + ".tmp";
+	FILE *f = fopen(tmp.c_str(), "we");
+	if(f == nullptr) return false;
+	fprintf(f, "id %s\nformat %s\nin %llu\nout %llu\nsha256 %s\n", cp.streamId.c_str(), cp.format.c_str(),
+			(unsigned long long)cp.point.in, (unsigned long long)cp.point.out, cp.sha256.c_str());
+	if(!cp.point.xzHeader.empty())
+		fprintf(f, "xz_header %s\n", toHex((const uint8_t*)cp.point.xzHeader.data(), cp.point.xzHeader.size()).c_str());
+	bool ok = fflush(f) == 0 && fsync(fileno(f)) == 0;
+	ok = fclose(f) == 0 && ok;
+	return ok && rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+void decodeAll(int inFd, unsigned threads, const Checkpoint *resume, Ring *ring) {
+	std::vector<uint8_t> inBuf(kInBufSize);
+	size_t inPos = 0, inLen = 0;
+	bool inputEnd = false;
+	bool ok = true;
+
+	ssize_t res = readSome(inFd, inBuf.data(), inBuf.size());
+	if(res < 0) {
+		fprintf(stderr, "Reading input failed: %s\n", strerror(errno));
+		ok = false;
+	} else {
+		inLen = res;
+		inputEnd = res == 0;
+	}
+	std::unique_ptr<Decoder> dec;
+	if(ok) {
+		std::string format = resume ? resume->format : detectFormat(inBuf.data(), inLen);
+		dec = makeDecoder(format, threads);
+		ok = dec != nullptr && (!resume || dec->resume(resume->point));
+		std::lock_guard<std::mutex> l(ring->lock);
+		ring->format = format;
+	}
+
+	bool streamEnd = false;
+	// A resumed decoder finds its first point where it starts, or at the
+	// end of the first zstd frame; past it, the input is known to line up
+	bool pastResumePoint = false;
+	bool rejected = false;
+	while(ok && !streamEnd) {
+		uint8_t *buf;
+		{
+			std::unique_lock<std::mutex> l(ring->lock);
+			ring->cond.wait(l, [ring] { return ring->head - ring->tail < kDepth || ring->failed; });
+			if(ring->failed) return;
+			buf = ring->bufs[ring->head % kDepth];
+		}
+
+		uint8_t *out = buf;
+		size_t outLen = kBufSize;
+		while(outLen && !streamEnd) {
+			if(inPos == inLen && !inputEnd) {
+				res = readSome(inFd, inBuf.data(), inBuf.size());
+				if(res < 0) {
+					fprintf(stderr, "Reading input failed: %s\n", strerror(errno));
+					ok = false;
+					break;
+				}
+				inPos = 0;
+				inLen = res;
+				inputEnd = res == 0;
+			}
+			const uint8_t *in = inBuf.data() + inPos;
+			size_t left = inLen - inPos;
+			int ret = dec->step(&in, &left, &out, &outLen, inputEnd);
+			inPos = inLen - left;
+			if(!dec->points.empty()) pastResumePoint = true;
+			if(ret < 0) {
+				rejected = resume && !pastResumePoint && ret == Decoder::kCorrupted;
+				ok = false;
+				break;
+			}
+			streamEnd = ret > 0;
+		}
+		if(!ok) break;
+
+		std::lock_guard<std::mutex> l(ring->lock);
+		ring->lens[ring->head % kDepth] = out - buf;
+		ring->head++;
+		ring->points.insert(ring->points.end(), dec->points.begin(), dec->points.end());
+		dec->points.clear();
+		ring->ended = streamEnd;
+		ring->cond.notify_all();
+	}
+
+	if(!ok) {
+		std::lock_guard<std::mutex> l(ring->lock);
+		ring->failed = true;
+		ring->rejected = rejected;
+		ring->cond.notify_all();
+	}
+}
+
+class Output {
+public:
+	~Output() {
+		if(directFd != -1) close(directFd);
+		if(fd != -1) close(fd);
+	}
+
+	bool open(const std::string& path) {
+		fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+		if(fd == -1) {
+			fprintf(stderr, "Opening %s failed: %s\n", path.c_str(), strerror(errno));
+			return false;
+		}
+		struct stat sb;
+		if(fstat(fd, &sb) != 0) return false;
+		isFile = S_ISREG(sb.st_mode);
+		// tmpfs and some dm targets refuse O_DIRECT, buffered writes are
+		// fine there
+		directFd = ::open(path.c_str(), O_WRONLY | O_DIRECT | O_CLOEXEC);
+		return true;
+	}
+
+	bool write(const uint8_t *buf, size_t len) {
+		// Everything but the tail of the image goes through O_DIRECT
+		size_t direct = directFd == -1 ? 0 : len & ~(kAlign - 1);
+		uint64_t start = pos;
+		if(direct && !writeFd(directFd, buf, direct)) {
+			if(errno != EINVAL) return false;
+			close(directFd);
+			directFd = -1;
+		}
+		size_t done = pos - start;
+		return writeFd(fd, buf + done, len - done);
+	}
+
+	bool finish() {
+		// A plain file may have held a bigger image before
+		if(isFile && ftruncate(fd, pos) != 0) return false;
+		return fsync(fd) == 0;
+	}
+
+	// Makes what was written so far durable, before a checkpoint says so
+	bool sync() {
+		return fdatasync(fd) == 0;
+	}
+
+	void seek(uint64_t offset) {
+		pos = offset;
+	}
+
+	uint64_t written() const {
+		return pos;
+	}
+
+private:
+	bool writeFd(int outFd, const uint8_t *buf, size_t len) {
+		while(len) {
+			ssize_t res = pwrite(outFd, buf, len, pos);
+			if(res == -1 && errno == EINTR) continue;
+			if(res <= 0) {
+				if(res == 0) errno = ENOSPC;
+				return false;
+			}
+			buf += res;
+			len -= res;
+			pos += res;
+		}
+		return true;
+	}
+
+	int fd = -1;
+	int directFd = -1;
+	bool isFile = false;
+	uint64_t pos = 0;
+};
+
+// Hashes the output up to len into sha, which must match digest
+bool hashPrefix(const std::string& path, uint64_t len, const std::string& digest, SHA256_CTX *sha) {
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if(fd == -1) return false;
+	posix_fadvise(fd, 0, len, POSIX_FADV_SEQUENTIAL);
+	std::vector<uint8_t> buf(kBufSize);
+	uint64_t pos = 0;
+	while(pos < len) {
+		ssize_t res = pread(fd, buf.data(), std::min<uint64_t>(buf.size(), len - pos), pos);
+		if(res == -1 && errno == EINTR) continue;
+		if(res <= 0) break;
+		SHA256_Update(sha, buf.data(), res);
+		pos += res;
+	}
+	close(fd);
+	SHA256_CTX copy = *sha;
+	uint8_t md[SHA256_DIGEST_LENGTH];
+	SHA256_Final(md, &copy);
+	return pos == len && toHex(md, sizeof(md)) == digest;
+}
+
+}  // namespace
+
+uint64_t resumeOffset(const InstallOptions& opts) {
+	Checkpoint cp;
+	if(opts.checkpoint.empty() || !readCheckpoint(opts.checkpoint, &cp) || cp.streamId != opts.streamId) return 0;
+	return cp.point.in;
+}
+
+bool installImage(int inFd, const InstallOptions& opts, InstallResult *result) {
+	Output output;
+	if(!output.open(opts.output)) return false;
+
+	unsigned threads = opts.threads;
+	if(threads == 0) threads = std::thread::hardware_concurrency();
+	if(threads == 0) threads = 1;
+
+	SHA256_CTX sha;
+	SHA256_Init(&sha);
+	Checkpoint cp;
+	bool resuming = false;
+	if(!opts.checkpoint.empty()) {
+		if(readCheckpoint(opts.checkpoint, &cp) && cp.streamId == opts.streamId) {
+			if(opts.inputOffset == -1)
+				resuming = lseek(inFd, cp.point.in, SEEK_SET) == (off_t)cp.point.in;
+			else
+				resuming = opts.inputOffset > 0 && (uint64_t)opts.inputOffset == cp.point.in;
+		}
+		if(!resuming) unlink(opts.checkpoint.c_str());
+	}
+	if(opts.inputOffset > 0 && !resuming) {
+		fprintf(stderr, "No checkpoint to resume at %lld\n", (long long)opts.inputOffset);
+		result->restart = true;
+		return false;
+	}
+	if(resuming) {
+		fprintf(stderr, "Checking the %llu bytes already written\n", (unsigned long long)cp.point.out);
+		if(!hashPrefix(opts.output, cp.point.out, cp.sha256, &sha)) {
+			fprintf(stderr, "Output doesn't match the checkpoint anymore\n");
+			unlink(opts.checkpoint.c_str());
+			result->restart = true;
+			return false;
+		}
+		fprintf(stderr, "Resuming at input offset %llu\n", (unsigned long long)cp.point.in);
+		output.seek(cp.point.out);
+	}
+
+	Ring ring;
+	std::vector<void*> bufs(kDepth);
+	for(size_t i = 0; i < kDepth; i++) {
+		if(posix_memalign(&bufs[i], kAlign, kBufSize) != 0) {
+			for(size_t j = 0; j < i; j++) free(bufs[j]);
+			return false;
+		}
+		ring.bufs[i] = (uint8_t*)bufs[i];
+	}
+
+	std::thread decoder(decodeAll, inFd, threads, resuming ? &cp : nullptr, &ring);
+	std::deque<ResumePoint> points;
+	Checkpoint next;
+	bool haveNext = false;
+	uint64_t checkpointed = resuming ? cp.point.out : 0;
+	bool ok = true;
+	while(true) {
+		size_t slot, len;
+		bool last;
+		{
+			std::unique_lock<std::mutex> l(ring.lock);
+			ring.cond.wait(l, [&ring] { return ring.head != ring.tail || ring.failed; });
+			if(ring.head == ring.tail) {
+				ok = false;
+				break;
+			}
+			slot = ring.tail % kDepth;
+			len = ring.lens[slot];
+			last = ring.ended && ring.head == ring.tail + 1;
+			points.insert(points.end(), ring.points.begin(), ring.points.end());
+			ring.points.clear();
+			next.format = ring.format;
+		}
+
+		// Snapshot the digest at every resume point within the buffer
+		const uint8_t *buf = ring.bufs[slot];
+		uint64_t start = output.written();
+		size_t hashed = 0;
+		while(!points.empty() && points.front().out <= start + len) {
+			ResumePoint point = std::move(points.front());
+			points.pop_front();
+			if(point.out < start + hashed) continue;
+			SHA256_Update(&sha, buf + hashed, point.out - start - hashed);
+			hashed = point.out - start;
+			SHA256_CTX copy = sha;
+			uint8_t md[SHA256_DIGEST_LENGTH];
+			SHA256_Final(md, &copy);
+			next.point = std::move(point);
+			next.sha256 = toHex(md, sizeof(md));
+			haveNext = true;
+		}
+		SHA256_Update(&sha, buf + hashed, len - hashed);
+
+		bool written = output.write(buf, len);
+		if(written && haveNext && !opts.checkpoint.empty() &&
+				next.point.out >= checkpointed + opts.checkpointInterval) {
+			next.streamId = opts.streamId;
+			written = output.sync();
+			if(written && !writeCheckpoint(opts.checkpoint, next))
+				fprintf(stderr, "Writing checkpoint failed: %s\n", strerror(errno));
+			checkpointed = next.point.out;
+		}
+		if(!written) {
+			fprintf(stderr, "Writing %s at %llu failed: %s\n", opts.output.c_str(),
+					(unsigned long long)output.written(), strerror(errno));
+			std::lock_guard<std::mutex> l(ring.lock);
+			ring.failed = true;
+			ring.cond.notify_all();
+			ok = false;
+			break;
+		}
+
+		std::lock_guard<std::mutex> l(ring.lock);
+		ring.tail++;
+		ring.cond.notify_all();
+		if(last) break;
+	}
+	decoder.join();
+	for(void *buf : bufs) free(buf);
+	if(!ok) {
+		// Most likely the server ignored the range. A dropped connection
+		// or a failed request keeps the checkpoint for the next attempt
+		if(ring.rejected) {
+			fprintf(stderr, "Input doesn't continue the interrupted install\n");
+			unlink(opts.checkpoint.c_str());
+			result->restart = true;
+		}
+		return false;
+	}
+
+	if(!output.finish()) {
+		fprintf(stderr, "Syncing %s failed: %s\n", opts.output.c_str(), strerror(errno));
+		return false;
+	}
+	if(!opts.checkpoint.empty()) unlink(opts.checkpoint.c_str());
+
+	uint8_t digest[SHA256_DIGEST_LENGTH];
+	SHA256_Final(digest, &sha);
+	result->bytes = output.written();
+	result->sha256 = toHex(digest, sizeof(digest));
+	fprintf(stderr, "Wrote %llu bytes, sha256 %s\n", (unsigned long long)result->bytes, result->sha256.c_str());
+	if(!opts.expectedSha256.empty() && strcasecmp(opts.expectedSha256.c_str(), result->sha256.c_str()) != 0) {
+		fprintf(stderr, "sha256 mismatch, expected %s\n", opts.expectedSha256.c_str());
+		return false;
+	}
+	return true;
+}
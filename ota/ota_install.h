@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+// Streams a system image, compressed with xz or zstd or not at all, into a
+// block device or a plain file, hashing what gets written.
+//
+// With a checkpoint file, the install periodically syncs the output and
+// records a point it can resume from: the offset of an xz block or zstd
+// frame in the input, and the output offset it decodes to. An interrupted
+// install then resumes at that point, after checking the output it already
+// wrote still hashes the same.
+struct InstallOptions {
+	std::string output;
+	// Hex SHA-256 of the uncompressed image, empty to only compute it
+	std::string expectedSha256;
+	// xz decoder threads, 0 for one per CPU
+	unsigned threads = 0;
+	// Checkpoint file, empty for none
+	std::string checkpoint;
+	// Identifies the stream, the checkpoint of another stream is dropped
+	std::string streamId;
+	// Input offset the input fd starts at. -1 seeks the input to the
+	// checkpoint if it can, or starts over
+	int64_t inputOffset = -1;
+	// Output bytes between checkpoints
+	uint64_t checkpointInterval = 128 * 1024 * 1024;
+};
+
+struct InstallResult {
+	uint64_t bytes = 0;
+	std::string sha256;
+	// The install couldn't resume from the checkpoint and dropped it, the
+	// stream has to be installed from its start
+	bool restart = false;
+};
+
+// Returns false, after saying why on stderr, if the stream is truncated or
+// corrupted, the output can't be written or the digest doesn't match
+bool installImage(int inFd, const InstallOptions& opts, InstallResult *result);
+
+// Input offset an interrupted install of opts.streamId resumes at, 0 if it
+// has to start over
+uint64_t resumeOffset(const InstallOptions& opts);
@@ -0,0 +1,295 @@
+#include "ota_install.h"
+
+#include <gtest/gtest.h>
+#include <android-base/file.h>
+#include <XzEnc.h>
+#include <openssl/sha.h>
+#include <zstd.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Compressible but not trivially so, with a tail that isn't block aligned
+std::vector<uint8_t> makeImage(size_t len) {
+	std::vector<uint8_t> image(len);
+	std::mt19937 rng(42);
+	for(size_t i = 0; i < len; i++)
+		image[i] = (i / 4096) % 3 == 0 ? 0 : rng() % 16;
+	return image;
+}
+
+std::string sha256Of(const std::vector<uint8_t>& data) {
+	uint8_t digest[SHA256_DIGEST_LENGTH];
+	SHA256(data.data(), data.size(), digest);
+	std::string res;
+	char hex[3];
+	for(uint8_t c : digest) {
+		snprintf(hex, sizeof(hex), "%02x", c);
+		res += hex;
+	}
+	return res;
+}
+
+struct VectorInStream {
+	ISeqInStream vt;
+	const std::vector<uint8_t> *data;
+	size_t pos;
+};
+
+struct VectorOutStream {
+	ISeqOutStream vt;
+	std::vector<uint8_t> *data;
+};
+
+// With sizes in the block headers, what xz -T4 --block-size=1MiB writes
+std::vector<uint8_t> xzCompress(const std::vector<uint8_t>& data, bool blockSizes = true) {
+	VectorInStream in = { {}, &data, 0 };
+	in.vt.Read = [](ISeqInStreamPtr p, void *buf, size_t *size) -> SRes {
+		auto *s = (VectorInStream*)p;
+		*size = std::min(*size, s->data->size() - s->pos);
+		memcpy(buf, s->data->data() + s->pos, *size);
+		s->pos += *size;
+		return SZ_OK;
+	};
+	std::vector<uint8_t> res;
+	VectorOutStream out = { {}, &res };
+	out.vt.Write = [](ISeqOutStreamPtr p, const void *buf, size_t size) -> size_t {
+		auto *s = (VectorOutStream*)p;
+		s->data->insert(s->data->end(), (const uint8_t*)buf, (const uint8_t*)buf + size);
+		return size;
+	};
+	CXzProps props;
+	XzProps_Init(&props);
+	props.lzma2Props.lzmaProps.level = 1;
+	props.checkId = XZ_CHECK_CRC64;
+	if(blockSizes) {
+		props.blockSize = 1024 * 1024;
+		props.numBlockThreads_Max = 4;
+		props.forceWriteSizesInHeader = 1;
+	}
+	EXPECT_EQ(Xz_Encode(&out.vt, &in.vt, &props, nullptr), SZ_OK);
+	return res;
+}
+
+// Several frames, as pzstd writes
+std::vector<uint8_t> zstdCompress(const std::vector<uint8_t>& data) {
+	std::vector<uint8_t> out;
+	for(size_t off = 0; off < data.size(); off += 3 * 1024 * 1024) {
+		size_t len = std::min(data.size() - off, (size_t)3 * 1024 * 1024);
+		std::vector<uint8_t> frame(ZSTD_compressBound(len));
+		size_t res = ZSTD_compress(frame.data(), frame.size(), data.data() + off, len, 3);
+		EXPECT_FALSE(ZSTD_isError(res));
+		out.insert(out.end(), frame.begin(), frame.begin() + res);
+	}
+	return out;
+}
+
+class InstallTest : public ::testing::Test {
+protected:
+	InstallTest() {
+		opts.output = out.path;
+		opts.threads = 4;
+	}
+
+	bool install(const std::vector<uint8_t>& stream, const std::string& expected = "", size_t from = 0) {
+		TemporaryFile in;
+		EXPECT_TRUE(android::base::WriteFully(in.fd, stream.data() + from, stream.size() - from));
+		EXPECT_EQ(lseek(in.fd, 0, SEEK_SET), 0);
+		opts.expectedSha256 = expected;
+		result = InstallResult();
+		return installImage(in.fd, opts, &result);
+	}
+
+	// Installs the first part of the stream, as a dropped download would,
+	// and resumes with the rest
+	void interruptAndResume(const std::vector<uint8_t>& stream, const std::vector<uint8_t>& image) {
+		opts.checkpoint = checkpoint.path;
+		opts.streamId = "test";
+		opts.checkpointInterval = 1024 * 1024;
+		std::vector<uint8_t> head(stream.begin(), stream.begin() + stream.size() * 2 / 3);
+		ASSERT_FALSE(install(head));
+		EXPECT_FALSE(result.restart);
+
+		uint64_t offset = resumeOffset(opts);
+		ASSERT_GT(offset, 0u);
+		ASSERT_LT(offset, head.size());
+		opts.inputOffset = offset;
+		ASSERT_TRUE(install(stream, sha256Of(image), offset));
+		EXPECT_EQ(written(), image);
+		EXPECT_EQ(resumeOffset(opts), 0u);
+	}
+
+	std::vector<uint8_t> written() {
+		std::string content;
+		EXPECT_TRUE(android::base::ReadFileToString(out.path, &content));
+		return std::vector<uint8_t>(content.begin(), content.end());
+	}
+
+	TemporaryFile out;
+	TemporaryFile checkpoint;
+	InstallOptions opts;
+	InstallResult result;
+};
+
+TEST_F(InstallTest, CopiesUncompressedImage) {
+	auto image = makeImage(5 * 1024 * 1024 + 123);
+	ASSERT_TRUE(install(image, sha256Of(image)));
+	EXPECT_EQ(result.bytes, image.size());
+	EXPECT_EQ(written(), image);
+}
+
+TEST_F(InstallTest, DecodesMultiBlockXz) {
+	auto image = makeImage(9 * 1024 * 1024 + 4097);
+	ASSERT_TRUE(install(xzCompress(image), sha256Of(image)));
+	EXPECT_EQ(result.sha256, sha256Of(image));
+	EXPECT_EQ(written(), image);
+}
+
+// Streamed blocks, as single threaded xz writes, between blocks decoded in
+// parallel
+TEST_F(InstallTest, DecodesXzWithoutBlockSizes) {
+	auto image = makeImage(5 * 1024 * 1024 + 4097);
+	std::vector<uint8_t> head(image.begin(), image.begin() + 2 * 1024 * 1024);
+	std::vector<uint8_t> tail(image.begin() + 2 * 1024 * 1024, image.end());
+	auto xz = xzCompress(head, false);
+	auto sized = xzCompress(tail);
+	xz.insert(xz.end(), 8, 0);
+	xz.insert(xz.end(), sized.begin(), sized.end());
+	auto unsized = xzCompress(head, false);
+	xz.insert(xz.end(), unsized.begin(), unsized.end());
+	image.insert(image.end(), head.begin(), head.end());
+	ASSERT_TRUE(install(xz, sha256Of(image)));
+	EXPECT_EQ(written(), image);
+}
+
+TEST_F(InstallTest, DecodesConcatenatedZstdFrames) {
+	auto image = makeImage(10 * 1024 * 1024 + 17);
+	ASSERT_TRUE(install(zstdCompress(image), sha256Of(image)));
+	EXPECT_EQ(written(), image);
+}
+
+TEST_F(InstallTest, ShrinksPlainFileOutput) {
+	auto image = makeImage(8 * 1024 * 1024);
+	ASSERT_TRUE(install(image));
+	image.resize(1024 * 1024 + 1);
+	ASSERT_TRUE(install(xzCompress(image)));
+	EXPECT_EQ(written(), image);
+}
+
+TEST_F(InstallTest, RejectsTruncatedStreams) {
+	auto image = makeImage(6 * 1024 * 1024);
+	auto xz = xzCompress(image);
+	xz.resize(xz.size() / 2);
+	EXPECT_FALSE(install(xz));
+	auto zstd = zstdCompress(image);
+	zstd.resize(zstd.size() - 100);
+	EXPECT_FALSE(install(zstd));
+}
+
+TEST_F(InstallTest, RejectsDigestMismatch) {
+	auto image = makeImage(2 * 1024 * 1024);
+	std::string expected = sha256Of(image);
+	image[1000] ^= 1;
+	EXPECT_FALSE(install(xzCompress(image), expected));
+	EXPECT_EQ(result.sha256, sha256Of(image));
+}
+
+TEST_F(InstallTest, ResumesXzAtBlock) {
+	auto image = makeImage(9 * 1024 * 1024 + 4097);
+	interruptAndResume(xzCompress(image), image);
+}
+
+TEST_F(InstallTest, ResumesZstdAtFrame) {
+	auto image = makeImage(20 * 1024 * 1024 + 17);
+	interruptAndResume(zstdCompress(image), image);
+}
+
+TEST_F(InstallTest, SeeksSeekableInputToCheckpoint) {
+	auto image = makeImage(9 * 1024 * 1024);
+	auto xz = xzCompress(image);
+	opts.checkpoint = checkpoint.path;
+	opts.streamId = "test";
+	opts.checkpointInterval = 1024 * 1024;
+	ASSERT_FALSE(install(std::vector<uint8_t>(xz.begin(), xz.begin() + xz.size() / 2)));
+	ASSERT_GT(resumeOffset(opts), 0u);
+	ASSERT_TRUE(install(xz, sha256Of(image)));
+	EXPECT_EQ(written(), image);
+}
+
+// The connection dropping again, or the request failing, right when the
+// install resumes
+TEST_F(InstallTest, KeepsCheckpointWhenResumedInputEnds) {
+	auto image = makeImage(20 * 1024 * 1024 + 17);
+	for(auto stream : { xzCompress(image), zstdCompress(image) }) {
+		opts.checkpoint = checkpoint.path;
+		opts.streamId = "test";
+		opts.checkpointInterval = 1024 * 1024;
+		ASSERT_FALSE(install(std::vector<uint8_t>(stream.begin(), stream.begin() + stream.size() / 2)));
+		uint64_t offset = resumeOffset(opts);
+		ASSERT_GT(offset, 0u);
+
+		opts.inputOffset = offset;
+		EXPECT_FALSE(install(std::vector<uint8_t>(stream.begin(), stream.begin() + offset), "", offset));
+		EXPECT_FALSE(result.restart);
+		EXPECT_FALSE(install(std::vector<uint8_t>(stream.begin(), stream.begin() + offset + 100), "", offset));
+		EXPECT_FALSE(result.restart);
+		EXPECT_EQ(resumeOffset(opts), offset);
+
+		ASSERT_TRUE(install(stream, sha256Of(image), offset));
+		EXPECT_EQ(written(), image);
+		opts.inputOffset = -1;
+	}
+}
+
+// A server ignoring the range sends the stream from its start
+TEST_F(InstallTest, RestartsWhenInputDoesntContinue) {
+	auto image = makeImage(9 * 1024 * 1024);
+	auto xz = xzCompress(image);
+	opts.checkpoint = checkpoint.path;
+	opts.streamId = "test";
+	opts.checkpointInterval = 1024 * 1024;
+	ASSERT_FALSE(install(std::vector<uint8_t>(xz.begin(), xz.begin() + xz.size() / 2)));
+	uint64_t offset = resumeOffset(opts);
+	ASSERT_GT(offset, 0u);
+
+	opts.inputOffset = offset;
+	EXPECT_FALSE(install(xz));
+	EXPECT_TRUE(result.restart);
+	EXPECT_EQ(resumeOffset(opts), 0u);
+}
+
+TEST_F(InstallTest, RestartsWhenOutputChanged) {
+	auto image = makeImage(9 * 1024 * 1024);
+	auto xz = xzCompress(image);
+	opts.checkpoint = checkpoint.path;
+	opts.streamId = "test";
+	opts.checkpointInterval = 1024 * 1024;
+	ASSERT_FALSE(install(std::vector<uint8_t>(xz.begin(), xz.begin() + xz.size() / 2)));
+	uint64_t offset = resumeOffset(opts);
+	ASSERT_GT(offset, 0u);
+
+	int fd = open(out.path, O_WRONLY);
+	ASSERT_TRUE(android::base::WriteFully(fd, "x", 1));
+	close(fd);
+	opts.inputOffset = offset;
+	EXPECT_FALSE(install(xz, "", offset));
+	EXPECT_TRUE(result.restart);
+	EXPECT_EQ(resumeOffset(opts), 0u);
+}
+
+TEST_F(InstallTest, IgnoresCheckpointOfAnotherStream) {
+	auto image = makeImage(9 * 1024 * 1024);
+	auto xz = xzCompress(image);
+	opts.checkpoint = checkpoint.path;
+	opts.streamId = "old";
+	opts.checkpointInterval = 1024 * 1024;
+	ASSERT_FALSE(install(std::vector<uint8_t>(xz.begin(), xz.begin() + xz.size() / 2)));
+	ASSERT_GT(resumeOffset(opts), 0u);
+	opts.streamId = "new";
+	EXPECT_EQ(resumeOffset(opts), 0u);
+}
+
+}  // namespace
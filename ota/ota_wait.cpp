@@ -0,0 +1,92 @@
+#include "ota_wait.h"
+
+#include <linux/netlink.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace {
+
+int64_t nowMs() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Kernel uevents, -1 if they aren't available (no netlink in the sandbox)
+int openUevents() {
+	int fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_KOBJECT_UEVENT);
+	if(fd == -1) return -1;
+	struct sockaddr_nl addr = {};
+	addr.nl_family = AF_NETLINK;
+	addr.nl_groups = 1;
+	if(bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+// Watches the deepest existing directory on the way to path, whose next
+// component is the one to show up
+void watchAncestor(int inotifyFd, const std::string& path) {
+	std::string dir = path;
+	while(true) {
+		size_t slash = dir.find_last_of('/');
+		if(slash == std::string::npos) {
+			dir = ".";
+		} else {
+			dir = slash == 0 ? "/" : dir.substr(0, slash);
+		}
+		if(inotify_add_watch(inotifyFd, dir.c_str(), IN_CREATE | IN_MOVED_TO | IN_ONLYDIR) != -1)
+			return;
+		if(dir == "/" || dir == ".") return;
+	}
+}
+
+void drain(int fd) {
+	char buf[4096];
+	while(read(fd, buf, sizeof(buf)) > 0);
+}
+
+}  // namespace
+
+bool waitForPath(const std::string& path, int timeoutMs, struct stat *sb, int recheckMs) {
+	sb->st_mode = 0;
+	if(stat(path.c_str(), sb) == 0) return true;
+
+	int64_t deadline = nowMs() + timeoutMs;
+	int inotifyFd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+	int ueventFd = openUevents();
+	bool found = false;
+	while(true) {
+		// Watch before checking, so a node created in between still wakes
+		// the poll up
+		if(inotifyFd != -1) watchAncestor(inotifyFd, path);
+		if(stat(path.c_str(), sb) == 0) {
+			found = true;
+			break;
+		}
+		int64_t left = deadline - nowMs();
+		if(left <= 0) break;
+
+		struct pollfd fds[2] = {
+			{ inotifyFd, POLLIN, 0 },
+			{ ueventFd, POLLIN, 0 },
+		};
+		int res = poll(fds, 2, (int)std::min<int64_t>(left, recheckMs));
+		if(res == -1 && errno != EINTR) break;
+		if(inotifyFd != -1 && (fds[0].revents & POLLIN)) drain(inotifyFd);
+		if(ueventFd != -1 && (fds[1].revents & POLLIN)) drain(ueventFd);
+	}
+	if(inotifyFd != -1) close(inotifyFd);
+	if(ueventFd != -1) close(ueventFd);
+	if(!found) sb->st_mode = 0;
+	return found;
+}
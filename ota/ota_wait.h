@@ -0,0 +1,14 @@
+#pragma once
+
+#include <sys/stat.h>
+#include <string>
+
+// Waits up to timeoutMs for path to show up, and stats it into sb. Returns
+// false if it still doesn't exist by then.
+//
+// Device nodes are created by ueventd after the kernel announced the
+// device, so the wait wakes up on both the uevent and the inotify event of
+// the node, or of a directory leading to it, rather than polling. Some
+// filesystems (functionfs, sysfs) don't report their files to inotify, for
+// those the path is still checked every recheckMs.
+bool waitForPath(const std::string& path, int timeoutMs, struct stat *sb, int recheckMs = 100);
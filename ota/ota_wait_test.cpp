@@ -0,0 +1,51 @@
+#include "ota_wait.h"
+
+#include <gtest/gtest.h>
+#include <android-base/file.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+namespace {
+
+using namespace std::chrono_literals;
+using namespace std::string_literals;
+
+TEST(WaitTest, ReturnsExistingPath) {
+	TemporaryFile file;
+	struct stat sb;
+	ASSERT_TRUE(waitForPath(file.path, 0, &sb));
+	EXPECT_TRUE(S_ISREG(sb.st_mode));
+}
+
+TEST(WaitTest, TimesOut) {
+	TemporaryDir dir;
+	struct stat sb;
+	auto start = std::chrono::steady_clock::now();
+	EXPECT_FALSE(waitForPath(dir.path + "/missing"s, 200, &sb));
+	EXPECT_GE(std::chrono::steady_clock::now() - start, 200ms);
+	EXPECT_EQ(sb.st_mode, 0u);
+}
+
+// Without rechecks, only inotify can wake the wait up in time
+TEST(WaitTest, WakesUpOnNestedCreation) {
+	TemporaryDir dir;
+	std::string sub = dir.path + "/sub"s;
+	std::string path = sub + "/node";
+	std::thread creator([&] {
+		std::this_thread::sleep_for(50ms);
+		mkdir(sub.c_str(), 0755);
+		std::this_thread::sleep_for(50ms);
+		android::base::WriteStringToFile("", path);
+	});
+	struct stat sb;
+	auto start = std::chrono::steady_clock::now();
+	EXPECT_TRUE(waitForPath(path, 5000, &sb, 5000));
+	EXPECT_LT(std::chrono::steady_clock::now() - start, 2s);
+	creator.join();
+	unlink(path.c_str());
+	rmdir(sub.c_str());
+}
+
+}  // namespace
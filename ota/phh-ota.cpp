@@ -1,14 +1,26 @@
+#include <algorithm>
 #include <string>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/mount.h>
 #include <sys/sysmacros.h>
 #include <sys/xattr.h>
+#include <sys/ioctl.h>
+#include <errno.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <getopt.h>
 #include <libfiemap/image_manager.h>
 #include <android-base/file.h>
+#include <android-base/properties.h>
+#include <android-base/strings.h>
+
+#include "ota_delta.h"
+#include "ota_install.h"
+#include "ota_wait.h"
 
 using namespace std::chrono_literals;
 using namespace std::string_literals;
@@ -25,54 +37,323 @@ std::string getNextSlot() {
     return next_slot;
 }
 
+// Outcome of the last install into a slot: "pending", "ok <sha256>" or
+// "failed <sha256>". switch-slot refuses anything but "ok"
+std::string installRecord(const std::string& slot) {
+	return "/metadata/gsi/phh/install_"s + slot;
+}
+
+// Where an interrupted install into a slot resumes, see ota_install.h. As
+// long as it exists, the slot's image is kept for the install to resume
+std::string checkpointPath(const std::string& slot) {
+	return "/metadata/gsi/phh/checkpoint_"s + slot;
+}
+
+void deleteSlotImage(IImageManager *imgManager, const std::string& slot) {
+	if(access(checkpointPath(slot).c_str(), F_OK) == 0) {
+		fprintf(stderr, "Keeping slot %s, its install can be resumed\n", slot.c_str());
+		return;
+	}
+	imgManager->UnmapImageDevice("system_otaphh_"s + slot);
+	imgManager->DeleteBackingImage("system_otaphh_"s + slot);
+}
+
+int printResumeOffset(int argc, char **argv) {
+	InstallOptions opts;
+	opts.checkpoint = checkpointPath(getNextSlot());
+	int c;
+	while((c = getopt(argc, argv, "i:")) != -1) {
+		if(c != 'i') {
+			fprintf(stderr, "Usage: phh-ota resume-offset [-i id]\n");
+			return 1;
+		}
+		opts.streamId = optarg;
+	}
+	printf("%llu\n", (unsigned long long)resumeOffset(opts));
+	return 0;
+}
+
+// Exits with 2 when the install has to start over from the start of the
+// stream
+int install(int argc, char **argv) {
+	InstallOptions opts;
+	opts.output = "/dev/phh-ota";
+	opts.checkpoint = checkpointPath(getNextSlot());
+	int c;
+	while((c = getopt(argc, argv, "o:s:j:i:r:")) != -1) {
+		switch(c) {
+			case 'o':
+				opts.output = optarg;
+				break;
+			case 's':
+				opts.expectedSha256 = android::base::Trim(optarg);
+				break;
+			case 'j':
+				opts.threads = atoi(optarg);
+				break;
+			case 'i':
+				opts.streamId = optarg;
+				break;
+			case 'r':
+				opts.inputOffset = strtoll(optarg, nullptr, 10);
+				break;
+			default:
+				fprintf(stderr, "Usage: phh-ota install [-o output] [-s sha256] [-j threads] [-i id] [-r input offset] [file]\n");
+				return 1;
+		}
+	}
+	// A pipe can only start over, unless the caller says where it starts
+	int inFd = 0;
+	if(optind == argc && opts.inputOffset == -1) opts.inputOffset = 0;
+	if(optind < argc) {
+		inFd = open(argv[optind], O_RDONLY | O_CLOEXEC);
+		if(inFd == -1) {
+			fprintf(stderr, "Opening %s failed: %s\n", argv[optind], strerror(errno));
+			return 1;
+		}
+	}
+
+	std::string record = installRecord(getNextSlot());
+	android::base::WriteStringToFile("pending\n", record);
+	InstallResult result;
+	bool ok = installImage(inFd, opts, &result);
+	android::base::WriteStringToFile((ok ? "ok "s : "failed "s) + result.sha256 + "\n", record);
+	if(ok) return 0;
+	return result.restart ? 2 : 1;
+}
+
+// What new-slot allocates when it isn't told the image size
+static const uint64_t kDefaultImageSize = 4*1024*1024*1024LL;
+// dm-linear maps whole extents, don't hand it a ragged tail
+static const uint64_t kImageAlign = 1024*1024;
+// How much bigger than needed a previous image may be and still be reused
+static const uint64_t kReuseSlack = 256*1024*1024;
+
+// Size of the image a file holds: expanded for a sparse image, the target
+// of a delta payload, as is otherwise
+uint64_t imageSize(const char *path) {
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if(fd == -1) return 0;
+	uint32_t header[7];
+	DeltaHeader delta;
+	uint64_t size = 0;
+	if(pread(fd, header, sizeof(header), 0) == sizeof(header) && header[0] == 0xed26ff3a) {
+		// blk_sz and total_blks of the sparse header
+		size = (uint64_t)header[3] * header[4];
+	} else if(pread(fd, &delta, sizeof(delta), 0) == sizeof(delta) &&
+			memcmp(delta.magic, DELTA_MAGIC, sizeof(delta.magic)) == 0) {
+		size = delta.targetBlocks * delta.blockSize;
+	} else {
+		size = lseek(fd, 0, SEEK_END);
+	}
+	close(fd);
+	return size;
+}
+
+uint64_t blockDevSize(const std::string& path) {
+	uint64_t size = 0;
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if(fd == -1) return 0;
+	if(ioctl(fd, BLKGETSIZE64, &size) != 0) size = 0;
+	close(fd);
+	return size;
+}
+
+// How long ueventd gets to create the node of a mapped image
+static const int kBlockDevTimeoutMs = 10000;
+
+bool waitForBlockDev(const std::string& blockDev, struct stat *sb) {
+	return waitForPath(blockDev, kBlockDevTimeoutMs, sb) && S_ISBLK(sb->st_mode);
+}
+
+// For the boot scripts: exits with 1 if a path is still missing after the
+// timeout
+int waitDevice(int argc, char **argv) {
+	int timeoutMs = kBlockDevTimeoutMs;
+	int c;
+	while((c = getopt(argc, argv, "t:")) != -1) {
+		if(c != 't') {
+			fprintf(stderr, "Usage: phh-ota wait-device [-t timeout ms] path...\n");
+			return 1;
+		}
+		timeoutMs = atoi(optarg);
+	}
+	if(optind >= argc) {
+		fprintf(stderr, "Usage: phh-ota wait-device [-t timeout ms] path...\n");
+		return 1;
+	}
+	struct timespec start, now;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(int i = optind; i < argc; i++) {
+		// The timeout is for all of them
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		int elapsedMs = (now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000;
+		struct stat sb;
+		if(!waitForPath(argv[i], std::max(timeoutMs - elapsedMs, 0), &sb)) {
+			fprintf(stderr, "%s didn't show up\n", argv[i]);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// System image the running system booted from, the source of a delta
+std::string currentSystem(IImageManager *imgManager) {
+	std::string slot;
+	if(getenv("PHH_OTA_SLOT") != NULL) {
+		slot = getenv("PHH_OTA_SLOT");
+	} else {
+		android::base::ReadFileToString("/metadata/phh/img", &slot);
+	}
+	std::string blockDev;
+	if(!slot.empty() && imgManager->GetMappedImageDevice("system_otaphh_"s + slot[0], &blockDev))
+		return blockDev;
+	return "/dev/block/mapper/system"s + android::base::GetProperty("ro.boot.slot_suffix", "");
+}
+
+int applyDeltaCommand(IImageManager *imgManager, int argc, char **argv) {
+	DeltaOptions opts;
+	opts.target = "/dev/phh-ota";
+	int c;
+	while((c = getopt(argc, argv, "S:o:j:")) != -1) {
+		switch(c) {
+			case 'S':
+				opts.source = optarg;
+				break;
+			case 'o':
+				opts.target = optarg;
+				break;
+			case 'j':
+				opts.workers = atoi(optarg);
+				break;
+			default:
+				fprintf(stderr, "Usage: phh-ota apply-delta [-S source] [-o output] [-j workers] payload\n");
+				return 1;
+		}
+	}
+	if(optind + 1 != argc) {
+		fprintf(stderr, "Usage: phh-ota apply-delta [-S source] [-o output] [-j workers] payload\n");
+		return 1;
+	}
+	opts.payload = argv[optind];
+	if(opts.source.empty()) opts.source = currentSystem(imgManager);
+	fprintf(stderr, "Applying %s onto %s\n", opts.payload.c_str(), opts.source.c_str());
+
+	std::string record = installRecord(getNextSlot());
+	android::base::WriteStringToFile("pending\n", record);
+	bool ok = applyDelta(opts);
+	// Every block was checked against its hash, there is no image-wide one
+	android::base::WriteStringToFile(ok ? "ok delta\n" : "failed delta\n", record);
+	return ok ? 0 : 1;
+}
+
 int main(int argc, char **argv) {
 	mkdir("/metadata/gsi/phh", 0771);
 	chown("/metadata/gsi/phh", 0, 1000);
 	mkdir("/data/gsi/phh", 0771);
 	chown("/data/gsi/phh", 0, 1000);
 
+	if(argc>=2 && strcmp(argv[1], "install") == 0) {
+		return install(argc - 1, argv + 1);
+	}
+	if(argc>=2 && strcmp(argv[1], "resume-offset") == 0) {
+		return printResumeOffset(argc - 1, argv + 1);
+	}
+	if(argc>=2 && strcmp(argv[1], "wait-device") == 0) {
+		return waitDevice(argc - 1, argv + 1);
+	}
+
 	auto imgManager = IImageManager::Open("phh", 0ms);
 	if(argc>=2 && strcmp(argv[1], "unmap") == 0) {
 		fprintf(stderr, "Unmapping backing image returned %s\n", imgManager->UnmapImageDevice("system_otaphh_a") ? "true" : "false");
 		fprintf(stderr, "Unmapping backing image returned %s\n", imgManager->UnmapImageDevice("system_otaphh_b") ? "true" : "false");
 		return 0;
 	}
+	if(argc>=2 && strcmp(argv[1], "apply-delta") == 0) {
+		return applyDeltaCommand(imgManager.get(), argc - 1, argv + 1);
+	}
 	if(argc>=2 && strcmp(argv[1], "switch-slot") == 0) {
 		std::string next_slot = getNextSlot();
+		std::string record;
+		if(android::base::ReadFileToString(installRecord(next_slot), &record) &&
+				!android::base::StartsWith(record, "ok ")) {
+			fprintf(stderr, "Refusing to switch to slot %s, its install is %s", next_slot.c_str(), record.c_str());
+			return 1;
+		}
 		mkdir("/metadata/phh", 0700);
 		android::base::WriteStringToFile(next_slot, "/metadata/phh/img");
 		return 0;
 	}
 	if(argc>=2 && strcmp(argv[1], "new-slot") == 0) {
+		uint64_t size = 0;
+		int c;
+		optind = 1;
+		while((c = getopt(argc - 1, argv + 1, "s:f:")) != -1) {
+			switch(c) {
+				case 's':
+					size = strtoull(optarg, nullptr, 10);
+					break;
+				case 'f':
+					size = imageSize(optarg);
+					if(size == 0) {
+						fprintf(stderr, "Can't tell the size of %s\n", optarg);
+						return -1;
+					}
+					break;
+				default:
+					fprintf(stderr, "Usage: phh-ota new-slot [-s bytes] [-f image]\n");
+					return -1;
+			}
+		}
+		if(size == 0) size = kDefaultImageSize;
+		size = (size + kImageAlign - 1) & ~(kImageAlign - 1);
+
 		std::string next_slot = getNextSlot();
 
 		std::string imageName = "system_otaphh_"s + next_slot;
 
 		fprintf(stderr, "Unmapping backing image returned %s\n", imgManager->UnmapImageDevice(imageName) ? "true" : "false");
-		fprintf(stderr, "Deleting backing image returned %s\n", imgManager->DeleteBackingImage(imageName) ? "true" : "false");
-		auto backRes = imgManager->CreateBackingImage(imageName, 4*1024*1024*1024LL, IImageManager::CREATE_IMAGE_DEFAULT, nullptr);
-		if(backRes.is_ok()) {
-			fprintf(stderr, "Creating system image succeeded\n");
-		} else {
-			fprintf(stderr, "Creating system image failed\n");
-			return -1;
-		}
-
+		// Deleting and recreating the image costs a full allocation and
+		// fragments /data further, keep the previous one when it fits
 		std::string blockDev;
-		fprintf(stderr, "Mapping backing image returned %s\n", imgManager->MapImageDevice(imageName, 0ms, &blockDev) ? "true" : "false");
-		fprintf(stderr, "blockdev is %s\n", blockDev.c_str());
-		printf("%s\n", blockDev.c_str());
-
 		struct stat sb;
-		for(int i=0; i<10; i++) {
-			if(!stat(blockDev.c_str(), &sb)) break;
-			sleep(1);
+		bool reuse = false;
+		bool resumable = access(checkpointPath(next_slot).c_str(), F_OK) == 0;
+		// Whatever the slot held, no install into it completed yet
+		unlink(installRecord(next_slot).c_str());
+		if(imgManager->BackingImageExists(imageName) &&
+				imgManager->MapImageDevice(imageName, 0ms, &blockDev) && waitForBlockDev(blockDev, &sb)) {
+			uint64_t current = blockDevSize(blockDev);
+			uint64_t slack = std::max(kReuseSlack, size / 8);
+			reuse = current >= size && (resumable || current - size <= slack);
+			if(reuse) {
+				// A resumable install keeps what it wrote, see install
+				fprintf(stderr, "Reusing %llu bytes system image%s\n", (unsigned long long)current,
+						resumable ? " of the interrupted install" : "");
+			} else {
+				imgManager->UnmapImageDevice(imageName);
+			}
 		}
-
-		if(!S_ISBLK(sb.st_mode)) {
-			fprintf(stderr, "blockDev wasn't block dev\n");
-			return -1;
+		if(!reuse || !resumable) {
+			unlink(checkpointPath(next_slot).c_str());
 		}
+		if(!reuse) {
+			fprintf(stderr, "Deleting backing image returned %s\n", imgManager->DeleteBackingImage(imageName) ? "true" : "false");
+			auto backRes = imgManager->CreateBackingImage(imageName, size, IImageManager::CREATE_IMAGE_DEFAULT, nullptr);
+			if(backRes.is_ok()) {
+				fprintf(stderr, "Creating %llu bytes system image succeeded\n", (unsigned long long)size);
+			} else {
+				fprintf(stderr, "Creating system image failed\n");
+				return -1;
+			}
+			fprintf(stderr, "Mapping backing image returned %s\n", imgManager->MapImageDevice(imageName, 0ms, &blockDev) ? "true" : "false");
+			if(!waitForBlockDev(blockDev, &sb)) {
+				fprintf(stderr, "blockDev wasn't block dev\n");
+				return -1;
+			}
+		}
+		fprintf(stderr, "blockdev is %s\n", blockDev.c_str());
+		printf("%s\n", blockDev.c_str());
 
 		unlink("/dev/phh-ota");
 		mknod("/dev/phh-ota", 0664 | S_IFBLK, makedev(major(sb.st_rdev), minor(sb.st_rdev)));
@@ -87,20 +368,16 @@ int main(int argc, char **argv) {
 	if(argc>=2 && strcmp(argv[1], "delete-other-slot") == 0) {
 		const char* current_slot = getenv("PHH_OTA_SLOT");
 		if(current_slot == NULL) {
-			imgManager->UnmapImageDevice("system_otaphh_a");
-			imgManager->DeleteBackingImage("system_otaphh_a");
-			imgManager->UnmapImageDevice("system_otaphh_b");
-			imgManager->DeleteBackingImage("system_otaphh_b");
+			deleteSlotImage(imgManager.get(), "a");
+			deleteSlotImage(imgManager.get(), "b");
 			return 0;
 		}
 		if(current_slot[0] == 'a') {
-			imgManager->UnmapImageDevice("system_otaphh_b");
-			imgManager->DeleteBackingImage("system_otaphh_b");
+			deleteSlotImage(imgManager.get(), "b");
 			return 0;
 		}
 		if(current_slot[0] == 'b') {
-			imgManager->UnmapImageDevice("system_otaphh_a");
-			imgManager->DeleteBackingImage("system_otaphh_a");
+			deleteSlotImage(imgManager.get(), "a");
 			return 0;
 		}
 		return 0;
@@ -43,7 +43,8 @@ if [ -f /cache/phh-adb ];then
 
     /apex/com.android.adbd/bin/adbd &
 
-    sleep 1
+    # The endpoints show up once adbd wrote its descriptors
+    phh-ota wait-device -t 3000 /dev/usb-ffs/adb/ep1 /dev/usb-ffs/adb/ep2 || sleep 1
     echo none > /config/usb_gadget/g1/UDC
     ln -s /config/usb_gadget/g1/functions/ffs.adb /config/usb_gadget/g1/configs/c.1/f1
     ls /sys/class/udc |head -n 1 > /config/usb_gadget/g1/UDC